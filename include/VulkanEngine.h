@@ -43,15 +43,95 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
   }
 }
 
+// mesh instances that can go out as one instanced draw
+struct InstanceBatch {
+  uint32_t mesh;
+  uint32_t material;
+  // indices into mesh_instances
+  std::vector<uint32_t> instances;
+};
+
 struct QueueFamilyIndices {
   std::optional<uint32_t> graphics_family;
   std::optional<uint32_t> present_family;
+  // transfer only family (no graphics or compute), usually a dedicated DMA engine
+  std::optional<uint32_t> transfer_family;
 
   bool IsComplete() {
     return graphics_family.has_value() && present_family.has_value();
   }
 };
 
+// set from the command line in main
+struct EngineOptions {
+  // record a synthetic scene with 1..N threads, print CPU time per frame and exit
+  bool bench_recording = false;
+  // measure job spawn/steal throughput and parallel for scaling, no window or device needed
+  bool bench_jobs = false;
+  // check spawn, steal, dependencies, exception propagation and a parallel for stress loop on the
+  // job system, throw on the first failure and exit. no window or device needed
+  bool test_jobs = false;
+  // keep 32 byte float vertices instead of the smallest layout that fits the mesh
+  bool full_precision_vertices = false;
+  // load this scene through assimp instead of the viking room obj
+  std::string model_path;
+  // map <model>.baked when it is up to date, otherwise import and write it
+  bool bake_meshes = true;
+  // time importing the model from source against mapping its bake and exit
+  bool bench_mesh_load = false;
+  // converted assets are kept in cache_directory, keyed on their source bytes
+  bool use_asset_cache = true;
+  std::string cache_directory = "cache";
+  // convert every asset into the cache without opening a window and exit
+  bool prewarm_cache = false;
+  // write a synthetic scene with this many meshes, time loading it with 1..N threads and exit
+  size_t bench_model_meshes = 0;
+  size_t bench_draw_count = 10000;
+  // load shaders/<stage>[.<define>...].spv compiled offline instead of the glsl
+  bool precompiled_shaders = false;
+  // compile a few hundred synthetic shader variants with 1..N threads and exit
+  bool bench_shaders = false;
+  // resize the window this many times, print the cost of the resize frames against a normal one and exit
+  uint32_t bench_resize_count = 0;
+  // no window or swapchain, render headless_frames into offscreen images and exit.
+  // animation runs on a fixed 60 Hz clock so every run produces the same frames
+  bool headless = false;
+  uint32_t headless_frames = 100;
+  // headless only, every frame is read back to <headless_output>/frame_0000.png, ...
+  std::string headless_output;
+  // GPU scope timings are written here as a Chrome trace on exit
+  std::string gpu_trace_path;
+  // same for the CPU scopes, empty unless the build has the CPU profiler compiled in
+  std::string cpu_trace_path;
+  // skip mesh instances whose bounds are outside the view frustum
+  bool frustum_culling = true;
+  // cull a million random boxes with every instruction set the CPU has, 1 thread and all of them, and exit
+  bool bench_culling = false;
+  // update a 500k node transform hierarchy fully, partially and clean, 1 thread and all of them,
+  // check it against a recursive update and exit
+  bool bench_transforms = false;
+  // cull on the GPU and draw everything with one indirect call, per object data lives in a storage buffer.
+  // headless runs also cull on the CPU and compare the visible counts
+  bool gpu_driven = false;
+  // render graph barriers go through vkCmdPipelineBarrier2 when VK_KHR_synchronization2 is supported
+  bool sync2 = true;
+  // replace the scene with this many copies of it laid out on a grid, for testing large object counts
+  uint32_t scatter_count = 0;
+  // visible instances of the same mesh and material are drawn with one instanced draw,
+  // transforms go through a per instance vertex stream. not used with gpu_driven
+  bool instancing = true;
+  // the texture's mip chain is blitted on the GPU when the device can filter its format in a blit.
+  // without gpu_mips it is downsampled on the CPU while decoding and cached with the texture
+  bool gpu_mips = true;
+  // filter for mips made on the CPU. kaiser has no blit equivalent, so it always runs on the CPU
+  MipFilter mip_filter = MipFilter::BOX;
+  // downsample a 4096x4096 image to 1x1 with every filter, scalar and SIMD, 1 thread and all of them, and exit
+  bool bench_mips = false;
+  // drive one device memory block's free list with a random allocate/free mix, check it for overlaps and that
+  // it coalesces back into one range, print throughput and fragmentation and exit. no window or device needed
+  bool bench_allocator = false;
+};
+
 // struct to get necessary swap chain information
 struct SwapChainSupportDetails {
   VkSurfaceCapabilitiesKHR capabilities;
@@ -59,40 +139,219 @@ struct SwapChainSupportDetails {
   std::vector<VkPresentModeKHR> present_modes;
 };
 
+// tinyobj's own material file reader, remembering which material libraries the obj pulled in
+class RecordingMaterialReader : public tinyobj::MaterialReader {
+public:
+  RecordingMaterialReader(const std::string& directory, std::vector<std::string>& opened)
+    : reader_(directory), directory_(directory), opened_(opened) {}
+
+  bool operator()(const std::string& mat_id, std::vector<tinyobj::material_t>* materials,
+    std::map<std::string, int>* mat_map, std::string* warn, std::string* err) override {
+    bool loaded = reader_(mat_id, materials, mat_map, warn, err);
+    if (loaded) {
+      opened_.push_back(directory_ + mat_id);
+    }
+    return loaded;
+  }
+
+private:
+  tinyobj::MaterialFileReader reader_;
+  std::string directory_;
+  std::vector<std::string>& opened_;
+};
+
 class VulkanEngine {
 public:
+  VulkanEngine(const EngineOptions& options = EngineOptions()) : options(options) {}
+
   void run() {
-    InitWindow();
+    CPU_PROFILE_THREAD("main");
+    jobs.Init(std::max(1u, std::thread::hardware_concurrency()));
+    if (options.use_asset_cache && !asset_cache.Init(options.cache_directory)) {
+      std::cerr << "asset cache disabled, could not create " << options.cache_directory << std::endl;
+    }
+    shader_cache.Init(asset_cache.IsEnabled() ? &asset_cache : nullptr);
+    instance.shader_cache = &shader_cache;
+    shader_library.Init(jobs, &shader_cache);
+
+    if (options.prewarm_cache) {
+      PrewarmCache();
+      jobs.Destroy();
+      return;
+    }
+    if (options.bench_jobs) {
+      BenchmarkJobs();
+      jobs.Destroy();
+      return;
+    }
+    if (options.test_jobs) {
+      TestJobs();
+      jobs.Destroy();
+      return;
+    }
+    if (options.bench_shaders) {
+      BenchmarkShaders();
+      jobs.Destroy();
+      return;
+    }
+    if (options.bench_mesh_load) {
+      BenchmarkMeshLoad();
+      jobs.Destroy();
+      return;
+    }
+    if (options.bench_model_meshes > 0) {
+      BenchmarkModelLoad(options.bench_model_meshes);
+      jobs.Destroy();
+      return;
+    }
+    if (options.bench_culling) {
+      BenchmarkCulling(1000000, 100);
+      jobs.Destroy();
+      return;
+    }
+    if (options.bench_transforms) {
+      BenchmarkTransforms(500000, 100);
+      jobs.Destroy();
+      return;
+    }
+    if (options.bench_mips) {
+      BenchmarkMips(4096, 10);
+      jobs.Destroy();
+      return;
+    }
+    if (options.bench_allocator) {
+      BenchmarkAllocator(1000000);
+      jobs.Destroy();
+      return;
+    }
+
+    if (options.headless && options.bench_resize_count > 0) {
+      throw std::runtime_error("--bench-resize needs a window");
+    }
+    if (options.gpu_driven && options.bench_recording) {
+      throw std::runtime_error("--bench-recording measures the CPU draw list, it can't run --gpu-driven");
+    }
+
+    if (!options.headless) {
+      InitWindow();
+    }
     InitVulkan();
-    MainLoop();
+    if (options.bench_recording) {
+      BenchmarkRecording(options.bench_draw_count, 100);
+    }
+    else if (options.bench_resize_count > 0) {
+      BenchmarkResize(options.bench_resize_count);
+    }
+    else if (options.headless) {
+      RunHeadless();
+    }
+    else {
+      MainLoop();
+    }
     Cleanup();
+    jobs.Destroy();
+    asset_cache.PrintStats();
+
+    CpuProfiler::PrintFrameStats();
+    if (!options.cpu_trace_path.empty() && !CpuProfiler::WriteChromeTrace(options.cpu_trace_path)) {
+      std::cerr << "failed to write " << options.cpu_trace_path << std::endl;
+    }
   }
 
 private:
 
   void MainLoop() {
     while (!glfwWindowShouldClose(instance.window)) {
-      glfwPollEvents();
+      {
+        CPU_PROFILE_SCOPE("poll events");
+        glfwPollEvents();
+        jobs.PumpMainThread();
+      }
+      DrawFrame();
+      CPU_PROFILE_FRAME();
+    }
+    vkDeviceWaitIdle(instance.device);
+  }
+
+  // renders a fixed number of frames, optionally writing each one out, and prints the average frame time
+  void RunHeadless() {
+    bool save_frames = !options.headless_output.empty();
+    if (save_frames) {
+      std::filesystem::create_directories(options.headless_output);
+    }
+
+    float readback_ms = 0.0f;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (uint32_t ii = 0; ii < options.headless_frames; ii++) {
+      jobs.PumpMainThread();
+
+      // DrawFrame moves current_frame on, the offscreen target is indexed by frame in flight
+      uint32_t image_index = static_cast<uint32_t>(current_frame);
       DrawFrame();
+      CPU_PROFILE_FRAME();
+
+      if (save_frames) {
+        auto readback_start = std::chrono::high_resolution_clock::now();
+        char name[32];
+        snprintf(name, sizeof(name), "frame_%04u.png", ii);
+        SaveOffscreenImage(image_index, options.headless_output + "/" + name);
+        readback_ms += std::chrono::duration<float, std::chrono::milliseconds::period>(
+          std::chrono::high_resolution_clock::now() - readback_start).count();
+      }
     }
     vkDeviceWaitIdle(instance.device);
+    auto end_time = std::chrono::high_resolution_clock::now();
+
+    float total_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count();
+    std::cout << options.headless_frames << " headless frames: " << (total_ms - readback_ms) / options.headless_frames
+      << " ms per frame";
+    if (save_frames) {
+      std::cout << ", " << readback_ms / options.headless_frames << " ms per readback";
+    }
+    std::cout << std::endl;
+
+    if (options.gpu_driven) {
+      // the frames still in flight at the end were never collected by DrawFrame
+      for (uint32_t ii = 0; ii < MAX_FRAMES_IN_FLIGHT; ii++) {
+        CollectGpuCulling(ii);
+      }
+      std::cout << "gpu culling: " << gpu_cull_mismatches << " of " << gpu_culler.GetStats().frames
+        << " frames disagreed with the CPU visible count" << std::endl;
+    }
   }
+
   void Cleanup() {
 
+    gpu_profiler.PrintStats();
+    if (!options.gpu_trace_path.empty() && !gpu_profiler.WriteChromeTrace(options.gpu_trace_path)) {
+      std::cerr << "failed to write " << options.gpu_trace_path << std::endl;
+    }
+    gpu_profiler.Destroy();
+
     CleanupSwapChain();
+    render_graph.Destroy();
 
     vkDestroySampler(instance.device, texture_sampler, nullptr);
     vkDestroyImageView(instance.device, texture_image_view, nullptr);
     vkDestroyImage(instance.device, texture_image, nullptr);
-    vkFreeMemory(instance.device, texture_image_memory, nullptr);
+    allocator.Free(texture_image_allocation);
 
-    vkDestroyDescriptorSetLayout(instance.device, descriptor_set_layout, nullptr);
+    if (options.gpu_driven) {
+      gpu_culler.PrintStats();
+      gpu_culler.Destroy();
+    }
+    else if (draw_stats.frames > 0) {
+      std::cout << "draws per frame: " << static_cast<float>(draw_stats.submissions) / draw_stats.frames
+        << " submitted, " << static_cast<float>(draw_stats.draws) / draw_stats.frames << " after batching" << std::endl;
+    }
 
-    vkDestroyBuffer(instance.device, vert_buffer.GetBuffer(), nullptr);
-    vkFreeMemory(instance.device, vert_buffer.GetBufferMemory(), nullptr);
+    pipeline_manager.Destroy();
+    vkDestroyPipelineLayout(instance.device, pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(instance.device, descriptor_set_layout, nullptr);
 
-    vkDestroyBuffer(instance.device, ind_buffer.GetBuffer(), nullptr);
-    vkFreeMemory(instance.device, ind_buffer.GetBufferMemory(), nullptr);
+    vert_buffer.Destroy(instance);
+    ind_buffer.Destroy(instance);
+    transient_allocator.Destroy(instance);
 
     for (size_t ii = 0; ii < MAX_FRAMES_IN_FLIGHT; ii++) {
       vkDestroySemaphore(instance.device, render_finished_semaphores[ii], nullptr);
@@ -101,46 +360,98 @@ private:
     }
 
     vkDestroyCommandPool(instance.device, command_pool, nullptr);
+    recorder.Destroy();
+
+    upload_manager.Destroy();
+    allocator.PrintStats();
+    allocator.Destroy();
     vkDestroyDevice(instance.device, nullptr);
 
     if (enable_validation_layers) {
       DestroyDebugUtilsMessengerEXT(instance.instance, instance.debug_messenger, nullptr);
     }
 
-    vkDestroySurfaceKHR(instance.instance, instance.surface, nullptr);
+    if (!options.headless) {
+      vkDestroySurfaceKHR(instance.instance, instance.surface, nullptr);
+    }
     vkDestroyInstance(instance.instance, nullptr);
-    glfwDestroyWindow(instance.window);
-    glfwTerminate();
+    if (!options.headless) {
+      glfwDestroyWindow(instance.window);
+      glfwTerminate();
+    }
   }
 
   void InitWindow() {
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
     instance.window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+    glfwSetWindowUserPointer(instance.window, this);
+    glfwSetFramebufferSizeCallback(instance.window, FramebufferResizeCallback);
   }
 
   void InitVulkan() {
-    CreateInstance();
-    SetupDebugMessenger();
-    CreateSurface();
-    PickPhysicalDevice();
-    CreateLogicalDevice();
-    CreateSwapChain();
-    CreateImageViews();
-    CreateRenderPass();
-    CreateDescriptorSetLayout();
+    // asset decoding doesn't touch the device, so it overlaps with device and pipeline setup
+    jobs.Run([this] { DecodeTexture(); }, &assets_loaded);
+    jobs.Run([this] { LoadModel(); }, &assets_loaded);
+
+    try {
+      CreateInstance();
+      SetupDebugMessenger();
+      if (!options.headless) {
+        CreateSurface();
+      }
+      PickPhysicalDevice();
+      CreateLogicalDevice();
+      CreatePipelineManager();
+      CreateAllocator();
+      CreateUploadManager();
+      if (options.headless) {
+        CreateOffscreenTargets();
+      }
+      else {
+        CreateSwapChain();
+      }
+      CreateImageViews();
+      CreateRenderPass();
+      CreateDescriptorSetLayout();
+      CreatePipelineLayout();
+    }
+    catch (...) {
+      // the asset jobs write into this engine, they have to finish before the setup error unwinds past it.
+      // theirs would only be a second error, the setup one is what gets reported
+      try {
+        jobs.Wait(assets_loaded);
+      }
+      catch (...) {
+      }
+      throw;
+    }
+    // the pipeline's vertex input depends on the layout picked for the model
+    jobs.Wait(assets_loaded);
+    if (options.scatter_count > 1) {
+      ScatterInstances(options.scatter_count);
+    }
+    scene_root = scene_transforms.AddNode();
+    BuildCullBounds();
+    BuildInstanceBatches();
+    CompileShaders();
     CreateGraphicsPipeline();
     CreateCommandPool();
-    CreateDepthResources();
+    CreateGpuProfiler();
+    CreateCommandRecorder();
+    CreateRenderGraph();
     CreateFrameBuffers();
     CreateTextureImage();
     CreateTextureImageView();
     CreateTextureSampler();
-    LoadModel();
     CreateVertexBuffer();
     CreateIndexBuffer();
-    CreateUniformBuffers();
+    if (options.gpu_driven) {
+      CreateGpuCuller();
+    }
+    FinishUploads();
+    CreateTransientBuffers();
     CreateDescriptorPool();
     CreateDescriptorSets();
     CreateCommandBuffers();
@@ -161,8 +472,9 @@ private:
 
     bool extensions_supported = CheckDeviceExtensionSupport(device);
 
-    bool swap_chain_adequate = false;
-    if (extensions_supported) {
+    // nothing is presented without a window
+    bool swap_chain_adequate = options.headless;
+    if (extensions_supported && !options.headless) {
       SwapChainSupportDetails swap_chain_support = QuerySwapChainSupport(device);
       swap_chain_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
     }
@@ -184,7 +496,8 @@ private:
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count,
       availiable_extensions.data());
 
-    std::set<std::string> required_extensions(device_extensions.begin(), device_extensions.end());
+    std::vector<const char*> extensions = RequiredDeviceExtensions();
+    std::set<std::string> required_extensions(extensions.begin(), extensions.end());
 
     for (const auto& extension : availiable_extensions) {
       required_extensions.erase(extension.extensionName);
@@ -194,6 +507,27 @@ private:
 
   }
 
+  bool DeviceExtensionSupported(VkPhysicalDevice device, const char* name) {
+    uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
+    std::vector<VkExtensionProperties> available_extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
+
+    for (const auto& extension : available_extensions) {
+      if (strcmp(extension.extensionName, name) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<const char*> RequiredDeviceExtensions() const {
+    if (options.headless) {
+      return {};
+    }
+    return device_extensions;
+  }
+
   void PickPhysicalDevice() {
     uint32_t device_count = 0;
     vkEnumeratePhysicalDevices(instance.instance, &device_count, nullptr);
@@ -232,22 +566,30 @@ private:
     int ii = 0;
     // iterate through the queue family and check if at least one queue family 
     // supports the queue graphics bit?
+    // every family is visited since a transfer only family is usually listed last
     for (const auto& queue_family : queue_families) {
-      if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+      if (!indices.graphics_family.has_value() && (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
         indices.graphics_family = ii;
       }
 
       // look for a queue family that has capability of presenting to our window surface
       // ii is the queue family index
+      // headless there is no surface, the graphics family stands in so the rest of the setup is unchanged
       VkBool32 present_support = false;
-      vkGetPhysicalDeviceSurfaceSupportKHR(device, ii, instance.surface, &present_support);
+      if (options.headless) {
+        present_support = (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+      }
+      else {
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, ii, instance.surface, &present_support);
+      }
 
-      if (present_support) {
+      if (!indices.present_family.has_value() && present_support) {
         indices.present_family = ii;
       }
 
-      if (indices.IsComplete()) {
-        break;
+      if (!indices.transfer_family.has_value() && (queue_family.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+        !(queue_family.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+        indices.transfer_family = ii;
       }
       ii++;
     }
@@ -261,6 +603,9 @@ private:
 
     std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
     std::set<uint32_t> unique_queue_families = { indices.graphics_family.value(), indices.present_family.value() };
+    if (indices.transfer_family.has_value()) {
+      unique_queue_families.insert(indices.transfer_family.value());
+    }
 
     float queue_priority = 1.0f;
     for (uint32_t queue_family : unique_queue_families) {
@@ -276,13 +621,52 @@ private:
     VkPhysicalDeviceFeatures device_features{};
     device_features.samplerAnisotropy = VK_TRUE;
 
+    std::vector<const char*> extensions = RequiredDeviceExtensions();
+
+    // the indirect draws pass the object index in firstInstance, which is optional on some hardware
+    VkPhysicalDeviceFeatures supported_features{};
+    vkGetPhysicalDeviceFeatures(instance.physical_device, &supported_features);
+    if (options.gpu_driven && !supported_features.drawIndirectFirstInstance) {
+      std::cerr << "drawIndirectFirstInstance is not supported, falling back to CPU culling" << std::endl;
+      options.gpu_driven = false;
+    }
+    bool draw_indirect_count = false;
+    if (options.gpu_driven) {
+      device_features.drawIndirectFirstInstance = VK_TRUE;
+      device_features.multiDrawIndirect = supported_features.multiDrawIndirect;
+      gpu_cull_features.multi_draw_indirect = supported_features.multiDrawIndirect == VK_TRUE;
+
+      draw_indirect_count = DeviceExtensionSupported(instance.physical_device, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+      if (draw_indirect_count) {
+        extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+      }
+    }
+
+    // the render graph falls back to vkCmdPipelineBarrier without it
+    VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2_features{};
+    synchronization2_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+    VkPhysicalDeviceProperties device_properties{};
+    vkGetPhysicalDeviceProperties(instance.physical_device, &device_properties);
+    if (options.sync2 && device_properties.apiVersion >= VK_API_VERSION_1_1 &&
+      DeviceExtensionSupported(instance.physical_device, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)) {
+      VkPhysicalDeviceFeatures2 features2{};
+      features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      features2.pNext = &synchronization2_features;
+      vkGetPhysicalDeviceFeatures2(instance.physical_device, &features2);
+    }
+    bool synchronization2 = synchronization2_features.synchronization2 == VK_TRUE;
+    if (synchronization2) {
+      extensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    }
+
     VkDeviceCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    create_info.pNext = synchronization2 ? &synchronization2_features : nullptr;
     create_info.pQueueCreateInfos = queue_create_infos.data();
     create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
     create_info.pEnabledFeatures = &device_features;
-    create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
-    create_info.ppEnabledExtensionNames = device_extensions.data();
+    create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    create_info.ppEnabledExtensionNames = extensions.data();
 
     // add validation layer info
     if (enable_validation_layers) {
@@ -300,6 +684,34 @@ private:
     // retrieve queue handles for each queue family
     vkGetDeviceQueue(instance.device, indices.graphics_family.value(), 0, &instance.graphics_queue);
     vkGetDeviceQueue(instance.device, indices.graphics_family.value(), 0, &presentation_queue);
+
+    if (draw_indirect_count) {
+      gpu_cull_features.draw_indirect_count = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+        vkGetDeviceProcAddr(instance.device, "vkCmdDrawIndexedIndirectCountKHR"));
+    }
+    if (synchronization2) {
+      pipeline_barrier2 = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(
+        vkGetDeviceProcAddr(instance.device, "vkCmdPipelineBarrier2KHR"));
+    }
+  }
+
+  void CreateAllocator() {
+    allocator.Init(instance);
+    instance.allocator = &allocator;
+    allocator.PrintMemoryReport();
+  }
+
+  void CreateUploadManager() {
+    QueueFamilyIndices indices = FindQueueFamilies(instance.physical_device);
+    upload_manager.Init(instance, indices.graphics_family.value(), indices.transfer_family);
+    render_data.uploader = &upload_manager;
+  }
+
+  // submit every staged copy from loading and block once until they land
+  void FinishUploads() {
+    upload_manager.WaitIdle();
+    upload_manager.PrintStats();
+    baked_mesh.Close();
   }
 
   // get the swap chain support details
@@ -376,7 +788,8 @@ private:
   }
 
   // use all the helper functions I created to create the swap chain 
-  void CreateSwapChain()
+  // old_swap_chain is retired by the new one, images it already handed out can still be presented
+  void CreateSwapChain(VkSwapchainKHR old_swap_chain = VK_NULL_HANDLE)
   {
     SwapChainSupportDetails swap_chain_support = QuerySwapChainSupport(instance.physical_device);
     VkSurfaceFormatKHR surface_format = ChooseSwapSurfaceFormat(swap_chain_support.formats);
@@ -418,6 +831,7 @@ private:
     create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     create_info.presentMode = present_mode;
     create_info.clipped = VK_TRUE;
+    create_info.oldSwapchain = old_swap_chain;
 
     if (vkCreateSwapchainKHR(instance.device, &create_info, nullptr, &swap_chain) != VK_SUCCESS) {
       throw std::runtime_error("failed to create swap chain");
@@ -431,18 +845,96 @@ private:
     swap_chain_extent = extent;
   }
 
+  // headless stand in for the swapchain, one color target per frame in flight so the frame's
+  // fence also covers its target. the format matches what SaveOffscreenImage writes out
+  void CreateOffscreenTargets() {
+    swap_chain_image_format = VK_FORMAT_R8G8B8A8_SRGB;
+    swap_chain_extent = { WIDTH, HEIGHT };
+
+    swap_chain_images.resize(MAX_FRAMES_IN_FLIGHT);
+    offscreen_allocations.resize(MAX_FRAMES_IN_FLIGHT);
+    for (size_t ii = 0; ii < swap_chain_images.size(); ii++) {
+      CreateImage(WIDTH, HEIGHT, 1, swap_chain_image_format, VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, MemoryUsage::GPU_ONLY,
+        swap_chain_images[ii], offscreen_allocations[ii]);
+    }
+  }
+
+  // copies a finished offscreen target into host memory and writes it as a PNG
+  void SaveOffscreenImage(uint32_t image_index, const std::string& path) {
+    VkDeviceSize size = static_cast<VkDeviceSize>(swap_chain_extent.width) * swap_chain_extent.height * 4;
+
+    if (readback_buffer == VK_NULL_HANDLE) {
+      VkBufferCreateInfo buffer_info{};
+      buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+      buffer_info.size = size;
+      buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+      buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+      if (vkCreateBuffer(instance.device, &buffer_info, nullptr, &readback_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create readback buffer");
+      }
+      readback_allocation = allocator.AllocateBuffer(readback_buffer, MemoryUsage::GPU_TO_CPU);
+    }
+
+    VkCommandBuffer command_buffer = BeginSingleTimeCommands();
+
+    // the render graph already left the image in TRANSFER_SRC_OPTIMAL, the writes still have to be made visible
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+      0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = { swap_chain_extent.width, swap_chain_extent.height, 1 };
+    vkCmdCopyImageToBuffer(command_buffer, swap_chain_images[image_index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      readback_buffer, 1, &region);
+
+    VkMemoryBarrier host_barrier{};
+    host_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+      0, 1, &host_barrier, 0, nullptr, 0, nullptr);
+
+    EndSingleTimeCommands(command_buffer);
+
+    if (!(readback_allocation.property_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+      VkPhysicalDeviceProperties properties{};
+      vkGetPhysicalDeviceProperties(instance.physical_device, &properties);
+      VkDeviceSize atom = properties.limits.nonCoherentAtomSize;
+
+      VkMappedMemoryRange range{};
+      range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+      range.memory = readback_allocation.memory;
+      range.offset = readback_allocation.offset / atom * atom;
+      range.size = VK_WHOLE_SIZE;
+      vkInvalidateMappedMemoryRanges(instance.device, 1, &range);
+    }
+
+    if (!stbi_write_png(path.c_str(), static_cast<int>(swap_chain_extent.width), static_cast<int>(swap_chain_extent.height),
+      4, readback_allocation.mapped, static_cast<int>(swap_chain_extent.width * 4))) {
+      throw std::runtime_error("failed to write " + path);
+    }
+  }
+
   void CreateImageViews() {
     swap_chain_image_views.resize(swap_chain_images.size());
 
     for (size_t ii = 0; ii < swap_chain_images.size(); ii++) {
-      swap_chain_image_views[ii] = CreateImageView(swap_chain_images[ii], swap_chain_image_format, VK_IMAGE_ASPECT_COLOR_BIT);
+      swap_chain_image_views[ii] = CreateImageView(swap_chain_images[ii], swap_chain_image_format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
     }
   }
 
   void CreateDescriptorSetLayout() {
     VkDescriptorSetLayoutBinding ubo_layout_binding{};
     ubo_layout_binding.binding = 0;
-    ubo_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    // dynamic so each draw can point at its own slice of the frame's transient buffer
+    ubo_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     // one uniform buffer, could pass in an array of ubos and we would need to
     // put the number of elements in the array
     ubo_layout_binding.descriptorCount = 1;
@@ -456,7 +948,18 @@ private:
     sampler_layout_binding.pImmutableSamplers = nullptr;
     sampler_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = { ubo_layout_binding, sampler_layout_binding };
+    std::vector<VkDescriptorSetLayoutBinding> bindings = { ubo_layout_binding, sampler_layout_binding };
+
+    // GPU driven draws read their transform from the cull pass's object buffer
+    if (options.gpu_driven) {
+      VkDescriptorSetLayoutBinding object_layout_binding{};
+      object_layout_binding.binding = 2;
+      object_layout_binding.descriptorCount = 1;
+      object_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      object_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+      bindings.push_back(object_layout_binding);
+    }
+
     VkDescriptorSetLayoutCreateInfo layout_info{};
     layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -468,124 +971,106 @@ private:
 
   }
 
-  void CreateGraphicsPipeline() {
-
-    Shader vert_shader("shaders/vert.glsl", "main", ShaderType::VERTEX_SHADER, instance);
-    Shader frag_shader("shaders/frag.glsl", "main", ShaderType::FRAGMENT_SHADER, instance);
-
-    VkPipelineShaderStageCreateInfo shader_stages[] = { vert_shader.GetInfo(), frag_shader.GetInfo() };
-
-    auto binding_description = Vertex::GetBindingDescription();
-    auto attribute_descriptions = Vertex::GetAttributeDescription();
-    // vertex input stage
-    VkPipelineVertexInputStateCreateInfo vertex_input_info{};
-    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertex_input_info.vertexBindingDescriptionCount = 1;
-    vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribute_descriptions.size());
-    vertex_input_info.pVertexBindingDescriptions = &binding_description;
-    vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions.data();
-
-    // input assembly stage
-    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
-    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    input_assembly.primitiveRestartEnable = VK_FALSE;
+  // offline compiled variant for the given defines, e.g. shaders/vert.has_color.has_normal.spv
+  static std::string PrecompiledShaderPath(const std::string& stage, const std::vector<std::string>& defines) {
+    std::string path = "shaders/" + stage;
+    for (const auto& define : defines) {
+      std::string name = define.substr(0, define.find('='));
+      std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+      path += "." + name;
+    }
+    return path + ".spv";
+  }
 
-    // viewports and scissors
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)swap_chain_extent.width;
-    viewport.height = (float)swap_chain_extent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
+  // every variant the pipelines need, compiled in parallel once. swapchain recreation reuses the SPIR-V
+  void CompileShaders() {
+    CPU_PROFILE_SCOPE("CompileShaders");
+    auto start_time = std::chrono::high_resolution_clock::now();
 
-    VkRect2D scissor{};
-    scissor.offset = { 0,0 };
-    scissor.extent = swap_chain_extent;
+    std::vector<std::string> vert_defines = vertex_layout.GetShaderDefines();
+    if (options.gpu_driven) {
+      vert_defines.push_back("GPU_DRIVEN");
+    }
+    else if (UseInstancing()) {
+      vert_defines.push_back("INSTANCED");
+    }
+    std::string vert_path = options.precompiled_shaders ? PrecompiledShaderPath("vert", vert_defines) : "shaders/vert.glsl";
+    std::string frag_path = options.precompiled_shaders ? PrecompiledShaderPath("frag", {}) : "shaders/frag.glsl";
 
-    VkPipelineViewportStateCreateInfo viewport_state{};
-    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewport_state.viewportCount = 1;
-    viewport_state.pViewports = &viewport;
-    viewport_state.scissorCount = 1;
-    viewport_state.pScissors = &scissor;
-
-    // rasterizer 
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rasterizer.depthBiasEnable = VK_FALSE;
-
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-    VkPipelineColorBlendAttachmentState color_blend_attachment{};
-    color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    color_blend_attachment.blendEnable = VK_FALSE;
-
-    VkPipelineColorBlendStateCreateInfo color_blending{};
-    color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    color_blending.logicOpEnable = VK_FALSE;
-    color_blending.logicOp = VK_LOGIC_OP_COPY; // Optional
-    color_blending.attachmentCount = 1;
-    color_blending.pAttachments = &color_blend_attachment;
-    color_blending.blendConstants[0] = 0.0f; // Optional
-    color_blending.blendConstants[1] = 0.0f; // Optional
-    color_blending.blendConstants[2] = 0.0f; // Optional
-    color_blending.blendConstants[3] = 0.0f; // Optional
+    vert_shader_variant = shader_library.Add(vert_path, ShaderType::VERTEX_SHADER, vert_defines);
+    frag_shader_variant = shader_library.Add(frag_path, ShaderType::FRAGMENT_SHADER);
+    if (options.gpu_driven) {
+      std::string cull_path = options.precompiled_shaders ? PrecompiledShaderPath("cull", {}) : "shaders/cull.glsl";
+      cull_shader_variant = shader_library.Add(cull_path, ShaderType::COMPUTE_SHADER);
+    }
+    shader_library.Compile();
 
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::cout << shader_library.VariantCount() << " shader variant(s) ready in "
+      << std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count() << " ms" << std::endl;
+    shader_cache.PrintStats();
+  }
 
+  // lives as long as the device, pipelines built against it survive swapchain recreation
+  void CreatePipelineLayout() {
     VkPipelineLayoutCreateInfo pipeline_layout_info{};
     pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipeline_layout_info.setLayoutCount = 1;
     pipeline_layout_info.pSetLayouts = &descriptor_set_layout;
-    pipeline_layout_info.pushConstantRangeCount = 0;
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(MeshConstants);
+
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
 
     if (vkCreatePipelineLayout(instance.device, &pipeline_layout_info, nullptr, &pipeline_layout) != VK_SUCCESS) {
       throw std::runtime_error("failed to create graphics pipeline layout!");
     }
+  }
 
-    // we'll use this to enable depth testing in the graphics pipeline
-    VkPipelineDepthStencilStateCreateInfo depth_stencil{};
-    depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depth_stencil.depthTestEnable = VK_TRUE;
-    depth_stencil.depthWriteEnable = VK_TRUE;
-    depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
-    depth_stencil.depthBoundsTestEnable = VK_FALSE;
-    depth_stencil.minDepthBounds = 0.0f; // optional
-    depth_stencil.maxDepthBounds = 1.0f; // optional
-    depth_stencil.stencilTestEnable = VK_FALSE;
-    depth_stencil.front = {}; // optional 
-    depth_stencil.back = {}; // optional
-
-    VkGraphicsPipelineCreateInfo pipeline_info{};
-    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipeline_info.stageCount = 2;
-    pipeline_info.pStages = shader_stages;
-    pipeline_info.pVertexInputState = &vertex_input_info;
-    pipeline_info.pInputAssemblyState = &input_assembly;
-    pipeline_info.pViewportState = &viewport_state;
-    pipeline_info.pRasterizationState = &rasterizer;
-    pipeline_info.pMultisampleState = &multisampling;
-    pipeline_info.pDepthStencilState = &depth_stencil;
-    pipeline_info.pColorBlendState = &color_blending;
-    pipeline_info.layout = pipeline_layout;
-    pipeline_info.renderPass = render_pass;
-    pipeline_info.subpass = 0;
-    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
-
-    if (vkCreateGraphicsPipelines(instance.device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &graphics_pipeline) !=
-      VK_SUCCESS) {
-      throw std::runtime_error("failed to create graphics pipeline!");
+  void CreatePipelineManager() {
+    // the driver cache goes in a subdirectory of the asset cache, which only indexes the files at its top level,
+    // so the LRU never counts or evicts it. it is rebuilt from scratch when caching is off
+    std::string cache_path;
+    if (asset_cache.IsEnabled()) {
+      std::filesystem::path directory = std::filesystem::path(options.cache_directory) / "pipelines";
+      std::error_code error;
+      std::filesystem::create_directories(directory, error);
+      if (!error) {
+        cache_path = (directory / "pipelines.bin").string();
+      }
     }
+    pipeline_manager.Init(instance, cache_path);
+  }
+
+  // the pipeline is owned by the pipeline manager, asking again with the same state returns the same one
+  void CreateGraphicsPipeline() {
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    GraphicsPipelineDesc desc;
+    desc.vertex_spirv = &shader_library.GetSpirv(vert_shader_variant);
+    desc.fragment_spirv = &shader_library.GetSpirv(frag_shader_variant);
+    desc.vertex_layout = vertex_layout;
+    if (UseInstancing()) {
+      desc.instance_bindings = { InstanceData::GetBindingDescription() };
+      auto instance_attributes = InstanceData::GetAttributeDescription();
+      desc.instance_attributes.assign(instance_attributes.begin(), instance_attributes.end());
+    }
+    desc.layout = pipeline_layout;
+    desc.render_pass = render_pass;
+    desc.subpass = 0;
+    desc.color_formats = { swap_chain_image_format };
+    desc.depth_format = FindDepthFormat();
+
+    graphics_pipeline = pipeline_manager.GetGraphicsPipeline(desc);
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::cout << "graphics pipeline ready in "
+      << std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count() << " ms" << std::endl;
+    pipeline_manager.PrintStats();
   }
 
 
@@ -597,8 +1082,9 @@ private:
     color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // the render graph moves both attachments in and out of these layouts around the pass
+    color_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
     VkAttachmentDescription depth_attachment{};
     depth_attachment.format = FindDepthFormat();
@@ -607,7 +1093,7 @@ private:
     depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depth_attachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
     depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference depth_attachment_ref{};
@@ -625,14 +1111,6 @@ private:
     subpass.pColorAttachments = &color_attachment_ref;
     subpass.pDepthStencilAttachment = &depth_attachment_ref;
 
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
     std::array<VkAttachmentDescription, 2> attachments = { color_attachment, depth_attachment };
 
     VkRenderPassCreateInfo render_pass_info{};
@@ -641,8 +1119,8 @@ private:
     render_pass_info.pAttachments = attachments.data();
     render_pass_info.subpassCount = 1;
     render_pass_info.pSubpasses = &subpass;
-    render_pass_info.dependencyCount = 1;
-    render_pass_info.pDependencies = &dependency;
+    // no external dependencies, the render graph's barriers in front of the pass cover them
+    render_pass_info.dependencyCount = 0;
 
     if (vkCreateRenderPass(instance.device, &render_pass_info, nullptr, &render_pass) != VK_SUCCESS) {
       throw std::runtime_error("failed to create render pass!");
@@ -653,7 +1131,7 @@ private:
     swap_chain_framebuffers.resize(swap_chain_images.size());
 
     for (size_t ii = 0; ii < swap_chain_image_views.size(); ii++) {
-      std::array<VkImageView, 2> attachments = { swap_chain_image_views[ii], depth_image_view };
+      std::array<VkImageView, 2> attachments = { swap_chain_image_views[ii], render_graph.GetImageView(graph_depth) };
       VkFramebufferCreateInfo framebuffer_info{};
       framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
       framebuffer_info.renderPass = render_pass;
@@ -677,7 +1155,8 @@ private:
     VkCommandPoolCreateInfo pool_info{};
     pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     pool_info.queueFamilyIndex = queue_family_indices.graphics_family.value();
-    pool_info.flags = 0;
+    // command buffers are re-recorded every frame
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
     if (vkCreateCommandPool(instance.device, &pool_info, nullptr, &command_pool) != VK_SUCCESS) {
       throw std::runtime_error("failed to create command pool!");
@@ -686,15 +1165,57 @@ private:
     render_data.command_pool = command_pool;
   }
 
-  void CreateDepthResources() {
-    VkFormat depth_format = FindDepthFormat();
+  void CreateGpuProfiler() {
+    QueueFamilyIndices queue_family_indices = FindQueueFamilies(instance.physical_device);
+    gpu_profiler.Init(instance, queue_family_indices.graphics_family.value(), MAX_FRAMES_IN_FLIGHT);
+  }
+
+  // one pool per job system worker, so it has to be recreated if the job system is
+  void CreateCommandRecorder() {
+    QueueFamilyIndices queue_family_indices = FindQueueFamilies(instance.physical_device);
+    recorder.Init(instance, jobs, queue_family_indices.graphics_family.value(), MAX_FRAMES_IN_FLIGHT);
+  }
+
+  void CreateRenderGraph() {
+    render_graph.Init(instance, pipeline_barrier2);
+    BuildRenderGraph();
+    render_graph.PrintStats();
+  }
+
+  // the frame's passes in execution order. rebuilt with the swapchain, the depth buffer is a
+  // transient sized to the extent and the imported handles are filled in every frame
+  void BuildRenderGraph() {
+    render_graph.Reset();
+
+    // headless frames are copied out instead of presented
+    graph_color = render_graph.ImportImage("color", swap_chain_image_format, VK_IMAGE_LAYOUT_UNDEFINED,
+      options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    graph_depth = render_graph.CreateImage("depth", { FindDepthFormat(), swap_chain_extent });
 
-    CreateImage(swap_chain_extent.width, swap_chain_extent.height, depth_format, VK_IMAGE_TILING_OPTIMAL,
-      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-      depth_image, depth_image_memory);
+    if (options.gpu_driven) {
+      graph_cull_draws = render_graph.ImportBuffer("cull draws");
+      graph_cull_count = render_graph.ImportBuffer("cull count");
 
-    depth_image_view = CreateImageView(depth_image, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT);
+      uint32_t cull_pass = render_graph.AddPass("cull", [this](VkCommandBuffer command_buffer) {
+        uint32_t cull_scope = gpu_profiler.BeginScope(command_buffer, "cull");
+        gpu_culler.RecordCull(command_buffer, static_cast<uint32_t>(current_frame), frame_frustum);
+        gpu_profiler.EndScope(command_buffer, cull_scope);
+      });
+      render_graph.UseResource(cull_pass, graph_cull_draws, ResourceUse::STORAGE_WRITE);
+      render_graph.UseResource(cull_pass, graph_cull_count, ResourceUse::STORAGE_WRITE);
+    }
+
+    uint32_t main_pass = render_graph.AddPass("main pass", [this](VkCommandBuffer command_buffer) {
+      RecordMainPass(command_buffer);
+    });
+    render_graph.UseResource(main_pass, graph_color, ResourceUse::COLOR_ATTACHMENT);
+    render_graph.UseResource(main_pass, graph_depth, ResourceUse::DEPTH_ATTACHMENT);
+    if (options.gpu_driven) {
+      render_graph.UseResource(main_pass, graph_cull_draws, ResourceUse::INDIRECT_READ);
+      render_graph.UseResource(main_pass, graph_cull_count, ResourceUse::INDIRECT_READ);
+    }
 
+    render_graph.Compile();
   }
 
 
@@ -717,10 +1238,6 @@ private:
     }
   }
   
-  bool HasStencilComponent(VkFormat format) {
-    return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
-  }
-
   VkFormat FindDepthFormat() {
 
     return FindSupportedFormat(
@@ -730,7 +1247,7 @@ private:
     );
   }
 
-  VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags) {
+  VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels) {
     VkImageViewCreateInfo view_info{};
     view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     view_info.image = image;
@@ -738,7 +1255,7 @@ private:
     view_info.format = format;
     view_info.subresourceRange.aspectMask = aspect_flags;
     view_info.subresourceRange.baseMipLevel = 0;
-    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.levelCount = mip_levels;
     view_info.subresourceRange.baseArrayLayer = 0;
     view_info.subresourceRange.layerCount = 1;
 
@@ -750,57 +1267,108 @@ private:
   }
 
 
-  void CreateTextureImage() {
+  // decided before there is a device, one that can't blit the format finishes the chain in CreateTextureImage
+  bool CpuTextureMips() const {
+    return !options.gpu_mips || options.mip_filter == MipFilter::KAISER;
+  }
+
+  // runs on a job system worker. the cached copy is the decoded rgba8 pixels behind a width / height header,
+  // followed by the rest of the mip chain when the CPU makes it
+  void DecodeTexture() {
+    CPU_PROFILE_SCOPE("DecodeTexture");
+    bool cpu_mips = CpuTextureMips();
+    std::string cache_key;
+    if (asset_cache.IsEnabled()) {
+      std::string settings = cpu_mips ? std::string("rgba8 mips ") + GetMipFilterName(options.mip_filter) : "rgba8";
+      cache_key = asset_cache.MakeKey("texture", TEXTURE_PATH, settings);
+
+      std::vector<uint8_t> entry;
+      uint32_t size[2];
+      if (asset_cache.Load(cache_key, entry) && entry.size() >= sizeof(size)) {
+        memcpy(size, entry.data(), sizeof(size));
+        uint32_t level_count = cpu_mips ? MipLevelCount(size[0], size[1]) : 1;
+        if (entry.size() == sizeof(size) + MipChainSize(size[0], size[1], level_count)) {
+          LayoutMipChain(size[0], size[1], level_count, texture_chain);
+          memcpy(texture_chain.data.data(), entry.data() + sizeof(size), texture_chain.data.size());
+          return;
+        }
+      }
+    }
+
     int tex_width, tex_height, tex_channels;
     stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &tex_width, &tex_height, &tex_channels, STBI_rgb_alpha);
-    VkDeviceSize image_size = tex_width * tex_height * 4;
-
-    std::cout << "image size is:" << image_size << std::endl;
 
     if (!pixels) {
       throw std::runtime_error("failed to load texture!");
     }
 
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
-
-    CreateBuffer(image_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
+    uint32_t width = static_cast<uint32_t>(tex_width);
+    uint32_t height = static_cast<uint32_t>(tex_height);
+    if (cpu_mips) {
+      GenerateMipChain(pixels, width, height, options.mip_filter, true, &jobs, texture_chain);
+    }
+    else {
+      LayoutMipChain(width, height, 1, texture_chain);
+      memcpy(texture_chain.data.data(), pixels, texture_chain.data.size());
+    }
+    stbi_image_free(pixels);
 
-    void* data;
-    vkMapMemory(instance.device, staging_buffer_memory, 0, image_size, 0, &data);
-    memcpy(data, pixels, static_cast<uint32_t>(image_size));
-    vkUnmapMemory(instance.device, staging_buffer_memory);
+    if (!cache_key.empty()) {
+      uint32_t size[2] = { width, height };
+      std::vector<uint8_t> entry(sizeof(size) + texture_chain.data.size());
+      memcpy(entry.data(), size, sizeof(size));
+      memcpy(entry.data() + sizeof(size), texture_chain.data.data(), texture_chain.data.size());
+      asset_cache.Store(cache_key, entry.data(), entry.size());
+    }
+  }
 
-    stbi_image_free(pixels);
+  void CreateTextureImage() {
+    uint32_t width = texture_chain.width;
+    uint32_t height = texture_chain.height;
+    VkDeviceSize image_size = static_cast<VkDeviceSize>(width) * height * 4;
+    texture_mip_levels = MipLevelCount(width, height);
 
-    CreateImage(tex_width, tex_height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
-      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture_image, texture_image_memory);
+    std::cout << "image size is:" << image_size << std::endl;
 
-    TransitionImageLayout(texture_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    // only level 0 was decoded, the rest is blitted unless the device can't filter the format in a blit
+    bool blit_mips = texture_chain.levels.size() < texture_mip_levels;
+    if (blit_mips && !SupportsLinearBlit(instance.physical_device, VK_FORMAT_R8G8B8A8_SRGB)) {
+      MipChain chain;
+      GenerateMipChain(texture_chain.data.data(), width, height, options.mip_filter, true, &jobs, chain);
+      texture_chain = std::move(chain);
+      blit_mips = false;
+    }
 
-    CopyBufferToImage(staging_buffer, texture_image, static_cast<uint32_t>(tex_width),
-      static_cast<uint32_t>(tex_height));
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (blit_mips) {
+      usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
+    CreateImage(width, height, texture_mip_levels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
+      usage, MemoryUsage::GPU_ONLY, texture_image, texture_image_allocation);
 
-    TransitionImageLayout(texture_image, VK_FORMAT_R8G8B8A8_SRGB,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // the layout transitions, the copy and the blits go into the upload batch, nothing waits here
+    if (blit_mips) {
+      upload_manager.UploadImageGenerateMips(texture_image, width, height, texture_chain.data.data(), image_size,
+        texture_mip_levels);
+    }
+    else {
+      upload_manager.UploadImage(texture_image, width, height, texture_chain.data.data(), texture_chain.data.size(),
+        texture_mip_levels);
+    }
 
-    vkDestroyBuffer(instance.device, staging_buffer, nullptr);
-    vkFreeMemory(instance.device, staging_buffer_memory, nullptr);
+    texture_chain = MipChain();
   }
 
 
-  void CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
-    VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& image_memory) {
+  void CreateImage(uint32_t width, uint32_t height, uint32_t mip_levels, VkFormat format, VkImageTiling tiling,
+    VkImageUsageFlags usage, MemoryUsage memory_usage, VkImage& image, Allocation& image_allocation) {
     VkImageCreateInfo image_info{};
     image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     image_info.imageType = VK_IMAGE_TYPE_2D;
     image_info.extent.width = width;
     image_info.extent.height = height;
     image_info.extent.depth = 1;
-    image_info.mipLevels = 1;
+    image_info.mipLevels = mip_levels;
     image_info.arrayLayers = 1;
     image_info.format = format;
     image_info.tiling = tiling;
@@ -814,23 +1382,12 @@ private:
       throw std::runtime_error("failed to create texture image!");
     }
 
-    VkMemoryRequirements mem_requirements;
-    vkGetImageMemoryRequirements(instance.device, image, &mem_requirements);
-
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    alloc_info.memoryTypeIndex = FindMemoryType(mem_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    if (vkAllocateMemory(instance.device, &alloc_info, nullptr, &image_memory) != VK_SUCCESS) {
-      throw std::runtime_error("failed to allocate image memory!");
-    }
-
-    vkBindImageMemory(instance.device, image, image_memory, 0);
+    image_allocation = allocator.AllocateImage(image, memory_usage);
   }
 
   void CreateTextureImageView() {
-    texture_image_view = CreateImageView(texture_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+    texture_image_view = CreateImageView(texture_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT,
+      texture_mip_levels);
   }
 
   void CreateTextureSampler() {
@@ -855,219 +1412,320 @@ private:
 
     sampler_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
     sampler_info.unnormalizedCoordinates = VK_FALSE;
-    sampler_info.compareEnable = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler_info.compareEnable = VK_FALSE;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     sampler_info.mipLodBias = 0.0f;
     sampler_info.minLod = 0.0f;
-    sampler_info.maxLod = 0.0f;
+    sampler_info.maxLod = static_cast<float>(texture_mip_levels);
 
     if (vkCreateSampler(instance.device, &sampler_info, nullptr, &texture_sampler) != VK_SUCCESS) {
       throw std::runtime_error("failed to create texture sampler!");
     }
   }
 
-  void LoadModel() {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
+  std::string ModelSourcePath() const {
+    return options.model_path.empty() ? MODEL_PATH : options.model_path;
+  }
 
-    if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str())) {
-      throw std::runtime_error(warn + err);
+  void LoadModel() {
+    CPU_PROFILE_SCOPE("LoadModel");
+    std::string source_path = ModelSourcePath();
+    std::string baked_path = source_path + ".baked";
+
+    // the cache key covers the bytes of every file the last import read and the settings. the list of those
+    // files is an entry of its own, keyed on the model file. without the cache the bake sits next to the
+    // source and is checked against the source's size and write time instead
+    bool use_cache = asset_cache.IsEnabled();
+    std::string settings = "baked mesh v" + std::to_string(BakedMesh::VERSION) +
+      (options.full_precision_vertices ? " full" : " quantized");
+    std::string sources_key;
+    std::string cache_key;
+    if (use_cache) {
+      sources_key = asset_cache.MakeKey("mesh-sources", source_path, settings);
+      std::vector<uint8_t> source_list;
+      if (asset_cache.Load(sources_key, source_list)) {
+        std::vector<std::string> source_files;
+        std::istringstream lines(std::string(source_list.begin(), source_list.end()));
+        for (std::string line; std::getline(lines, line);) {
+          source_files.push_back(line);
+        }
+        cache_key = MakeMeshKey(source_files, settings);
+      }
     }
 
-    for(const auto& shape : shapes) {
-      for (const auto& index : shape.mesh.indices) {
-        Vertex vertex{};
-
-        vertex.pos = {
-          attrib.vertices[3 * index.vertex_index + 0],
-          attrib.vertices[3 * index.vertex_index + 1],
-          attrib.vertices[3 * index.vertex_index + 2]
-        };
+    if (options.bake_meshes) {
+      bool cached = !cache_key.empty() && asset_cache.Lookup(cache_key);
+      if (cached && LoadBakedModel(asset_cache.GetPath(cache_key), source_path, false)) {
+        return;
+      }
+      if (!use_cache && LoadBakedModel(baked_path, source_path, true)) {
+        return;
+      }
+    }
 
-        vertex.tex_coord = {
-          attrib.texcoords[2 * index.texcoord_index + 0],
-          1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-        };
+    if (!options.model_path.empty()) {
+      LoadScene();
+    }
+    else {
+      LoadObj();
+    }
 
-        vertex.color = { 1.0f, 1.0f, 1.0f };
-        vertices.push_back(vertex);
-        indices.push_back(indices.size());
+    if (options.bake_meshes) {
+      if (use_cache) {
+        cache_key = MakeMeshKey(model_source_files, settings);
+        if (cache_key.empty()) {
+          return;
+        }
+        baked_path = asset_cache.GetPath(cache_key);
+      }
+      if (!BakedMesh::Write(baked_path, source_path, quantized_mesh, indices, meshes, mesh_instances)) {
+        std::cerr << "failed to write " << baked_path << std::endl;
+      }
+      else if (use_cache) {
+        asset_cache.Insert(cache_key);
+        std::string source_list;
+        for (const auto& file : model_source_files) {
+          source_list += file + "\n";
+        }
+        asset_cache.Store(sources_key, source_list.data(), source_list.size());
       }
     }
   }
 
-  void CreateVertexBuffer() {
-    vert_buffer = VertexBuffer(instance, render_data, vertices);
-  }
-
-  uint32_t FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memory_properties;
-    vkGetPhysicalDeviceMemoryProperties(instance.physical_device, &memory_properties);
-
-    for (uint32_t ii = 0; ii < memory_properties.memoryTypeCount; ii++) {
-      if ((type_filter & (1 << ii)) &&
-        (memory_properties.memoryTypes[ii].propertyFlags & properties) == properties) {
-        return ii;
+  // hashes every file in source_files, so editing a glTF's buffers or an obj's materials invalidates
+  // the bake as well as editing the model file. empty if one of them can't be read
+  std::string MakeMeshKey(const std::vector<std::string>& source_files, const std::string& settings) const {
+    if (source_files.empty()) {
+      return std::string();
+    }
+    std::string hashes;
+    for (const auto& file : source_files) {
+      MappedFile source;
+      if (!source.Open(file)) {
+        return std::string();
       }
+      hashes += file + " " + HashToString(Hash64(source.Data(), source.Size())) + "\n";
     }
-    throw std::runtime_error("failed to find suitable memory type!");
+    return asset_cache.MakeKey("mesh", hashes.data(), hashes.size(), settings);
   }
 
-  void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
-    VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& buffer_memory) {
+  // the vertex and index blobs stay mapped until the uploads are done, they go
+  // from the mapping into the staging ring (or straight into ReBAR memory)
+  bool LoadBakedModel(const std::string& baked_path, const std::string& source_path, bool check_source) {
+    CPU_PROFILE_SCOPE("LoadBakedModel");
+    auto start_time = std::chrono::high_resolution_clock::now();
 
-    VkBufferCreateInfo buffer_info{};
-    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_info.size = size;
-    buffer_info.usage = usage;
-    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (!baked_mesh.Open(baked_path)) {
+      return false;
+    }
 
-    if (vkCreateBuffer(instance.device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
-      throw std::runtime_error("failed to create buffer");
+    if (check_source) {
+      bool wants_full = options.full_precision_vertices;
+      bool is_full = baked_mesh.GetHeader().vertex_stride == VertexLayout::Full().Stride();
+      if (!baked_mesh.IsUpToDate(source_path) || wants_full != is_full) {
+        baked_mesh.Close();
+        return false;
+      }
     }
 
-    VkMemoryRequirements memory_requirements;
-    vkGetBufferMemoryRequirements(instance.device, buffer, &memory_requirements);
+    vertex_layout = baked_mesh.GetLayout();
+    quantized_mesh = QuantizedMesh();
+    quantized_mesh.layout = vertex_layout;
+    quantized_mesh.vertex_count = baked_mesh.GetHeader().vertex_count;
+    quantized_mesh.constants = baked_mesh.GetHeader().constants;
+    meshes = baked_mesh.GetMeshes();
+    mesh_instances = baked_mesh.GetInstances();
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count();
+
+    std::cout << "mapped " << baked_path << " in " << ms << " ms: " << baked_mesh.GetHeader().vertex_count
+      << " vertices, " << baked_mesh.GetHeader().index_count / 3 << " triangles" << std::endl;
+    return true;
+  }
+
+  void LoadObj() {
+    CPU_PROFILE_SCOPE("LoadObj");
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
 
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = memory_requirements.size;
-    alloc_info.memoryTypeIndex = FindMemoryType(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    auto start_time = std::chrono::high_resolution_clock::now();
 
-    if (vkAllocateMemory(instance.device, &alloc_info, nullptr, &buffer_memory) != VK_SUCCESS) {
-      throw std::runtime_error("failed to allocate memory");
+    // material libraries are looked up next to the obj, both end up in the mesh cache key
+    std::ifstream obj_file(MODEL_PATH);
+    if (!obj_file) {
+      throw std::runtime_error("failed to open " + MODEL_PATH);
+    }
+    model_source_files = { MODEL_PATH };
+    std::string obj_directory = std::filesystem::path(MODEL_PATH).parent_path().string();
+    RecordingMaterialReader material_reader(obj_directory.empty() ? "" : obj_directory + "/", model_source_files);
+    if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, &obj_file, &material_reader)) {
+      throw std::runtime_error(warn + err);
     }
 
-    vkBindBufferMemory(instance.device, buffer, buffer_memory, 0);
-  }
+    size_t index_count = 0;
+    for (const auto& shape : shapes) {
+      index_count += shape.mesh.indices.size();
+    }
+    indices.reserve(index_count);
 
-  void CopyBuffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size) {
+    // obj indexes position and uv separately, so every corner comes out as its own vertex
+    VertexWelder welder(vertices, index_count);
 
-    VkCommandBuffer command_buffer = BeginSingleTimeCommands();
+    for(const auto& shape : shapes) {
+      for (const auto& index : shape.mesh.indices) {
+        Vertex vertex{};
 
-    VkBufferCopy copy_region{};
-    copy_region.size = size;
-    vkCmdCopyBuffer(command_buffer, src_buffer, dst_buffer, 1, &copy_region);
+        vertex.pos = {
+          attrib.vertices[3 * index.vertex_index + 0],
+          attrib.vertices[3 * index.vertex_index + 1],
+          attrib.vertices[3 * index.vertex_index + 2]
+        };
 
-    EndSingleTimeCommands(command_buffer);
+        vertex.tex_coord = {
+          attrib.texcoords[2 * index.texcoord_index + 0],
+          1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+        };
+
+        vertex.color = { 1.0f, 1.0f, 1.0f };
+        indices.push_back(welder.Add(vertex));
+      }
+    }
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count();
+    size_t saved = (index_count - vertices.size()) * sizeof(Vertex);
 
+    std::cout << "loaded " << MODEL_PATH << " in " << ms << " ms: " << index_count << " -> "
+      << vertices.size() << " vertices, " << saved / 1024 << " KiB saved" << std::endl;
+
+    OptimizeMesh(vertices, indices);
+
+    // the obj is drawn as a single mesh
+    meshes = { { 0, static_cast<uint32_t>(indices.size()), 0, static_cast<uint32_t>(vertices.size()), 0 } };
+    ComputeMeshBounds(vertices, meshes[0]);
+    mesh_instances = { { 0, glm::mat4(1.0f) } };
+
+    QuantizeMesh(vertices);
   }
 
-  void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout) {
-    VkCommandBuffer command_buffer = BeginSingleTimeCommands();
+  // meshes come out of Model already optimized and packed into one arena
+  void LoadScene() {
+    CPU_PROFILE_SCOPE("LoadScene");
+    auto start_time = std::chrono::high_resolution_clock::now();
 
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = old_layout;
-    barrier.newLayout = new_layout;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = image;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0; barrier.subresourceRange.layerCount = 1;
+    Model model(options.model_path.c_str(), &jobs);
+    model_source_files = model.GetSourceFiles();
+    vertices = model.GetVertices();
+    indices = model.GetIndices();
+    meshes = model.GetMeshes();
+    mesh_instances = model.GetInstances();
 
-    VkPipelineStageFlags source_stage;
-    VkPipelineStageFlags destination_stage;
+    auto end_time = std::chrono::high_resolution_clock::now();
+    float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count();
 
-    // Need to deal with  two different types of layout transitions:
-    // undefined -> transfer destination AND
-    // Transfer destination -> shader reading 
-    if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-      barrier.srcAccessMask = 0;
-      barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    std::cout << "loaded " << options.model_path << " in " << ms << " ms: " << meshes.size() << " meshes, "
+      << mesh_instances.size() << " instances, " << vertices.size() << " vertices, "
+      << indices.size() / 3 << " triangles" << std::endl;
 
-      source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-      destination_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    }
-    else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    QuantizeMesh(vertices);
+  }
 
-      source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-      destination_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    }
-    else if(old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-      barrier.srcAccessMask = 0;
-      barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  void QuantizeMesh(const std::vector<Vertex>& mesh_vertices) {
+    CPU_PROFILE_SCOPE("QuantizeMesh");
+    // a tenth of a millimetre for metre scaled models
+    const float position_tolerance = 0.0001f;
 
-      source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-      destination_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    }
-    else {
-      throw std::invalid_argument("unsupported layout transition");
-    }
+    vertex_layout = options.full_precision_vertices ? VertexLayout::Full() :
+      SelectVertexLayout(mesh_vertices, position_tolerance);
+    quantized_mesh = QuantizeVertices(mesh_vertices, vertex_layout);
+
+    QuantizationReport report = AnalyzeQuantization(mesh_vertices, quantized_mesh);
+    std::cout << "vertex layout: " << report.stride_before << " -> " << report.stride_after << " bytes per vertex, "
+      << report.bytes_before / 1024 << " -> " << report.bytes_after / 1024 << " KiB, max error position "
+      << report.max_position_error << " uv " << report.max_tex_coord_error << std::endl;
+  }
 
-    if(new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-      barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+  // runs after welding, prints the simulated cache behaviour before and after so the gain is visible without a GPU
+  void OptimizeMesh(std::vector<Vertex>& mesh_vertices, std::vector<uint32_t>& mesh_indices) {
+    CPU_PROFILE_SCOPE("OptimizeMesh");
+    VertexCacheStats before = AnalyzeVertexCache(mesh_indices, mesh_vertices.size());
 
-      if(HasStencilComponent(format)) {
-        barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-      }
+    OptimizeVertexCache(mesh_indices, mesh_vertices.size());
+    OptimizeOverdraw(mesh_indices, mesh_vertices);
+    OptimizeVertexFetch(mesh_vertices, mesh_indices);
+
+    VertexCacheStats after = AnalyzeVertexCache(mesh_indices, mesh_vertices.size());
+    std::cout << "vertex cache: ACMR " << before.acmr << " -> " << after.acmr
+      << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+  }
+
+  void CreateVertexBuffer() {
+    if (baked_mesh.IsOpen()) {
+      vert_buffer = VertexBuffer(instance, render_data, baked_mesh.GetVertexData(), baked_mesh.GetVertexDataSize());
     }
     else {
-      barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      vert_buffer = VertexBuffer(instance, render_data, quantized_mesh.data.data(), quantized_mesh.data.size());
     }
-
-    vkCmdPipelineBarrier(command_buffer, source_stage, destination_stage,
-      0,
-      0, nullptr,
-      0, nullptr,
-      1, &barrier);
-
-    EndSingleTimeCommands(command_buffer);
   }
 
-  void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-    VkCommandBuffer command_buffer = BeginSingleTimeCommands();
+  void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+    MemoryUsage memory_usage, VkBuffer& buffer, Allocation& allocation) {
 
-    // need to specify which part of the buffer will be copied to which part of the image
-    VkBufferImageCopy region{};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-    region.imageOffset = { 0, 0, 0 };
-    region.imageExtent = { width, height, 1 };
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    vkCmdCopyBufferToImage(command_buffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-      1, &region);
+    if (vkCreateBuffer(instance.device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create buffer");
+    }
 
-    EndSingleTimeCommands(command_buffer);
+    allocation = allocator.AllocateBuffer(buffer, memory_usage);
   }
 
   void CreateIndexBuffer() {
-    ind_buffer = IndexBuffer(instance, render_data, indices);
+    if (baked_mesh.IsOpen()) {
+      ind_buffer = IndexBuffer(instance, render_data, baked_mesh.GetIndexData(), baked_mesh.GetIndexDataSize());
+    }
+    else {
+      ind_buffer = IndexBuffer(instance, render_data, indices);
+    }
   }
 
-  void CreateUniformBuffers()
-  {
-    VkDeviceSize buffer_size = sizeof(UniformBufferObject);
-    uniform_buffers.resize(swap_chain_images.size());
-    uniform_buffers_memory.resize(swap_chain_images.size());
-
-    for (size_t ii = 0; ii < swap_chain_images.size(); ii++) {
-      CreateBuffer(buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniform_buffers[ii], uniform_buffers_memory[ii]);
+  // one persistently mapped buffer per frame in flight, uniforms are bump allocated from it
+  void CreateTransientBuffers() {
+    // room for every instance being visible at once. instanced batches are padded to the allocation
+    // alignment, which the spec caps at 256, and without instancing each instance gets its own aligned uniforms
+    const VkDeviceSize max_alignment = 256;
+    VkDeviceSize frame_size = TransientAllocator::DEFAULT_FRAME_SIZE;
+    if (UseInstancing()) {
+      frame_size += sizeof(InstanceData) * mesh_instances.size() + max_alignment * instance_batches.size();
     }
+    else if (!options.gpu_driven) {
+      VkDeviceSize ubo_size = (sizeof(UniformBufferObject) + max_alignment - 1) & ~(max_alignment - 1);
+      frame_size += ubo_size * mesh_instances.size();
+    }
+    transient_allocator.Init(instance, MAX_FRAMES_IN_FLIGHT, frame_size);
   }
 
   void CreateDescriptorPool() {
-    std::array<VkDescriptorPoolSize, 2> pool_sizes{};
-    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    pool_sizes[0].descriptorCount = static_cast<uint32_t>(swap_chain_images.size());
+    std::array<VkDescriptorPoolSize, 3> pool_sizes{};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    pool_sizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
     pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    pool_sizes[1].descriptorCount = static_cast<uint32_t>(swap_chain_images.size());
+    pool_sizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[2].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 
     VkDescriptorPoolCreateInfo pool_info{};
     pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
     pool_info.pPoolSizes = pool_sizes.data();
-    pool_info.maxSets = static_cast<uint32_t>(swap_chain_images.size());
+    pool_info.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 
     if (vkCreateDescriptorPool(instance.device, &pool_info, nullptr, &descriptor_pool) != VK_SUCCESS) {
       throw std::runtime_error("failed to create descriptor pool");
@@ -1076,22 +1734,23 @@ private:
   }
 
   void CreateDescriptorSets() {
-    std::vector<VkDescriptorSetLayout> layouts(swap_chain_images.size(), descriptor_set_layout);
+    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptor_set_layout);
     VkDescriptorSetAllocateInfo alloc_info{};
     alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     alloc_info.descriptorPool = descriptor_pool;
-    alloc_info.descriptorSetCount = static_cast<uint32_t>(swap_chain_images.size());
+    alloc_info.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
     alloc_info.pSetLayouts = layouts.data();
 
-    descriptor_sets.resize(swap_chain_images.size());
+    descriptor_sets.resize(MAX_FRAMES_IN_FLIGHT);
 
     if (vkAllocateDescriptorSets(instance.device, &alloc_info, descriptor_sets.data()) != VK_SUCCESS) {
       throw std::runtime_error("failed to create descriptor sets!");
     }
 
-    for (size_t ii = 0; ii < swap_chain_images.size(); ii++) {
+    for (size_t ii = 0; ii < MAX_FRAMES_IN_FLIGHT; ii++) {
+      // the offset into the frame's transient buffer is supplied when the set is bound
       VkDescriptorBufferInfo buffer_info{};
-      buffer_info.buffer = uniform_buffers[ii];
+      buffer_info.buffer = transient_allocator.GetBuffer(static_cast<uint32_t>(ii));
       buffer_info.offset = 0;
       buffer_info.range = sizeof(UniformBufferObject);
 
@@ -1100,13 +1759,20 @@ private:
       image_info.imageView = texture_image_view;
       image_info.sampler = texture_sampler;
 
-      std::array<VkWriteDescriptorSet, 2> descriptor_writes{};
+      VkDescriptorBufferInfo object_info{};
+      if (options.gpu_driven) {
+        object_info.buffer = gpu_culler.GetObjectBuffer();
+        object_info.offset = 0;
+        object_info.range = gpu_culler.GetObjectBufferSize();
+      }
+
+      std::array<VkWriteDescriptorSet, 3> descriptor_writes{};
 
       descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
       descriptor_writes[0].dstSet = descriptor_sets[ii];
       descriptor_writes[0].dstBinding = 0;
       descriptor_writes[0].dstArrayElement = 0;
-      descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
       descriptor_writes[0].descriptorCount = 1;
       descriptor_writes[0].pBufferInfo = &buffer_info;
 
@@ -1118,35 +1784,142 @@ private:
       descriptor_writes[1].descriptorCount = 1;
       descriptor_writes[1].pImageInfo = &image_info;
 
-      vkUpdateDescriptorSets(instance.device, static_cast<uint32_t>(descriptor_writes.size()),
-        descriptor_writes.data(), 0, nullptr);
+      descriptor_writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptor_writes[2].dstSet = descriptor_sets[ii];
+      descriptor_writes[2].dstBinding = 2;
+      descriptor_writes[2].dstArrayElement = 0;
+      descriptor_writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      descriptor_writes[2].descriptorCount = 1;
+      descriptor_writes[2].pBufferInfo = &object_info;
+
+      uint32_t write_count = options.gpu_driven ? 3 : 2;
+      vkUpdateDescriptorSets(instance.device, write_count, descriptor_writes.data(), 0, nullptr);
     }
   }
 
-  void UpdateUniformBuffer(uint32_t current_image) {
+  // once per frame, every draw and the culling frustum use the same matrices
+  void UpdateCamera() {
     static auto start_time = std::chrono::high_resolution_clock::now();
 
     auto current_time = std::chrono::high_resolution_clock::now();
 
     float time = std::chrono::duration<float, std::chrono::seconds::period>(current_time - start_time).count();
+    // headless runs have to render the same frames every time
+    if (options.headless) {
+      time = frame_number / 60.0f;
+    }
 
-    UniformBufferObject ubo{};
-    ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f),
+    scene_transforms.SetRotation(scene_root, glm::angleAxis(time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+    scene_transforms.Update(&jobs);
+    scene_rotation = scene_transforms.GetWorld(scene_root);
+    view_matrix = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f),
       glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.proj = glm::perspective(glm::radians(45.0f), swap_chain_extent.width
+    proj_matrix = glm::perspective(glm::radians(45.0f), swap_chain_extent.width
       / (float)swap_chain_extent.height, 0.1f, 10.0f);
-    ubo.proj[1][1] *= -1;
+    proj_matrix[1][1] *= -1;
+  }
+
+  // returns the dynamic offset of this frame's uniforms in the transient buffer
+  uint32_t UpdateUniformBuffer(const glm::mat4& transform) {
+    UniformBufferObject ubo{};
+    ubo.model = scene_rotation * transform;
+    ubo.view = view_matrix;
+    ubo.proj = proj_matrix;
 
-    void* data;
-    vkMapMemory(instance.device, uniform_buffers_memory[current_image], 0, sizeof(ubo), 0, &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(instance.device, uniform_buffers_memory[current_image]);
+    return transient_allocator.Push(ubo).offset;
+  }
+
+  // copies of the scene on a square grid around the origin, spaced by the largest mesh
+  void ScatterInstances(uint32_t count) {
+    float spacing = 0.0f;
+    for (const auto& mesh : meshes) {
+      spacing = std::max(spacing, glm::length(mesh.bounds_max - mesh.bounds_min));
+    }
+
+    std::vector<MeshInstance> scene = mesh_instances;
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(count))));
+    mesh_instances.clear();
+    mesh_instances.reserve(scene.size() * count);
+    for (uint32_t ii = 0; ii < count; ii++) {
+      glm::vec3 offset((static_cast<float>(ii % side) - side / 2.0f) * spacing,
+        (static_cast<float>(ii / side) - side / 2.0f) * spacing, 0.0f);
+      glm::mat4 translation = glm::translate(glm::mat4(1.0f), offset);
+      for (const auto& instance : scene) {
+        mesh_instances.push_back({ instance.mesh, translation * instance.transform });
+      }
+    }
+    std::cout << "scattered " << count << " copies of the scene, " << mesh_instances.size() << " instances" << std::endl;
+  }
+
+  // world space boxes of every mesh instance, in mesh_instances order
+  void BuildCullBounds() {
+    cull_bounds.Clear();
+    cull_bounds.Reserve(mesh_instances.size());
+    for (const auto& instance : mesh_instances) {
+      const Mesh& mesh = meshes[instance.mesh];
+      cull_bounds.AddTransformedAabb(mesh.bounds_min, mesh.bounds_max, instance.transform);
+    }
+  }
+
+  bool UseInstancing() const {
+    return options.instancing && !options.gpu_driven;
+  }
+
+  // groups the instances by mesh and material once, the draw list only has to filter them per frame
+  void BuildInstanceBatches() {
+    instance_batches.clear();
+    std::unordered_map<uint64_t, size_t> batch_lookup;
+
+    for (uint32_t ii = 0; ii < mesh_instances.size(); ii++) {
+      const Mesh& mesh = meshes[mesh_instances[ii].mesh];
+      uint64_t key = (static_cast<uint64_t>(mesh_instances[ii].mesh) << 32) | mesh.material;
 
+      auto existing = batch_lookup.find(key);
+      if (existing == batch_lookup.end()) {
+        existing = batch_lookup.emplace(key, instance_batches.size()).first;
+        instance_batches.push_back({ mesh_instances[ii].mesh, mesh.material, {} });
+      }
+      instance_batches[existing->second].instances.push_back(ii);
+    }
+
+    if (UseInstancing()) {
+      std::cout << "instancing: " << mesh_instances.size() << " instances in " << instance_batches.size()
+        << " batches" << std::endl;
+    }
+  }
+
+  // one object per mesh instance, with the same bounds the CPU culls against
+  void CreateGpuCuller() {
+    std::vector<GpuObject> objects(mesh_instances.size());
+    for (size_t ii = 0; ii < mesh_instances.size(); ii++) {
+      const MeshInstance& mesh_instance = mesh_instances[ii];
+      const Mesh& mesh = meshes[mesh_instance.mesh];
+
+      GpuObject& object = objects[ii];
+      object.transform = mesh_instance.transform;
+      object.center = glm::vec4(cull_bounds.CenterX()[ii], cull_bounds.CenterY()[ii], cull_bounds.CenterZ()[ii], 0.0f);
+      object.extent = glm::vec4(cull_bounds.ExtentX()[ii], cull_bounds.ExtentY()[ii], cull_bounds.ExtentZ()[ii], 0.0f);
+      object.first_index = mesh.first_index;
+      object.index_count = mesh.index_count;
+      object.vertex_offset = mesh.vertex_offset;
+      object.padding = 0;
+    }
+
+    gpu_culler.Init(instance, render_data, pipeline_manager, shader_library.GetSpirv(cull_shader_variant),
+      objects, MAX_FRAMES_IN_FLIGHT, gpu_cull_features);
+    gpu_cull_expected.assign(MAX_FRAMES_IN_FLIGHT, 0);
+  }
+
+  // the frame's fence must have signalled. headless, the count is checked against the CPU cull of the same frame
+  void CollectGpuCulling(uint32_t frame) {
+    uint32_t visible = 0;
+    if (gpu_culler.Collect(frame, visible) && options.headless && visible != gpu_cull_expected[frame]) {
+      gpu_cull_mismatches++;
+    }
   }
 
   void CreateCommandBuffers() {
-    command_buffers.resize(swap_chain_framebuffers.size());
+    command_buffers.resize(MAX_FRAMES_IN_FLIGHT);
 
     VkCommandBufferAllocateInfo alloc_info{};
     alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1157,54 +1930,946 @@ private:
     if (vkAllocateCommandBuffers(instance.device, &alloc_info, command_buffers.data()) != VK_SUCCESS) {
       throw std::runtime_error("failed to allocate command buffers");
     }
+  }
+
+  // one draw per visible mesh instance, each with its own uniforms in the transient buffer
+  void BuildDrawList() {
+    UpdateCamera();
+    // the bounds are in the space of the instance transforms, the scene rotation is applied on top of them
+    frame_frustum = ExtractFrustum(proj_matrix * view_matrix * scene_rotation);
+
+    // the cull pass writes the draws, the CPU only supplies the camera
+    if (options.gpu_driven) {
+      frame_ubo_offset = UpdateUniformBuffer(glm::mat4(1.0f));
+      if (options.headless) {
+        CPU_PROFILE_SCOPE("cull");
+        gpu_cull_expected[current_frame] = static_cast<uint32_t>(
+          CullObjects(frame_frustum, cull_bounds, cull_visible, &jobs, cull_isa));
+      }
+      draw_list.clear();
+      return;
+    }
+
+    if (options.frustum_culling) {
+      CPU_PROFILE_SCOPE("cull");
+      CullObjects(frame_frustum, cull_bounds, cull_visible, &jobs, cull_isa);
+    }
+
+    draw_list.clear();
+    if (UseInstancing()) {
+      BuildInstancedDraws();
+      return;
+    }
+
+    for (size_t ii = 0; ii < mesh_instances.size(); ii++) {
+      if (options.frustum_culling && !cull_visible[ii]) {
+        continue;
+      }
+      const MeshInstance& instance = mesh_instances[ii];
+      const Mesh& mesh = meshes[instance.mesh];
+      draw_list.push_back({ vert_buffer.GetBuffer(), ind_buffer.GetBuffer(), mesh.index_count, mesh.first_index,
+        mesh.vertex_offset, UpdateUniformBuffer(instance.transform), quantized_mesh.constants });
+    }
+    draw_stats.submissions += draw_list.size();
+    draw_stats.draws += draw_list.size();
+    draw_stats.frames++;
+  }
+
+  // one draw per batch with any visible instance. the batches share the frame's camera uniforms,
+  // their visible transforms are packed into the transient buffer as the per instance stream
+  void BuildInstancedDraws() {
+    uint32_t ubo_offset = UpdateUniformBuffer(glm::mat4(1.0f));
+
+    for (const auto& batch : instance_batches) {
+      uint32_t visible_count = 0;
+      for (uint32_t index : batch.instances) {
+        visible_count += (!options.frustum_culling || cull_visible[index]) ? 1 : 0;
+      }
+      if (visible_count == 0) {
+        continue;
+      }
+
+      TransientAllocation allocation = transient_allocator.Allocate(sizeof(InstanceData) * visible_count);
+      InstanceData* instance_data = static_cast<InstanceData*>(allocation.data);
+      for (uint32_t index : batch.instances) {
+        if (!options.frustum_culling || cull_visible[index]) {
+          (instance_data++)->transform = mesh_instances[index].transform;
+        }
+      }
+
+      const Mesh& mesh = meshes[batch.mesh];
+      DrawItem item{ vert_buffer.GetBuffer(), ind_buffer.GetBuffer(), mesh.index_count, mesh.first_index,
+        mesh.vertex_offset, ubo_offset, quantized_mesh.constants };
+      item.instance_count = visible_count;
+      item.instance_buffer = allocation.buffer;
+      item.instance_offset = allocation.offset;
+      draw_list.push_back(item);
+
+      draw_stats.submissions += visible_count;
+    }
+    draw_stats.draws += draw_list.size();
+    draw_stats.frames++;
+  }
+
+  // recorded every frame, the draw list is split across the recorder's threads
+  // into secondary buffers that the primary executes inside the render pass
+  void RecordCommandBuffer(VkCommandBuffer command_buffer, uint32_t image_index) {
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    begin_info.pInheritanceInfo = nullptr;
+
+    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+      throw std::runtime_error("failed to begin recording command buffer");
+    }
+
+    gpu_profiler.BeginFrame(command_buffer, static_cast<uint32_t>(current_frame));
+    uint32_t frame_scope = gpu_profiler.BeginScope(command_buffer, "frame");
+
+    // the frame's own target and culling buffers, the graph's barriers are recorded against them
+    recording_image_index = image_index;
+    render_graph.SetImportedImage(graph_color, swap_chain_images[image_index]);
+    if (options.gpu_driven) {
+      render_graph.SetImportedBuffer(graph_cull_draws, gpu_culler.GetDrawBuffer(static_cast<uint32_t>(current_frame)));
+      render_graph.SetImportedBuffer(graph_cull_count, gpu_culler.GetCountBuffer(static_cast<uint32_t>(current_frame)));
+    }
+    render_graph.Execute(command_buffer);
+
+    gpu_profiler.EndScope(command_buffer, frame_scope);
+
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record command buffer");
+    }
+  }
+
+  // the render graph has already put the attachments (and the GPU culling output) where the pass needs them
+  void RecordMainPass(VkCommandBuffer command_buffer) {
+    std::array<VkClearValue, 2> clear_values{};
+    clear_values[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+    // range of values in the depth buffer 
+    clear_values[1].depthStencil = { 1.0f, 0 };
+
+    VkRenderPassBeginInfo render_pass_info{};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_info.renderPass = render_pass;
+    render_pass_info.framebuffer = swap_chain_framebuffers[recording_image_index];
+    render_pass_info.renderArea.offset = { 0,0 };
+    render_pass_info.renderArea.extent = swap_chain_extent;
+
+    render_pass_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
+    render_pass_info.pClearValues = clear_values.data();
+
+    uint32_t pass_scope = gpu_profiler.BeginScope(command_buffer, "main pass");
+
+    // a handful of commands regardless of the object count, not worth spreading across threads
+    if (options.gpu_driven) {
+      vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+      RecordIndirectDraws(command_buffer);
+    }
+    else {
+      vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+      VkCommandBufferInheritanceInfo inheritance{};
+      inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+      inheritance.renderPass = render_pass;
+      inheritance.subpass = 0;
+      inheritance.framebuffer = swap_chain_framebuffers[recording_image_index];
+
+      const std::vector<VkCommandBuffer>& secondaries = recorder.Record(static_cast<uint32_t>(current_frame),
+        inheritance, draw_list.size(), [this](VkCommandBuffer secondary, size_t begin, size_t end) {
+          RecordDraws(secondary, begin, end);
+        });
+
+      if (!secondaries.empty()) {
+        vkCmdExecuteCommands(command_buffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+      }
+    }
+
+    vkCmdEndRenderPass(command_buffer);
+    gpu_profiler.EndScope(command_buffer, pass_scope);
+  }
+
+  // pipeline and dynamic state, secondaries inherit neither so every command buffer sets them
+  void BindGraphicsState(VkCommandBuffer command_buffer) {
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)swap_chain_extent.width;
+    viewport.height = (float)swap_chain_extent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = { 0,0 };
+    scissor.extent = swap_chain_extent;
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+  }
+
+  // runs on the recorder's threads, secondary buffers inherit no state so everything is bound here
+  void RecordDraws(VkCommandBuffer command_buffer, size_t begin, size_t end) {
+    BindGraphicsState(command_buffer);
+
+    VkBuffer bound_vertex_buffer = VK_NULL_HANDLE;
+    VkBuffer bound_index_buffer = VK_NULL_HANDLE;
+    VkBuffer bound_instance_buffer = VK_NULL_HANDLE;
+    VkDeviceSize bound_instance_offset = 0;
+
+    for (size_t ii = begin; ii < end; ii++) {
+      const DrawItem& item = draw_list[ii];
+
+      if (item.vertex_buffer != bound_vertex_buffer) {
+        VkDeviceSize offsets[] = { 0 };
+        vkCmdBindVertexBuffers(command_buffer, 0, 1, &item.vertex_buffer, offsets);
+        bound_vertex_buffer = item.vertex_buffer;
+      }
+
+      if (item.index_buffer != bound_index_buffer) {
+        vkCmdBindIndexBuffer(command_buffer, item.index_buffer, 0, VK_INDEX_TYPE_UINT32);
+        bound_index_buffer = item.index_buffer;
+      }
+
+      if (item.instance_buffer != VK_NULL_HANDLE &&
+        (item.instance_buffer != bound_instance_buffer || item.instance_offset != bound_instance_offset)) {
+        vkCmdBindVertexBuffers(command_buffer, InstanceData::BINDING, 1, &item.instance_buffer, &item.instance_offset);
+        bound_instance_buffer = item.instance_buffer;
+        bound_instance_offset = item.instance_offset;
+      }
+
+      vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+        pipeline_layout, 0, 1, &descriptor_sets[current_frame], 1, &item.ubo_offset);
+
+      vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT,
+        0, sizeof(MeshConstants), &item.constants);
+
+      vkCmdDrawIndexed(command_buffer, item.index_count, item.instance_count, item.first_index, item.vertex_offset, 0);
+    }
+  }
+
+  // every object shares the model's buffers, the camera uniforms and the quantization constants
+  void RecordIndirectDraws(VkCommandBuffer command_buffer) {
+    BindGraphicsState(command_buffer);
+
+    VkBuffer vertex_buffers[] = { vert_buffer.GetBuffer() };
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+    vkCmdBindIndexBuffer(command_buffer, ind_buffer.GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+      pipeline_layout, 0, 1, &descriptor_sets[current_frame], 1, &frame_ubo_offset);
+    vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT,
+      0, sizeof(MeshConstants), &quantized_mesh.constants);
+
+    gpu_culler.RecordDraws(command_buffer, static_cast<uint32_t>(current_frame));
+  }
+
+  // records draw_count copies of the model per frame with 1..N recording threads and
+  // prints the CPU time per frame. nothing is submitted so pools are reset right away
+  void BenchmarkRecording(size_t draw_count, uint32_t frames) {
+    uint32_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    transient_allocator.BeginFrame(0);
+    BuildDrawList();
+    // culling can leave nothing to copy, fall back to drawing the first mesh unculled
+    if (draw_list.empty()) {
+      if (meshes.empty()) {
+        throw std::runtime_error("--bench-recording needs a model with at least one mesh");
+      }
+      const Mesh& mesh = meshes[0];
+      draw_list.push_back({ vert_buffer.GetBuffer(), ind_buffer.GetBuffer(), mesh.index_count, mesh.first_index,
+        mesh.vertex_offset, UpdateUniformBuffer(glm::mat4(1.0f)), quantized_mesh.constants });
+    }
+    draw_list.resize(draw_count, draw_list[0]);
+
+    for (uint32_t thread_count = 1; thread_count <= max_threads; thread_count++) {
+      recorder.Destroy();
+      jobs.Destroy();
+      jobs.Init(thread_count);
+      CreateCommandRecorder();
+
+      auto start_time = std::chrono::high_resolution_clock::now();
+      for (uint32_t ii = 0; ii < frames; ii++) {
+        current_frame = ii % MAX_FRAMES_IN_FLIGHT;
+        recorder.BeginFrame(static_cast<uint32_t>(current_frame));
+        vkResetCommandBuffer(command_buffers[current_frame], 0);
+        RecordCommandBuffer(command_buffers[current_frame], 0);
+      }
+      auto end_time = std::chrono::high_resolution_clock::now();
+
+      float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count();
+      std::cout << "recording " << draw_count << " draws with " << thread_count << " thread(s): "
+        << ms / frames << " ms per frame" << std::endl;
+    }
+    current_frame = 0;
+  }
+
+  // alternates the window between two sizes. every resize frame is timed from the resize to the end
+  // of the frame drawn with the new swapchain and compared against the average frame before it
+  void BenchmarkResize(uint32_t resize_count) {
+    const uint32_t warmup_frames = 100;
+
+    auto time_ms = [](const std::function<void()>& func) {
+      auto start_time = std::chrono::high_resolution_clock::now();
+      func();
+      auto end_time = std::chrono::high_resolution_clock::now();
+      return std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count();
+    };
+
+    float frame_ms = time_ms([&] {
+      for (uint32_t ii = 0; ii < warmup_frames; ii++) {
+        glfwPollEvents();
+        DrawFrame();
+      }
+    }) / warmup_frames;
+
+    float total_ms = 0.0f;
+    float worst_ms = 0.0f;
+    for (uint32_t ii = 0; ii < resize_count; ii++) {
+      int width = (ii % 2 == 0) ? WIDTH * 3 / 4 : WIDTH;
+      int height = (ii % 2 == 0) ? HEIGHT * 3 / 4 : HEIGHT;
+      glfwSetWindowSize(instance.window, width, height);
+
+      float ms = time_ms([&] {
+        glfwPollEvents();
+        // the callback may not have fired yet if the window system is slow to apply the size
+        frame_buffer_resized = false;
+        RecreateSwapChain();
+        DrawFrame();
+      });
+      total_ms += ms;
+      worst_ms = std::max(worst_ms, ms);
+    }
+    vkDeviceWaitIdle(instance.device);
+
+    std::cout << "normal frame: " << frame_ms << " ms" << std::endl;
+    std::cout << "resize frame over " << resize_count << " resizes: " << total_ms / resize_count << " ms average, "
+      << worst_ms << " ms worst" << std::endl;
+  }
+
+  // converts every asset the way a normal start would, so the next start only sees cache hits
+  void PrewarmCache() {
+    JobCounter converted;
+    jobs.Run([this] { DecodeTexture(); }, &converted);
+    jobs.Run([this] { LoadModel(); }, &converted);
+    jobs.Wait(converted);
+
+    // the vertex variant depends on the layout the model ended up with
+    shader_cache.GetSpirv("shaders/vert.glsl", shaderc_glsl_vertex_shader, vertex_layout.GetShaderDefines());
+    shader_cache.GetSpirv("shaders/frag.glsl", shaderc_glsl_fragment_shader, {});
+
+    baked_mesh.Close();
+    asset_cache.PrintStats();
+    shader_cache.PrintStats();
+  }
+
+  // imports the model from source (parse, weld, optimize, quantize), bakes it, then
+  // maps the bake and reads every byte of it the way the upload would
+  void BenchmarkMeshLoad() {
+    std::string source_path = ModelSourcePath();
+    std::string baked_path = source_path + ".bench.baked";
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    if (!options.model_path.empty()) {
+      LoadScene();
+    }
+    else {
+      LoadObj();
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    float source_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count();
+
+    if (!BakedMesh::Write(baked_path, source_path, quantized_mesh, indices, meshes, mesh_instances)) {
+      throw std::runtime_error("failed to write " + baked_path);
+    }
+
+    start_time = std::chrono::high_resolution_clock::now();
+    BakedMesh baked;
+    if (!baked.Open(baked_path)) {
+      throw std::runtime_error("failed to map " + baked_path);
+    }
+    auto mapped_time = std::chrono::high_resolution_clock::now();
+
+    // stand in for the memcpy into the staging buffer, so every page is actually faulted in
+    uint64_t checksum = 0;
+    const uint8_t* vertex_bytes = static_cast<const uint8_t*>(baked.GetVertexData());
+    for (VkDeviceSize ii = 0; ii < baked.GetVertexDataSize(); ii += 64) {
+      checksum += vertex_bytes[ii];
+    }
+    for (uint32_t ii = 0; ii < baked.GetHeader().index_count; ii += 16) {
+      checksum += baked.GetIndexData()[ii];
+    }
+    end_time = std::chrono::high_resolution_clock::now();
+
+    float map_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(mapped_time - start_time).count();
+    float touch_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count();
+
+    std::cout << "source: " << source_ms << " ms" << std::endl;
+    std::cout << "baked: " << map_ms << " ms to map, " << touch_ms << " ms including reading it all ("
+      << checksum << ")" << std::endl;
+
+    baked.Close();
+    std::filesystem::remove(baked_path);
+  }
+
+  // writes an obj with mesh_count separate spheres and times importing it with 1..N threads
+  void BenchmarkModelLoad(size_t mesh_count) {
+    const int slices = 32;
+    const int stacks = 16;
+    std::string path = (std::filesystem::temp_directory_path() / "bench_scene.obj").string();
+
+    {
+      std::ofstream file(path);
+      size_t base = 1;
+      for (size_t mesh = 0; mesh < mesh_count; mesh++) {
+        glm::vec3 center(static_cast<float>(mesh % 32) * 3.0f, static_cast<float>(mesh / 32) * 3.0f, 0.0f);
+        file << "o sphere" << mesh << "\n";
+
+        for (int stack = 0; stack <= stacks; stack++) {
+          float phi = glm::pi<float>() * stack / stacks;
+          for (int slice = 0; slice <= slices; slice++) {
+            float theta = glm::two_pi<float>() * slice / slices;
+            glm::vec3 position = center + glm::vec3(std::sin(phi) * std::cos(theta), std::sin(phi) * std::sin(theta), std::cos(phi));
+            file << "v " << position.x << " " << position.y << " " << position.z << "\n";
+            file << "vt " << static_cast<float>(slice) / slices << " " << static_cast<float>(stack) / stacks << "\n";
+          }
+        }
+
+        for (int stack = 0; stack < stacks; stack++) {
+          for (int slice = 0; slice < slices; slice++) {
+            size_t a = base + stack * (slices + 1) + slice;
+            size_t b = a + slices + 1;
+            file << "f " << a << "/" << a << " " << b << "/" << b << " " << a + 1 << "/" << a + 1 << "\n";
+            file << "f " << a + 1 << "/" << a + 1 << " " << b << "/" << b << " " << b + 1 << "/" << b + 1 << "\n";
+          }
+        }
+        base += (stacks + 1) * (slices + 1);
+      }
+    }
+
+    uint32_t max_threads = jobs.ThreadCount();
+    for (uint32_t thread_count = 1; thread_count <= max_threads; thread_count++) {
+      jobs.Destroy();
+      jobs.Init(thread_count);
+
+      auto start_time = std::chrono::high_resolution_clock::now();
+      Model model(path.c_str(), &jobs);
+      auto end_time = std::chrono::high_resolution_clock::now();
+
+      float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count();
+      std::cout << "loading " << model.GetMeshes().size() << " meshes with " << thread_count << " thread(s): "
+        << ms << " ms" << std::endl;
+    }
+
+    std::filesystem::remove(path);
+  }
+
+  // random boxes around the default camera, roughly a third of them visible. every instruction set the CPU
+  // supports is timed on the calling thread alone and then split across every worker
+  void BenchmarkCulling(size_t object_count, uint32_t iterations) {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position(-6.0f, 6.0f);
+    std::uniform_real_distribution<float> size(0.01f, 0.5f);
+
+    BoundsTable bounds;
+    bounds.Reserve(object_count);
+    for (size_t ii = 0; ii < object_count; ii++) {
+      glm::vec3 center(position(rng), position(rng), position(rng));
+      glm::vec3 extent(size(rng), size(rng), size(rng));
+      bounds.AddAabb(center - extent, center + extent);
+    }
+
+    glm::mat4 view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    glm::mat4 proj = glm::perspective(glm::radians(45.0f), WIDTH / (float)HEIGHT, 0.1f, 10.0f);
+    proj[1][1] *= -1;
+    Frustum frustum = ExtractFrustum(proj * view);
+
+    std::vector<CullIsa> isas = { CullIsa::SCALAR };
+    CullIsa best = DetectCullIsa();
+    if (best == CullIsa::SSE || best == CullIsa::AVX) {
+      isas.push_back(CullIsa::SSE);
+    }
+    if (best == CullIsa::AVX) {
+      isas.push_back(CullIsa::AVX);
+    }
+
+    std::vector<uint8_t> visible;
+    for (CullIsa isa : isas) {
+      for (JobSystem* job_system : { static_cast<JobSystem*>(nullptr), &jobs }) {
+        size_t visible_count = CullObjects(frustum, bounds, visible, job_system, isa);
+
+        auto start_time = std::chrono::high_resolution_clock::now();
+        for (uint32_t ii = 0; ii < iterations; ii++) {
+          CullObjects(frustum, bounds, visible, job_system, isa);
+        }
+        auto end_time = std::chrono::high_resolution_clock::now();
+
+        float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count() / iterations;
+        uint32_t thread_count = job_system ? job_system->ThreadCount() : 1;
+        std::cout << "culling " << object_count << " objects, " << GetCullIsaName(isa) << " with " << thread_count
+          << " thread(s): " << ms << " ms, " << object_count / (ms * 1000.0f) << " M objects/s, "
+          << visible_count << " visible" << std::endl;
+      }
+    }
+  }
+
+  // a random forest with a handful of roots, every other node hangs off a random earlier one so the levels
+  // are wide and a dirty node's subtree is scattered through them. each pass is checked against the recursive update
+  void BenchmarkTransforms(size_t node_count, uint32_t iterations) {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    auto random_local = [&]() {
+      LocalTransform local;
+      local.translation = glm::vec3(unit(rng), unit(rng), unit(rng));
+      local.rotation = glm::angleAxis(unit(rng) * glm::pi<float>(), glm::normalize(glm::vec3(unit(rng), unit(rng), 1.0f)));
+      local.scale = glm::vec3(1.0f + 0.1f * unit(rng));
+      return local;
+    };
+
+    const uint32_t root_count = 16;
+    TransformHierarchy hierarchy;
+    hierarchy.Reserve(node_count);
+    for (uint32_t ii = 0; ii < node_count; ii++) {
+      uint32_t parent = TransformHierarchy::INVALID_NODE;
+      if (ii >= root_count) {
+        parent = rng() % ii;
+      }
+      hierarchy.AddNode(parent, random_local());
+    }
+    hierarchy.Update(nullptr);
+    std::cout << "transforms: " << node_count << " nodes in " << hierarchy.LevelCount() << " levels" << std::endl;
+
+    std::vector<uint32_t> roots;
+    for (uint32_t ii = 0; ii < root_count; ii++) {
+      roots.push_back(ii);
+    }
+    std::vector<uint32_t> scattered;
+    for (size_t ii = 0; ii < node_count / 100; ii++) {
+      scattered.push_back(static_cast<uint32_t>(rng() % node_count));
+    }
+
+    struct Pass {
+      const char* name;
+      const std::vector<uint32_t>* dirty;
+    };
+    std::vector<uint32_t> none;
+    std::vector<glm::mat4> reference;
+    // relative to the size of the element, translations grow with depth
+    const float tolerance = 1e-4f;
+
+    for (const Pass& pass : { Pass{ "every root dirty", &roots }, Pass{ "1% of nodes dirty", &scattered },
+      Pass{ "clean", &none } }) {
+      for (JobSystem* job_system : { static_cast<JobSystem*>(nullptr), &jobs }) {
+        size_t written = 0;
+        float ms = 0.0f;
+        for (uint32_t ii = 0; ii < iterations; ii++) {
+          for (uint32_t node : *pass.dirty) {
+            hierarchy.SetTranslation(node, glm::vec3(unit(rng), unit(rng), unit(rng)));
+          }
+          auto start_time = std::chrono::high_resolution_clock::now();
+          written = hierarchy.Update(job_system);
+          auto end_time = std::chrono::high_resolution_clock::now();
+          ms += std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count();
+        }
+
+        hierarchy.ComputeWorldRecursive(reference);
+        float max_error = 0.0f;
+        for (uint32_t node = 0; node < node_count; node++) {
+          for (int column = 0; column < 4; column++) {
+            glm::vec4 difference = glm::abs(hierarchy.GetWorld(node)[column] - reference[node][column]) /
+              glm::max(glm::abs(reference[node][column]), glm::vec4(1.0f));
+            max_error = std::max({ max_error, difference.x, difference.y, difference.z, difference.w });
+          }
+        }
+
+        uint32_t thread_count = job_system ? job_system->ThreadCount() : 1;
+        std::cout << "transforms, " << pass.name << " with " << thread_count << " thread(s): " << ms / iterations
+          << " ms, " << written << " world matrices, max error against recursive " << max_error << std::endl;
+        if (!(max_error <= tolerance)) {
+          throw std::runtime_error(std::string("transform update differs from the recursive one, ") + pass.name);
+        }
+        if (pass.dirty->empty() && written != 0) {
+          throw std::runtime_error("transform update wrote " + std::to_string(written) + " matrices with nothing dirty");
+        }
+      }
+    }
+  }
+
+  // full sRGB chain of a size x size image of noise, so neither filter gets off lightly on flat areas. throughput
+  // counts the source pixels read, every level but the 1x1 one. each run is checked against the scalar single
+  // threaded chain
+  void BenchmarkMips(uint32_t size, uint32_t iterations) {
+    std::mt19937 rng(1234);
+    std::vector<uint8_t> pixels(static_cast<size_t>(size) * size * 4);
+    for (auto& value : pixels) {
+      value = static_cast<uint8_t>(rng());
+    }
+    size_t source_pixels = MipChainSize(size, size, MipLevelCount(size, size) - 1) / 4;
+
+    for (MipFilter filter : { MipFilter::BOX, MipFilter::KAISER }) {
+      MipChain reference;
+      GenerateMipChain(pixels.data(), size, size, filter, true, nullptr, reference, false);
+
+      for (bool simd : { false, true }) {
+        if (simd && !MipSimdSupported()) {
+          continue;
+        }
+        for (JobSystem* job_system : { static_cast<JobSystem*>(nullptr), &jobs }) {
+          MipChain chain;
+          auto start_time = std::chrono::high_resolution_clock::now();
+          for (uint32_t ii = 0; ii < iterations; ii++) {
+            GenerateMipChain(pixels.data(), size, size, filter, true, job_system, chain, simd);
+          }
+          auto end_time = std::chrono::high_resolution_clock::now();
+
+          float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count() / iterations;
+          uint32_t thread_count = job_system ? job_system->ThreadCount() : 1;
+          std::cout << "mips " << size << "x" << size << ", " << GetMipFilterName(filter) << (simd ? " SIMD" : " scalar")
+            << " with " << thread_count << " thread(s): " << ms << " ms, " << source_pixels / (ms * 1000.0f) << " MP/s"
+            << (chain.data == reference.data ? "" : ", differs from scalar") << std::endl;
+        }
+      }
+    }
+  }
+
+  // random mix of allocations and frees on one 256 MiB block, sizes from 256 bytes up to 1 MiB with power of two
+  // alignments. the timed pass only drives the block, the checked pass replays the same mix against a map of the
+  // live ranges to catch overlaps. afterwards everything is freed and has to coalesce back into a single range
+  void BenchmarkAllocator(uint32_t operation_count) {
+    const uint64_t block_size = 256ull << 20;
+    struct LiveRange {
+      uint64_t offset;
+      uint64_t size;
+    };
+
+    auto run_mix = [&](BlockMetadata& block, std::vector<LiveRange>& live, std::map<uint64_t, uint64_t>* checked) {
+      std::mt19937 rng(1234);
+      std::uniform_int_distribution<uint32_t> size_log(8, 20);
+      std::uniform_int_distribution<uint32_t> alignment_log(4, 12);
+      size_t failed = 0;
+
+      for (uint32_t ii = 0; ii < operation_count; ii++) {
+        if (!live.empty() && (rng() & 1)) {
+          size_t index = std::uniform_int_distribution<size_t>(0, live.size() - 1)(rng);
+          LiveRange range = live[index];
+          live[index] = live.back();
+          live.pop_back();
+          block.Free(range.offset, range.size);
+          if (checked) {
+            checked->erase(range.offset);
+          }
+          continue;
+        }
 
-    for (size_t ii = 0; ii < command_buffers.size(); ii++) {
-      VkCommandBufferBeginInfo begin_info{};
-      begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-      begin_info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-      begin_info.pInheritanceInfo = nullptr;
+        uint64_t size = std::uniform_int_distribution<uint64_t>(256, 1ull << size_log(rng))(rng);
+        uint64_t alignment = 1ull << alignment_log(rng);
+        uint64_t offset = 0;
+        if (!block.Allocate(size, alignment, offset)) {
+          failed++;
+          continue;
+        }
+        live.push_back({ offset, size });
+
+        if (checked) {
+          if (offset % alignment != 0 || offset + size > block_size) {
+            throw std::runtime_error("allocator returned a misaligned or out of block range");
+          }
+          auto next = checked->lower_bound(offset);
+          if (next != checked->end() && next->first < offset + size) {
+            throw std::runtime_error("allocator returned a range overlapping the next live one");
+          }
+          if (next != checked->begin() && std::prev(next)->first + std::prev(next)->second > offset) {
+            throw std::runtime_error("allocator returned a range overlapping the previous live one");
+          }
+          checked->emplace(offset, size);
+        }
+      }
+      return failed;
+    };
+
+    BlockMetadata block(block_size);
+    std::vector<LiveRange> live;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    size_t failed = run_mix(block, live, nullptr);
+    auto end_time = std::chrono::high_resolution_clock::now();
+
+    // share of the free bytes that the largest free range can't serve in one allocation
+    uint64_t free_bytes = block.Size() - block.Used();
+    float fragmentation = free_bytes > 0 ? 1.0f - block.LargestFreeRange() / static_cast<float>(free_bytes) : 0.0f;
+    float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count();
+    std::cout << "allocator " << operation_count << " operations: " << ms << " ms, " << operation_count / (ms * 1000.0f)
+      << " M operations/s, " << failed << " failed, " << live.size() << " live using " << block.Used() / (1024 * 1024)
+      << " MiB, " << block.FreeRangeCount() << " free ranges, " << fragmentation * 100.0f << "% fragmented" << std::endl;
+
+    BlockMetadata checked_block(block_size);
+    std::vector<LiveRange> checked_live;
+    std::map<uint64_t, uint64_t> live_ranges;
+    run_mix(checked_block, checked_live, &live_ranges);
+
+    for (const LiveRange& range : checked_live) {
+      checked_block.Free(range.offset, range.size);
+    }
+    if (!checked_block.Empty() || checked_block.FreeRangeCount() != 1 || checked_block.LargestFreeRange() != block_size) {
+      throw std::runtime_error("allocator left " + std::to_string(checked_block.FreeRangeCount())
+        + " free ranges after freeing everything");
+    }
+    std::cout << "allocator: no overlaps, everything coalesced back into one range" << std::endl;
+  }
 
-      if (vkBeginCommandBuffer(command_buffers[ii], &begin_info) != VK_SUCCESS) {
-        throw std::runtime_error("failed to begin recording command buffer");
+  // every vertex layout permutation plus the fragment shader, repeated under a dummy define so each
+  // copy is a distinct variant. bypasses the shader cache, this measures compilation only
+  void BenchmarkShaders() {
+    const uint32_t copies = 32;
+    uint32_t max_threads = jobs.ThreadCount();
+
+    for (uint32_t thread_count = 1; thread_count <= max_threads; thread_count++) {
+      jobs.Destroy();
+      jobs.Init(thread_count);
+
+      ShaderLibrary library;
+      library.Init(jobs, nullptr);
+      for (uint32_t copy = 0; copy < copies; copy++) {
+        std::string copy_define = "BENCH_VARIANT=" + std::to_string(copy);
+        for (uint32_t permutation = 0; permutation < 4; permutation++) {
+          std::vector<std::string> defines = { copy_define };
+          if (permutation & 1) {
+            defines.push_back("HAS_COLOR");
+          }
+          if (permutation & 2) {
+            defines.push_back("HAS_NORMAL");
+          }
+          library.Add("shaders/vert.glsl", ShaderType::VERTEX_SHADER, defines);
+        }
+        library.Add("shaders/frag.glsl", ShaderType::FRAGMENT_SHADER, { copy_define });
       }
 
-      std::array<VkClearValue, 2> clear_values{};
-      clear_values[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-      // range of values in the depth buffer 
-      clear_values[1].depthStencil = { 1.0f, 0 };
+      auto start_time = std::chrono::high_resolution_clock::now();
+      library.Compile();
+      auto end_time = std::chrono::high_resolution_clock::now();
 
-      VkRenderPassBeginInfo render_pass_info{};
-      render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-      render_pass_info.renderPass = render_pass;
-      render_pass_info.framebuffer = swap_chain_framebuffers[ii];
-      render_pass_info.renderArea.offset = { 0,0 };
-      render_pass_info.renderArea.extent = swap_chain_extent;
+      std::cout << library.VariantCount() << " shader variants with " << thread_count << " thread(s): "
+        << std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count() << " ms" << std::endl;
+    }
+  }
 
-      render_pass_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
-      render_pass_info.pClearValues = clear_values.data();
+  // spawn: the main thread queues empty jobs and waits, steal: one job fans out
+  // children that the other workers have to steal, parallel for: a memory bound
+  // loop with 1..N workers
+  void BenchmarkJobs() {
+    const uint32_t job_count = 100000;
+    uint32_t max_threads = jobs.ThreadCount();
+
+    auto time_ms = [](const std::function<void()>& func) {
+      auto start_time = std::chrono::high_resolution_clock::now();
+      func();
+      auto end_time = std::chrono::high_resolution_clock::now();
+      return std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count();
+    };
+
+    float spawn_ms = time_ms([&] {
+      JobCounter counter;
+      for (uint32_t ii = 0; ii < job_count; ii++) {
+        jobs.Run([] {}, &counter);
+      }
+      jobs.Wait(counter);
+    });
+
+    uint64_t steals_before = jobs.GetStats().steals;
+    float steal_ms = time_ms([&] {
+      JobCounter counter;
+      jobs.Run([&] {
+        for (uint32_t ii = 0; ii < job_count; ii++) {
+          jobs.Run([] {}, &counter);
+        }
+      }, &counter);
+      jobs.Wait(counter);
+    });
+    uint64_t steals = jobs.GetStats().steals - steals_before;
+
+    std::cout << "spawn: " << job_count / spawn_ms * 1000.0f << " jobs/s" << std::endl;
+    std::cout << "steal: " << job_count / steal_ms * 1000.0f << " jobs/s, " << steals << " stolen" << std::endl;
+
+    std::vector<float> data(16 * 1024 * 1024, 1.0f);
+    for (uint32_t thread_count = 1; thread_count <= max_threads; thread_count++) {
+      jobs.Destroy();
+      jobs.Init(thread_count);
+
+      float ms = time_ms([&] {
+        jobs.ParallelFor(data.size(), 64 * 1024, [&](size_t begin, size_t end) {
+          for (size_t ii = begin; ii < end; ii++) {
+            data[ii] = std::sqrt(data[ii] * 2.0f + 1.0f);
+          }
+        });
+      });
+      std::cout << "parallel for with " << thread_count << " thread(s): " << ms << " ms" << std::endl;
+    }
+  }
 
-      vkCmdBeginRenderPass(command_buffers[ii], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-      vkCmdBindPipeline(command_buffers[ii], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
+  // every check throws on failure. runs on at least 4 threads so the races have somewhere to happen even on
+  // a single core. the stress loop puts a fresh counter on the stack for every ParallelFor, the way the
+  // engine does every frame, so a finisher still touching a counter Wait has returned from gets thousands of
+  // chances to hit it. the window is narrow, run it on several cores under a sanitizer to be sure
+  void TestJobs() {
+    jobs.Destroy();
+    jobs.Init(std::max(4u, std::thread::hardware_concurrency()));
+
+    auto check = [](bool condition, const std::string& what) {
+      if (!condition) {
+        throw std::runtime_error("job system test failed: " + what);
+      }
+    };
+    const uint32_t job_count = 10000;
 
-      VkBuffer vertex_buffers[] = { vert_buffer.GetBuffer()};
+    {
+      std::atomic<uint32_t> ran{ 0 };
+      JobCounter counter;
+      for (uint32_t ii = 0; ii < job_count; ii++) {
+        jobs.Run([&ran] { ran.fetch_add(1, std::memory_order_relaxed); }, &counter);
+      }
+      jobs.Wait(counter);
+      check(counter.Done() && ran.load() == job_count, "spawn, " + std::to_string(ran.load()) + " jobs ran");
+    }
 
-      VkDeviceSize offsets[] = { 0 };
+    {
+      // one job queues every child on its own worker, the rest only get them by stealing
+      std::atomic<uint32_t> ran{ 0 };
+      uint64_t steals_before = jobs.GetStats().steals;
+      JobCounter counter;
+      jobs.Run([&] {
+        for (uint32_t ii = 0; ii < job_count; ii++) {
+          jobs.Run([&ran] { ran.fetch_add(1, std::memory_order_relaxed); }, &counter);
+        }
+      }, &counter);
+      jobs.Wait(counter);
+      check(ran.load() == job_count, "steal, " + std::to_string(ran.load()) + " children ran");
+      std::cout << "job system: " << jobs.GetStats().steals - steals_before << " jobs stolen" << std::endl;
+    }
 
-      vkCmdBindVertexBuffers(command_buffers[ii], 0, 1, vertex_buffers, offsets);
+    {
+      const uint32_t group_size = 100;
+      std::atomic<uint32_t> first_done{ 0 };
+      std::atomic<bool> ordered{ true };
+      JobCounter first;
+      JobCounter second;
+      for (uint32_t ii = 0; ii < group_size; ii++) {
+        jobs.Run([&first_done] {
+          std::this_thread::yield();
+          first_done.fetch_add(1, std::memory_order_relaxed);
+        }, &first);
+      }
+      for (uint32_t ii = 0; ii < group_size; ii++) {
+        jobs.RunAfter(first, [&] {
+          if (first_done.load() != group_size) {
+            ordered = false;
+          }
+        }, &second);
+      }
+      jobs.Wait(second);
+      check(first.Done() && ordered.load(), "dependency, a RunAfter job started before its dependency finished");
 
-      vkCmdBindIndexBuffer(command_buffers[ii], ind_buffer.GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+      // the dependency is done already, so this is queued straight away
+      bool ran = false;
+      JobCounter third;
+      jobs.RunAfter(first, [&ran] { ran = true; }, &third);
+      jobs.Wait(third);
+      check(ran, "dependency, RunAfter on a finished counter never ran");
+    }
 
-      vkCmdBindDescriptorSets(command_buffers[ii], VK_PIPELINE_BIND_POINT_GRAPHICS,
-        pipeline_layout, 0, 1, &descriptor_sets[ii], 0, nullptr);
+    {
+      std::atomic<uint32_t> ran{ 0 };
+      JobCounter counter;
+      for (uint32_t ii = 0; ii < 100; ii++) {
+        jobs.Run([&ran, ii] {
+          ran.fetch_add(1, std::memory_order_relaxed);
+          if (ii == 50) {
+            throw std::runtime_error("expected");
+          }
+        }, &counter);
+      }
+      bool caught = false;
+      try {
+        jobs.Wait(counter);
+      }
+      catch (const std::runtime_error&) {
+        caught = true;
+      }
+      check(caught && ran.load() == 100, "exception, Wait didn't rethrow or returned before the group finished");
+
+      caught = false;
+      try {
+        jobs.ParallelFor(1000, 10, [](size_t begin, size_t end) {
+          if (begin <= 500 && 500 < end) {
+            throw std::runtime_error("expected");
+          }
+        });
+      }
+      catch (const std::runtime_error&) {
+        caught = true;
+      }
+      check(caught, "exception, ParallelFor didn't rethrow");
+
+      // without a counter the exception is kept until Destroy, the worker that ran the job keeps going
+      uint32_t thread_count = jobs.ThreadCount();
+      JobCounter after;
+      jobs.Run([] { throw std::runtime_error("expected"); });
+      jobs.Run([] {}, &after);
+      jobs.Wait(after);
+      caught = false;
+      try {
+        jobs.Destroy();
+      }
+      catch (const std::runtime_error&) {
+        caught = true;
+      }
+      check(caught, "exception, Destroy didn't rethrow the exception of a job without a counter");
+      jobs.Init(thread_count);
+    }
 
-      vkCmdDrawIndexed(command_buffers[ii], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+    {
+      const size_t count = 1000;
+      const uint32_t iterations = 10000;
+      std::vector<std::atomic<uint32_t>> hits(count);
+      for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+        jobs.ParallelFor(count, 1 + iteration % 97, [&](size_t begin, size_t end) {
+          for (size_t ii = begin; ii < end; ii++) {
+            hits[ii].fetch_add(1, std::memory_order_relaxed);
+          }
+        });
+      }
+      for (size_t ii = 0; ii < count; ii++) {
+        check(hits[ii].load() == iterations, "parallel for, item " + std::to_string(ii) + " ran " +
+          std::to_string(hits[ii].load()) + " times");
+      }
 
-      vkCmdEndRenderPass(command_buffers[ii]);
+      // nested, the inner waits run on workers
+      std::atomic<uint32_t> inner{ 0 };
+      jobs.ParallelFor(64, 1, [&](size_t begin, size_t end) {
+        for (size_t ii = begin; ii < end; ii++) {
+          jobs.ParallelFor(256, 16, [&](size_t inner_begin, size_t inner_end) {
+            inner.fetch_add(static_cast<uint32_t>(inner_end - inner_begin), std::memory_order_relaxed);
+          });
+        }
+      });
+      check(inner.load() == 64 * 256, "nested parallel for, " + std::to_string(inner.load()) + " items ran");
+    }
 
-      if (vkEndCommandBuffer(command_buffers[ii]) != VK_SUCCESS) {
-        throw std::runtime_error("failed to record command buffer");
+    {
+      // Destroy runs what is still queued instead of dropping it with the counter above zero
+      uint32_t thread_count = jobs.ThreadCount();
+      std::atomic<uint32_t> ran{ 0 };
+      JobCounter counter;
+      for (uint32_t ii = 0; ii < job_count; ii++) {
+        jobs.Run([&ran] { ran.fetch_add(1, std::memory_order_relaxed); }, &counter);
       }
+      jobs.RunOnMainThread([&ran] { ran.fetch_add(1, std::memory_order_relaxed); }, &counter);
+      jobs.Destroy();
+      check(counter.Done() && ran.load() == job_count + 1, "destroy, " + std::to_string(ran.load()) + " jobs ran");
+      jobs.Init(thread_count);
     }
+
+    std::cout << "job system: spawn, steal, dependency, exception, parallel for and destroy tests passed on "
+      << jobs.ThreadCount() << " threads" << std::endl;
   }
 
   VkCommandBuffer BeginSingleTimeCommands() {
@@ -1279,7 +2944,8 @@ private:
     app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     app_info.pEngineName = "No Engine";
     app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    app_info.apiVersion = VK_API_VERSION_1_0;
+    // 1.1 for vkGetPhysicalDeviceFeatures2, the optional device features are queried through it
+    app_info.apiVersion = VK_API_VERSION_1_1;
 
     VkInstanceCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -1360,10 +3026,15 @@ private:
   // will return the list of required extensions based on whether
 // validation layers are enabled or not
   std::vector<const char* > GetRequiredExtensions() {
-    uint32_t glfw_extension_count = 0;
-    const char** glfw_extensions;
-    glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
-    std::vector<const char*> extensions(glfw_extensions, glfw_extensions + glfw_extension_count);
+    std::vector<const char*> extensions;
+
+    // headless needs no surface extensions, which also keeps glfw out of it entirely
+    if (!options.headless) {
+      uint32_t glfw_extension_count = 0;
+      const char** glfw_extensions;
+      glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+      extensions.assign(glfw_extensions, glfw_extensions + glfw_extension_count);
+    }
 
     if (enable_validation_layers) {
       extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -1403,33 +3074,41 @@ private:
 
   //
   void CleanupSwapChain() {
-
-    vkDestroyImageView(instance.device, depth_image_view, nullptr);
-    vkDestroyImage(instance.device, depth_image, nullptr);
-    vkFreeMemory(instance.device, depth_image_memory, nullptr);
-
-    for (auto framebuffer : swap_chain_framebuffers) {
-      vkDestroyFramebuffer(instance.device, framebuffer, nullptr);
-    }
+    CleanupExtentResources();
 
     vkFreeCommandBuffers(instance.device, command_pool, static_cast<uint32_t>(command_buffers.size()), command_buffers.data());
-    vkDestroyPipeline(instance.device, graphics_pipeline, nullptr);
-    vkDestroyPipelineLayout(instance.device, pipeline_layout, nullptr);
     vkDestroyRenderPass(instance.device, render_pass, nullptr);
 
-    for (auto image_view : swap_chain_image_views) {
-      vkDestroyImageView(instance.device, image_view, nullptr);
-    }
-
     vkDestroySwapchainKHR(instance.device, swap_chain, nullptr);
 
-    for (size_t ii = 0; ii < swap_chain_images.size(); ii++) {
-      vkDestroyBuffer(instance.device, uniform_buffers[ii], nullptr);
-      vkFreeMemory(instance.device, uniform_buffers_memory[ii], nullptr);
+    // headless the images are ours rather than the swapchain's
+    for (size_t ii = 0; ii < offscreen_allocations.size(); ii++) {
+      vkDestroyImage(instance.device, swap_chain_images[ii], nullptr);
+      allocator.Free(offscreen_allocations[ii]);
+    }
+    offscreen_allocations.clear();
+
+    if (readback_buffer != VK_NULL_HANDLE) {
+      vkDestroyBuffer(instance.device, readback_buffer, nullptr);
+      allocator.Free(readback_allocation);
+      readback_buffer = VK_NULL_HANDLE;
     }
 
     vkDestroyDescriptorPool(instance.device, descriptor_pool, nullptr);
   }
+
+  // everything sized to the swapchain images, the only things a resize has to rebuild
+  void CleanupExtentResources() {
+    render_graph.Reset();
+
+    for (auto framebuffer : swap_chain_framebuffers) {
+      vkDestroyFramebuffer(instance.device, framebuffer, nullptr);
+    }
+
+    for (auto image_view : swap_chain_image_views) {
+      vkDestroyImageView(instance.device, image_view, nullptr);
+    }
+  }
   // we need to recreate the swap chain for when the window surface is no
   // longer compatible with the swap chain (window resizing)
   void RecreateSwapChain() {
@@ -1440,21 +3119,31 @@ private:
       glfwGetFramebufferSize(instance.window, &width, &height);
       glfwWaitEvents();
     }
-    vkDeviceWaitIdle(instance.device);
-    CleanupSwapChain();
+    // only the graphics and present queues touch the swapchain images and depth buffer,
+    // uploads on the transfer queue can keep going
+    vkQueueWaitIdle(instance.graphics_queue);
+    vkQueueWaitIdle(presentation_queue);
+
+    VkFormat old_format = swap_chain_image_format;
+    VkSwapchainKHR old_swap_chain = swap_chain;
+    CreateSwapChain(old_swap_chain);
+    CleanupExtentResources();
+    vkDestroySwapchainKHR(instance.device, old_swap_chain, nullptr);
+
+    // viewport and scissor are dynamic and descriptors / command buffers don't depend on the extent,
+    // only a new surface format invalidates the render pass (and the pipeline manager reuses the pipeline anyway)
+    if (swap_chain_image_format != old_format) {
+      vkDestroyRenderPass(instance.device, render_pass, nullptr);
+      CreateRenderPass();
+      CreateGraphicsPipeline();
+    }
 
-    CreateSwapChain();
     CreateImageViews();
-    CreateRenderPass();
-    CreateGraphicsPipeline();
-    CreateDepthResources();
+    BuildRenderGraph();
     CreateFrameBuffers();
-    CreateUniformBuffers();
-    CreateDescriptorPool();
-    CreateDescriptorSets();
-    CreateCommandBuffers();
 
-    images_in_flight.resize(swap_chain_images.size(), VK_NULL_HANDLE);
+    // the image count may have changed, and nothing is in flight anymore
+    images_in_flight.assign(swap_chain_images.size(), VK_NULL_HANDLE);
   }
 
   // acquire an image from the swap chain
@@ -1463,9 +3152,24 @@ private:
   // return the image to the swap chain for presentation
 
   void DrawFrame() {
-    vkWaitForFences(instance.device, 1, &in_flight_fences[current_frame], VK_TRUE, UINT64_MAX);
-    uint32_t image_index;
-    VkResult result = vkAcquireNextImageKHR(instance.device, swap_chain, UINT64_MAX, image_available_semaphores[current_frame], VK_NULL_HANDLE, &image_index);
+    CPU_PROFILE_SCOPE("DrawFrame");
+    {
+      CPU_PROFILE_SCOPE("wait for frame fence");
+      vkWaitForFences(instance.device, 1, &in_flight_fences[current_frame], VK_TRUE, UINT64_MAX);
+    }
+    // this frame's previous timings and visible count are final once its fence has signalled
+    gpu_profiler.Collect(static_cast<uint32_t>(current_frame));
+    if (options.gpu_driven) {
+      CollectGpuCulling(static_cast<uint32_t>(current_frame));
+    }
+
+    // headless each frame in flight owns its target, so there is nothing to acquire
+    uint32_t image_index = static_cast<uint32_t>(current_frame);
+    VkResult result = VK_SUCCESS;
+    if (!options.headless) {
+      CPU_PROFILE_SCOPE("acquire");
+      result = vkAcquireNextImageKHR(instance.device, swap_chain, UINT64_MAX, image_available_semaphores[current_frame], VK_NULL_HANDLE, &image_index);
+    }
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR) {
       RecreateSwapChain();
@@ -1475,35 +3179,58 @@ private:
       throw std::runtime_error("failed to acquire a swap chain image");
     }
 
-    UpdateUniformBuffer(image_index);
     // check if a previous frame is using this image
     if (images_in_flight[image_index] != VK_NULL_HANDLE) {
+      CPU_PROFILE_SCOPE("wait for image fence");
       vkWaitForFences(instance.device, 1, &images_in_flight[image_index], VK_TRUE, UINT64_MAX);
     }
 
     // mark this image as now being in use by this frame
     images_in_flight[image_index] = in_flight_fences[current_frame];
 
+    // the fence wait above means the GPU is done with this frame's transient buffer and pools
+    transient_allocator.BeginFrame(static_cast<uint32_t>(current_frame));
+    recorder.BeginFrame(static_cast<uint32_t>(current_frame));
+    {
+      CPU_PROFILE_SCOPE("update uniforms");
+      BuildDrawList();
+    }
+
+    {
+      CPU_PROFILE_SCOPE("record");
+      vkResetCommandBuffer(command_buffers[current_frame], 0);
+      RecordCommandBuffer(command_buffers[current_frame], image_index);
+    }
+
 
     VkSubmitInfo submit_info{};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
     VkSemaphore wait_semaphores[] = { image_available_semaphores[current_frame] };
     VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    submit_info.waitSemaphoreCount = 1;
+    submit_info.waitSemaphoreCount = options.headless ? 0 : 1;
     submit_info.pWaitSemaphores = wait_semaphores;
     submit_info.pWaitDstStageMask = wait_stages;
     submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffers[image_index];
+    submit_info.pCommandBuffers = &command_buffers[current_frame];
 
     VkSemaphore signal_semaphores[] = { render_finished_semaphores[current_frame] };
-    submit_info.signalSemaphoreCount = 1;
+    submit_info.signalSemaphoreCount = options.headless ? 0 : 1;
     submit_info.pSignalSemaphores = signal_semaphores;
 
     vkResetFences(instance.device, 1, &in_flight_fences[current_frame]);
 
-    if (vkQueueSubmit(instance.graphics_queue, 1, &submit_info, in_flight_fences[current_frame]) != VK_SUCCESS) {
-      throw std::runtime_error("failed to submit draw command buffer");
+    {
+      CPU_PROFILE_SCOPE("submit");
+      if (vkQueueSubmit(instance.graphics_queue, 1, &submit_info, in_flight_fences[current_frame]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit draw command buffer");
+      }
+    }
+
+    frame_number++;
+    if (options.headless) {
+      current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+      return;
     }
 
     VkPresentInfoKHR present_info{};
@@ -1516,7 +3243,10 @@ private:
     present_info.pSwapchains = swap_chains;
     present_info.pImageIndices = &image_index;
 
-    result = vkQueuePresentKHR(presentation_queue, &present_info);
+    {
+      CPU_PROFILE_SCOPE("present");
+      result = vkQueuePresentKHR(presentation_queue, &present_info);
+    }
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || frame_buffer_resized) {
       frame_buffer_resized = false;
@@ -1534,7 +3264,11 @@ private:
   VkQueue graphics_queue;
   VkQueue presentation_queue;
 
-  VkSwapchainKHR swap_chain;
+  VkSwapchainKHR swap_chain = VK_NULL_HANDLE;
+  // headless only, backing memory of the offscreen targets in swap_chain_images
+  std::vector<Allocation> offscreen_allocations;
+  VkBuffer readback_buffer = VK_NULL_HANDLE;
+  Allocation readback_allocation;
   std::vector<VkImage> swap_chain_images;
   std::vector<VkImageView> swap_chain_image_views;
   VkFormat swap_chain_image_format;
@@ -1549,15 +3283,49 @@ private:
 
   VkCommandPool command_pool;
   std::vector<VkCommandBuffer> command_buffers;
+  CommandRecorder recorder;
+  std::vector<DrawItem> draw_list;
 
   std::vector<VkSemaphore> image_available_semaphores;
   std::vector<VkSemaphore> render_finished_semaphores;
   std::vector<VkFence> in_flight_fences;
   std::vector<VkFence> images_in_flight;
   size_t current_frame = 0;
+  // frames submitted so far, drives the animation in headless mode
+  uint64_t frame_number = 0;
 
   std::vector<Vertex> vertices;
   std::vector<uint32_t> indices;
+  VertexLayout vertex_layout;
+  QuantizedMesh quantized_mesh;
+  BakedMesh baked_mesh;
+  std::vector<Mesh> meshes;
+  std::vector<MeshInstance> mesh_instances;
+  // every file the last import read, LoadModel keys the baked mesh on them
+  std::vector<std::string> model_source_files;
+  std::vector<InstanceBatch> instance_batches;
+  // mesh instances that passed culling against the draws actually issued, summed over every frame
+  struct {
+    uint64_t frames = 0;
+    uint64_t submissions = 0;
+    uint64_t draws = 0;
+  } draw_stats;
+
+  // the scene hangs off scene_root, mesh instance transforms are relative to it
+  TransformHierarchy scene_transforms;
+  uint32_t scene_root = 0;
+
+  // camera for the current frame, set by UpdateCamera
+  glm::mat4 scene_rotation = glm::mat4(1.0f);
+  glm::mat4 view_matrix = glm::mat4(1.0f);
+  glm::mat4 proj_matrix = glm::mat4(1.0f);
+
+  BoundsTable cull_bounds;
+  std::vector<uint8_t> cull_visible;
+  CullIsa cull_isa = DetectCullIsa();
+  Frustum frame_frustum{};
+  // gpu driven draws share one set of uniforms per frame
+  uint32_t frame_ubo_offset = 0;
 
   VkBuffer vertex_buffer;
   VkDeviceMemory vertex_buffer_memory;
@@ -1566,25 +3334,53 @@ private:
   VkDeviceMemory index_buffer_memory;
   IndexBuffer ind_buffer;
 
-  std::vector<VkBuffer> uniform_buffers;
-  std::vector<VkDeviceMemory> uniform_buffers_memory;
+  TransientAllocator transient_allocator;
 
   VkDescriptorPool descriptor_pool;
   std::vector<VkDescriptorSet> descriptor_sets;
 
 
+  // decoded off the main thread, freed once uploaded. level 0 only when the GPU makes the mips
+  MipChain texture_chain;
+  uint32_t texture_mip_levels = 1;
   VkImage texture_image;
-  VkDeviceMemory texture_image_memory;
+  Allocation texture_image_allocation;
 
   VkImageView texture_image_view;
   VkSampler texture_sampler;
 
-  VkImage depth_image;
-  VkDeviceMemory depth_image_memory;
-  VkImageView depth_image_view;
+  RenderGraph render_graph;
+  // set when VK_KHR_synchronization2 is enabled
+  PFN_vkCmdPipelineBarrier2KHR pipeline_barrier2 = nullptr;
+  uint32_t graph_color = 0;
+  uint32_t graph_depth = 0;
+  uint32_t graph_cull_draws = 0;
+  uint32_t graph_cull_count = 0;
+  // swapchain image the graph is being recorded for, the main pass picks its framebuffer with it
+  uint32_t recording_image_index = 0;
 
   bool frame_buffer_resized = false;
 
+  EngineOptions options;
+  JobSystem jobs;
+  AssetCache asset_cache;
+  ShaderCache shader_cache;
+  ShaderLibrary shader_library;
+  PipelineManager pipeline_manager;
+  GpuProfiler gpu_profiler;
+  uint32_t vert_shader_variant = 0;
+  uint32_t frag_shader_variant = 0;
+  uint32_t cull_shader_variant = 0;
+
+  GpuCuller gpu_culler;
+  GpuCullFeatures gpu_cull_features;
+  // CPU visible count per frame in flight and how many frames the GPU disagreed with it, headless only
+  std::vector<uint32_t> gpu_cull_expected;
+  uint32_t gpu_cull_mismatches = 0;
+  JobCounter assets_loaded;
+
+  MemoryAllocator allocator;
+  UploadManager upload_manager;
   InitData instance;
   RenderData render_data;
 };
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct AssetCacheStats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t stores;
+  uint64_t evictions;
+  uint64_t bytes;
+  uint64_t entries;
+};
+
+// On disk cache for converted assets (baked meshes, decoded textures, SPIR-V).
+// Entries are named by a hash of the source bytes and the conversion settings,
+// so editing a source or changing a setting just produces a new key and the old
+// entry ages out. Last use is tracked through the file's write time, and the
+// least recently used entries are deleted once the directory grows past max_size.
+// Safe to use from several threads.
+class AssetCache {
+public:
+  static const uint64_t DEFAULT_MAX_SIZE = 1024ull * 1024 * 1024;
+
+  AssetCache();
+
+  // creates the directory if needed and indexes the files already in it. subdirectories are left alone,
+  // other caches can keep their files there without them being counted or evicted
+  bool Init(const std::string& directory, uint64_t max_size = DEFAULT_MAX_SIZE);
+  bool IsEnabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return enabled_;
+  }
+
+  // kind is part of the key and the file name, settings should name every option that changes the output.
+  // returns an empty key if the source can't be read
+  std::string MakeKey(const std::string& kind, const std::string& source_path, const std::string& settings) const;
+  std::string MakeKey(const std::string& kind, const void* data, size_t size, const std::string& settings) const;
+
+  // counts a hit or a miss, a hit also marks the entry as recently used
+  bool Lookup(const std::string& key);
+  // where the entry for key lives, whether or not it exists yet
+  std::string GetPath(const std::string& key) const;
+
+  // registers a file that a producer wrote to GetPath(key) and evicts if the cache is over its size
+  void Insert(const std::string& key);
+  // writes data through a temporary file, then Insert
+  bool Store(const std::string& key, const void* data, size_t size);
+  // Lookup plus reading the whole entry
+  bool Load(const std::string& key, std::vector<uint8_t>& data);
+
+  AssetCacheStats GetStats() const;
+  void PrintStats() const;
+
+private:
+  struct Entry {
+    uint64_t size;
+    std::filesystem::file_time_type last_used;
+  };
+
+  void EvictLocked();
+
+  bool enabled_ = false;
+  std::filesystem::path directory_;
+  uint64_t max_size_ = DEFAULT_MAX_SIZE;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Entry> entries_;
+  uint64_t total_size_ = 0;
+  AssetCacheStats stats_{};
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include "vulkan_headers.h"
+#include "vertex_format.h"
+#include "model.h"
+#include "mapped_file.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On disk layout, every section starts on a 16 byte boundary:
+//   BakedMeshHeader
+//   Mesh[mesh_count]
+//   MeshInstance[instance_count]
+//   vertex blob, already in the GPU layout the header describes
+//   uint32_t[index_count]
+struct BakedMeshHeader {
+  uint32_t magic;
+  uint32_t version;
+
+  // the source the bake was made from, a mismatch means it has to be rebaked
+  uint64_t source_size;
+  int64_t source_time;
+
+  uint32_t position_format;
+  uint32_t color_format;
+  uint32_t tex_coord_format;
+  uint32_t normal_format;
+  uint32_t vertex_stride;
+
+  uint32_t vertex_count;
+  uint32_t index_count;
+  uint32_t mesh_count;
+  uint32_t instance_count;
+
+  float bounds_min[3];
+  float bounds_max[3];
+  MeshConstants constants;
+
+  uint64_t mesh_offset;
+  uint64_t instance_offset;
+  uint64_t vertex_offset;
+  uint64_t index_offset;
+};
+
+// A baked mesh container, written once after a mesh has been imported, welded,
+// optimized and quantized, and memory mapped on every later start. The blobs
+// are handed to the upload path straight from the mapping, nothing is parsed.
+class BakedMesh {
+public:
+  static const uint32_t MAGIC = 0x48534d42; // "BMSH"
+  static const uint32_t VERSION = 2;
+
+  BakedMesh();
+
+  // goes through a temporary file and a rename so an interrupted bake never leaves a torn file behind
+  static bool Write(const std::string& path, const std::string& source_path, const QuantizedMesh& vertices,
+    const std::vector<uint32_t>& indices, const std::vector<Mesh>& meshes, const std::vector<MeshInstance>& instances);
+
+  // maps the file and checks the header, the section bounds and that every mesh and instance
+  // stays inside them, fails on anything unexpected
+  bool Open(const std::string& path);
+  void Close();
+  bool IsOpen() const { return file_.IsOpen(); }
+
+  // compares the stamp recorded at bake time against the source file on disk
+  bool IsUpToDate(const std::string& source_path) const;
+
+  const BakedMeshHeader& GetHeader() const { return *header_; }
+  VertexLayout GetLayout() const;
+
+  const void* GetVertexData() const { return file_.Data() + header_->vertex_offset; }
+  VkDeviceSize GetVertexDataSize() const { return static_cast<VkDeviceSize>(header_->vertex_count) * header_->vertex_stride; }
+  const uint32_t* GetIndexData() const { return reinterpret_cast<const uint32_t*>(file_.Data() + header_->index_offset); }
+  VkDeviceSize GetIndexDataSize() const { return static_cast<VkDeviceSize>(header_->index_count) * sizeof(uint32_t); }
+
+  // the tables are tiny, these copy them out
+  std::vector<Mesh> GetMeshes() const;
+  std::vector<MeshInstance> GetInstances() const;
+
+private:
+  static bool GetSourceStamp(const std::string& source_path, uint64_t& size, int64_t& time);
+
+  MappedFile file_;
+  const BakedMeshHeader* header_ = nullptr;
+};
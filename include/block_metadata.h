@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <map>
+
+// Free-list bookkeeping for a single device memory block. Holds no Vulkan state
+// so the sub-allocation strategy can be exercised on the CPU without a device.
+class BlockMetadata {
+public:
+  explicit BlockMetadata(uint64_t size);
+
+  // best-fit search over the free ranges. returns false if no range can hold
+  // size bytes once the start is aligned up to alignment (a power of two)
+  bool Allocate(uint64_t size, uint64_t alignment, uint64_t& offset);
+
+  // size must be the value passed to Allocate for this offset
+  void Free(uint64_t offset, uint64_t size);
+
+  uint64_t Size() const { return size_; }
+  uint64_t Used() const { return used_; }
+  uint64_t LargestFreeRange() const;
+  size_t FreeRangeCount() const { return free_by_offset_.size(); }
+  bool Empty() const { return used_ == 0; }
+
+  static uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+  }
+
+private:
+  void InsertFreeRange(uint64_t offset, uint64_t size);
+  void EraseFreeRange(std::map<uint64_t, uint64_t>::iterator it);
+
+  uint64_t size_;
+  uint64_t used_ = 0;
+
+  // offset -> size, sorted so neighbours can be merged on Free
+  std::map<uint64_t, uint64_t> free_by_offset_;
+  // size -> offset, so the best fit is a lower_bound instead of a full scan
+  std::multimap<uint64_t, uint64_t> free_by_size_;
+};
@@ -1,5 +1,7 @@
 #pragma once
 #include "vulkan_headers.h"
+#include "memory_allocator.h"
+#include "upload_manager.h"
 #include <stdexcept>
 
 class Buffer {
@@ -9,7 +11,10 @@ public:
   Buffer(const InitData& instance, const RenderData& ren_dat, VkDeviceSize buffer_size, VkBufferUsageFlags usage, void* data);
 
   VkBuffer GetBuffer() const { return buffer_; }
-  VkDeviceMemory GetBufferMemory() const { return buffer_memory_; }
+  VkDeviceMemory GetBufferMemory() const { return allocation_.memory; }
+  const Allocation& GetAllocation() const { return allocation_; }
+
+  void Destroy(const InitData& init);
 
   virtual void Bind() = 0;
 
@@ -18,20 +23,10 @@ public:
 
 private:
   static void CreateBuffer(const InitData& init, VkDeviceSize size, VkBufferUsageFlags usage,
-    VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& buffer_memory);
-
-  static void CopyBuffer(const InitData& init, VkCommandPool command_pool, 
-    VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size);
-
-  static VkCommandBuffer BeginSingleTimeCommands(const InitData& init,
-    VkCommandPool command_pool);
-
-  static void EndSingleTimeCommands(const InitData& instance, VkCommandBuffer command_buffer,  VkCommandPool command_pool);
-
-  static uint32_t FindMemoryType(const InitData& init, uint32_t type_filter, VkMemoryPropertyFlags properties);
+    MemoryUsage memory_usage, VkBuffer& buffer, Allocation& allocation);
 
   VkBuffer buffer_ = VK_NULL_HANDLE;
-  VkDeviceMemory buffer_memory_ = VK_NULL_HANDLE;
+  Allocation allocation_;
 
   friend class Texture;
 };
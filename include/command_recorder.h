@@ -0,0 +1,52 @@
+#pragma once
+#include "vulkan_headers.h"
+#include "job_system.h"
+#include <functional>
+#include <vector>
+
+// records items [begin, end) of the frame's draw list into a secondary command buffer
+typedef std::function<void(VkCommandBuffer command_buffer, size_t begin, size_t end)> RecordFunc;
+
+// Splits a frame's draw list into one chunk per job system worker. Every worker
+// owns one command pool per frame in flight, so recording never contends on a
+// pool and a frame's pools can be reset wholesale once its fence has signalled.
+// Chunks go through the job system, so whichever worker picks one up (the
+// calling thread included) records it with its own pool.
+class CommandRecorder {
+public:
+  CommandRecorder();
+  ~CommandRecorder();
+
+  void Init(const InitData& init, JobSystem& jobs, uint32_t queue_family, uint32_t frame_count);
+  void Destroy();
+
+  // resets every worker's pool for this frame, the frame's fence must have signalled
+  void BeginFrame(uint32_t frame);
+
+  // returns the recorded secondary buffers in draw list order, ready for vkCmdExecuteCommands.
+  // inheritance must name the render pass / subpass (and ideally framebuffer) they run in
+  const std::vector<VkCommandBuffer>& Record(uint32_t frame, const VkCommandBufferInheritanceInfo& inheritance,
+    size_t item_count, const RecordFunc& record);
+
+  uint32_t ThreadCount() const { return static_cast<uint32_t>(workers_.size()); }
+
+private:
+  struct FramePool {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    // a worker may pick up several chunks per frame, buffers are handed out in order
+    std::vector<VkCommandBuffer> buffers;
+    size_t used = 0;
+  };
+
+  struct Worker {
+    // indexed by frame in flight
+    std::vector<FramePool> frames;
+  };
+
+  VkCommandBuffer AcquireBuffer(uint32_t frame);
+
+  VkDevice device_ = VK_NULL_HANDLE;
+  JobSystem* jobs_ = nullptr;
+  std::vector<Worker> workers_;
+  std::vector<VkCommandBuffer> results_;
+};
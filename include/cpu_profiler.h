@@ -0,0 +1,109 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Scoped CPU timings. Debug builds record by default, release builds only with
+// ENABLE_CPU_PROFILER defined, otherwise the macros below expand to nothing and
+// the instrumented code pays nothing.
+#if !defined(NDEBUG) || defined(ENABLE_CPU_PROFILER)
+#define CPU_PROFILER_ENABLED 1
+#endif
+
+#define CPU_PROFILE_CONCAT_INNER(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT_INNER(a, b)
+
+#ifdef CPU_PROFILER_ENABLED
+// name has to outlive the profiler, use string literals
+#define CPU_PROFILE_SCOPE(name) CpuScope CPU_PROFILE_CONCAT(cpu_scope_, __LINE__)(name)
+#define CPU_PROFILE_FRAME() CpuProfiler::FrameMark()
+#define CPU_PROFILE_THREAD(name) CpuProfiler::SetThreadName(name)
+#else
+#define CPU_PROFILE_SCOPE(name)
+#define CPU_PROFILE_FRAME()
+#define CPU_PROFILE_THREAD(name)
+#endif
+
+// value as the inside of a JSON string, for the scope and thread names in both profilers' traces
+void WriteJsonEscaped(std::ostream& out, const std::string& value);
+
+struct CpuEvent {
+  const char* name;
+  uint64_t start_ns;
+  uint64_t end_ns;
+};
+
+struct CpuFrameStats {
+  uint32_t frames;
+  float average_ms;
+  float p50_ms;
+  float p95_ms;
+  float p99_ms;
+  float max_ms;
+};
+
+// Every thread writes finished scopes into its own ring buffer, so recording
+// is a clock read and a store with no locks or shared cache lines. Readers copy
+// each ring up to its published head and then drop whatever the thread may have
+// overwritten meanwhile, the head works as the ring's sequence lock. The oldest
+// events are overwritten once a ring wraps. A thread's ring is reused by a later thread once it exits, so its
+// track in the trace can hold several threads one after another.
+// Frame times come from FrameMark on the main loop's thread.
+class CpuProfiler {
+public:
+  static const uint32_t RING_SIZE = 1 << 16;
+  static const uint32_t MAX_FRAMES = 1 << 16;
+
+  static uint64_t Now();
+  static void Record(const char* name, uint64_t start_ns, uint64_t end_ns);
+  // shows up as the thread's name in the trace
+  static void SetThreadName(const std::string& name);
+
+  // ends the current frame and starts the next
+  static void FrameMark();
+  static CpuFrameStats GetFrameStats();
+  // percentiles plus a histogram of the recorded frame times
+  static void PrintFrameStats();
+
+  // chrome://tracing / Perfetto JSON with one track per thread
+  static bool WriteChromeTrace(const std::string& path);
+
+private:
+  // the fields are atomics, a reader copying a slot its thread is overwriting gets a torn event that
+  // it throws away afterwards instead of racing the writer
+  struct EventSlot {
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> start_ns;
+    std::atomic<uint64_t> end_ns;
+  };
+
+  struct ThreadRing {
+    std::string name;
+    uint32_t index = 0;
+    std::unique_ptr<EventSlot[]> events;
+    // total events ever written, the ring holds the last RING_SIZE of them
+    std::atomic<uint64_t> head{ 0 };
+  };
+
+  static ThreadRing& LocalRing();
+  // every ring ever created, guarded by a mutex only touched on a thread's first event, on its exit and when reading
+  static std::vector<std::unique_ptr<ThreadRing>>& Rings();
+  // rings of exited threads, waiting for the next thread that records
+  static std::vector<ThreadRing*>& FreeRings();
+};
+
+class CpuScope {
+public:
+  explicit CpuScope(const char* name) : name_(name), start_(CpuProfiler::Now()) {}
+  ~CpuScope() { CpuProfiler::Record(name_, start_, CpuProfiler::Now()); }
+
+  CpuScope(const CpuScope&) = delete;
+  CpuScope& operator=(const CpuScope&) = delete;
+
+private:
+  const char* name_;
+  uint64_t start_;
+};
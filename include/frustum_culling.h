@@ -0,0 +1,65 @@
+#pragma once
+#include "vulkan_headers.h"
+#include "job_system.h"
+#include <cstdint>
+#include <vector>
+
+// planes point inwards, a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all six
+struct Frustum {
+  glm::vec4 planes[6];
+};
+
+// planes of the clip volume of view_proj (Vulkan depth range, 0 to 1), in the space view_proj is applied to
+Frustum ExtractFrustum(const glm::mat4& view_proj);
+
+// Object bounds as center / half extent boxes in structure of arrays layout, so
+// the culling loops load 4 or 8 objects per component straight into a register.
+// Spheres are stored as the box around them.
+class BoundsTable {
+public:
+  BoundsTable();
+
+  void Reserve(size_t count);
+  void Clear();
+
+  uint32_t AddAabb(const glm::vec3& min, const glm::vec3& max);
+  uint32_t AddSphere(const glm::vec3& center, float radius);
+  // bounds of the box [min, max] after transform, still axis aligned
+  uint32_t AddTransformedAabb(const glm::vec3& min, const glm::vec3& max, const glm::mat4& transform);
+
+  size_t Size() const { return center_x_.size(); }
+
+  const float* CenterX() const { return center_x_.data(); }
+  const float* CenterY() const { return center_y_.data(); }
+  const float* CenterZ() const { return center_z_.data(); }
+  const float* ExtentX() const { return extent_x_.data(); }
+  const float* ExtentY() const { return extent_y_.data(); }
+  const float* ExtentZ() const { return extent_z_.data(); }
+
+private:
+  std::vector<float> center_x_;
+  std::vector<float> center_y_;
+  std::vector<float> center_z_;
+  std::vector<float> extent_x_;
+  std::vector<float> extent_y_;
+  std::vector<float> extent_z_;
+};
+
+enum class CullIsa {
+  SCALAR,
+  SSE,  // 4 objects per instruction
+  AVX   // 8 objects per instruction
+};
+
+// widest instruction set the running CPU supports, SCALAR on anything that isn't x86
+CullIsa DetectCullIsa();
+const char* GetCullIsaName(CullIsa isa);
+
+// visible[ii] is set to 1 for objects in [begin, end) that touch the frustum and 0 for the rest.
+// returns the number of visible objects
+size_t CullRange(const Frustum& frustum, const BoundsTable& bounds, size_t begin, size_t end,
+  uint8_t* visible, CullIsa isa);
+
+// culls the whole table, split across the job system when there is one. isa must be supported by the CPU
+size_t CullObjects(const Frustum& frustum, const BoundsTable& bounds, std::vector<uint8_t>& visible,
+  JobSystem* jobs, CullIsa isa);
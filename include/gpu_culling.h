@@ -0,0 +1,119 @@
+#pragma once
+#include "vulkan_headers.h"
+#include "frustum_culling.h"
+#include "memory_allocator.h"
+#include "pipeline_manager.h"
+#include "storage_buffer.h"
+#include <cstdint>
+#include <vector>
+
+// one entry of the object buffer, matches GpuObject in shaders/gpu_object.glsl (std430)
+struct GpuObject {
+  glm::mat4 transform;
+  // world space box around the mesh, w unused
+  glm::vec4 center;
+  glm::vec4 extent;
+  uint32_t first_index;
+  uint32_t index_count;
+  int32_t vertex_offset;
+  uint32_t padding;
+};
+
+// push constants of shaders/cull.glsl
+struct CullConstants {
+  glm::vec4 planes[6];
+  uint32_t object_count;
+  // 1 when the draws are packed and drawn with a count, 0 when every object keeps its slot
+  uint32_t compact;
+};
+
+// what the device offers for drawing the culled objects
+struct GpuCullFeatures {
+  // vkCmdDrawIndexedIndirectCountKHR, null without VK_KHR_draw_indirect_count
+  PFN_vkCmdDrawIndexedIndirectCountKHR draw_indirect_count = nullptr;
+  // without multiDrawIndirect every draw is its own indirect call
+  bool multi_draw_indirect = false;
+};
+
+struct GpuCullStats {
+  uint32_t object_count;
+  // frames read back so far and the visible objects summed over them
+  uint64_t frames;
+  uint64_t visible;
+  uint32_t last_visible;
+};
+
+// Culls the whole scene on the GPU. Per object data sits in one storage buffer,
+// a compute pass tests every object against the frustum and writes a
+// VkDrawIndexedIndirectCommand for each visible one, and the frame draws them
+// all with a single indirect call. The CPU cost no longer depends on the object
+// count. Draws carry their object index in firstInstance, so the vertex shader
+// finds its transform through gl_InstanceIndex.
+//
+// With vkCmdDrawIndexedIndirectCount the visible draws are packed and counted
+// on the GPU. Without it every object keeps a slot and culled ones draw zero
+// instances. The count is copied to host memory every frame and read back once
+// the frame's fence has signalled.
+class GpuCuller {
+public:
+  GpuCuller();
+
+  // objects go through render's uploader, the uploads have to be flushed before the first frame
+  void Init(const InitData& init, const RenderData& render, PipelineManager& pipelines,
+    const std::vector<uint32_t>& cull_spirv, const std::vector<GpuObject>& objects,
+    uint32_t frame_count, const GpuCullFeatures& features);
+  void Destroy();
+
+  // outside a render pass: clears the count, culls every object and copies the count for readback.
+  // the draw and count buffers are left to the caller to make visible to the indirect draw
+  void RecordCull(VkCommandBuffer command_buffer, uint32_t frame, const Frustum& frustum);
+  // inside the render pass, with the pipeline, buffers and descriptor sets already bound
+  void RecordDraws(VkCommandBuffer command_buffer, uint32_t frame);
+
+  // visible objects found by the frame's last cull, the frame's fence must have signalled.
+  // returns false if the frame hasn't been culled yet
+  bool Collect(uint32_t frame, uint32_t& visible);
+
+  // bound to the graphics descriptor set so the vertex shader can read the transforms
+  VkBuffer GetObjectBuffer() const { return objects_.GetBuffer(); }
+  VkDeviceSize GetObjectBufferSize() const { return sizeof(GpuObject) * object_count_; }
+  uint32_t ObjectCount() const { return object_count_; }
+  // written by the frame's cull, read by its indirect draws
+  VkBuffer GetDrawBuffer(uint32_t frame) const { return frames_[frame].draws; }
+  VkBuffer GetCountBuffer(uint32_t frame) const { return frames_[frame].count; }
+
+  const GpuCullStats& GetStats() const { return stats_; }
+  void PrintStats() const;
+
+private:
+  struct Frame {
+    VkBuffer draws = VK_NULL_HANDLE;
+    Allocation draws_allocation;
+    VkBuffer count = VK_NULL_HANDLE;
+    Allocation count_allocation;
+    VkBuffer readback = VK_NULL_HANDLE;
+    Allocation readback_allocation;
+    VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+    // set once a cull has been recorded, until then there is nothing to read back
+    bool culled = false;
+  };
+
+  void CreateDescriptors(uint32_t frame_count);
+  VkBuffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memory_usage, Allocation& allocation);
+
+  const InitData* init_ = nullptr;
+  GpuCullFeatures features_;
+  VkDeviceSize non_coherent_atom_size_ = 1;
+
+  StorageBuffer objects_;
+  uint32_t object_count_ = 0;
+
+  VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
+  VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+  VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+  // owned by the pipeline manager
+  VkPipeline pipeline_ = VK_NULL_HANDLE;
+
+  std::vector<Frame> frames_;
+  GpuCullStats stats_{};
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include "vulkan_headers.h"
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct GpuScopeStats {
+  std::string name;
+  uint32_t samples;
+  float average_ms;
+  float p50_ms;
+  float p95_ms;
+  float p99_ms;
+};
+
+// Named GPU timings from timestamp queries. Every frame in flight has its own
+// query pool, reset at the start of its command buffer and read back the next
+// time the frame comes around, after its fence has signalled, so reading never
+// stalls. The last WINDOW samples of each scope are kept for averages and
+// percentiles, and every scope ever measured can be written as a Chrome trace.
+class GpuProfiler {
+public:
+  static const uint32_t MAX_SCOPES = 64;
+  static const uint32_t WINDOW = 256;
+
+  GpuProfiler();
+
+  void Init(const InitData& init, uint32_t queue_family, uint32_t frame_count);
+  void Destroy();
+
+  // false if the queue family has no timestamp support, every call below is a no op then
+  bool IsEnabled() const { return enabled_; }
+
+  // reads the timings recorded the last time this frame was used, the frame's fence must have signalled
+  void Collect(uint32_t frame);
+  // resets the frame's queries, record before anything else and outside a render pass
+  void BeginFrame(VkCommandBuffer command_buffer, uint32_t frame);
+
+  // scopes may nest. the returned id goes to EndScope
+  uint32_t BeginScope(VkCommandBuffer command_buffer, const char* name);
+  void EndScope(VkCommandBuffer command_buffer, uint32_t scope);
+
+  std::vector<GpuScopeStats> GetStats() const;
+  void PrintStats() const;
+
+  // chrome://tracing / Perfetto JSON, one complete event per measured scope
+  bool WriteChromeTrace(const std::string& path) const;
+
+private:
+  struct Frame {
+    VkQueryPool pool = VK_NULL_HANDLE;
+    // scope names in query order, scope ii owns queries 2 * ii and 2 * ii + 1
+    std::vector<std::string> scopes;
+    // 0 until the frame's command buffer has been recorded
+    uint64_t frame_number = 0;
+  };
+
+  struct TraceEvent {
+    std::string name;
+    uint64_t frame_number;
+    double start_us;
+    double duration_us;
+  };
+
+  VkDevice device_ = VK_NULL_HANDLE;
+  bool enabled_ = false;
+  // nanoseconds per tick
+  float period_ = 1.0f;
+  uint64_t valid_mask_ = ~0ull;
+
+  std::vector<Frame> frames_;
+  uint32_t current_ = 0;
+  uint64_t frame_number_ = 0;
+
+  // first timestamp seen, trace times are relative to it
+  uint64_t origin_ = 0;
+  bool has_origin_ = false;
+
+  // most recent WINDOW durations in milliseconds, by scope name
+  std::unordered_map<std::string, std::deque<float>> history_;
+  std::vector<std::string> order_;
+  std::vector<TraceEvent> trace_;
+};
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// MurmurHash64A, fast and good enough for cache keys. Not for anything adversarial
+uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0);
+
+inline uint64_t Hash64(const std::string& value, uint64_t seed = 0) {
+  return Hash64(value.data(), value.size(), seed);
+}
+
+// 16 lower case hex digits, used for file names
+std::string HashToString(uint64_t hash);
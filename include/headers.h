@@ -1,6 +1,7 @@
 #pragma once
 
 #include "stb_image.h"
+#include "stb_image_write.h"
 #include "vulkan_headers.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -15,15 +16,44 @@
 #include <cstring>
 #include <algorithm>
 #include <cstdint>
+#include <cmath>
 #include <set>
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <filesystem>
+#include <glm/gtc/constants.hpp>
 #include <chrono>
+#include <thread>
+#include <random>
 #include <shaderc/shaderc.hpp>
 #include "texture.h"
 #include "vertex_buffer.h"
+#include "vertex_welder.h"
+#include "mesh_optimizer.h"
+#include "vertex_format.h"
+#include "model.h"
+#include "mapped_file.h"
+#include "baked_mesh.h"
+#include "hash.h"
+#include "asset_cache.h"
+#include "shader_cache.h"
+#include "shader_library.h"
+#include "pipeline_manager.h"
+#include "gpu_profiler.h"
+#include "cpu_profiler.h"
 #include "index_buffer.h"
+#include "memory_allocator.h"
+#include "upload_manager.h"
+#include "transient_allocator.h"
+#include "job_system.h"
+#include "command_recorder.h"
+#include "frustum_culling.h"
+#include "storage_buffer.h"
+#include "gpu_culling.h"
+#include "transform_hierarchy.h"
+#include "render_graph.h"
+#include "mip_generator.h"
 
 
 
@@ -7,5 +7,6 @@ class IndexBuffer: public Buffer {
 public:
   IndexBuffer();
   IndexBuffer(const InitData& init, const RenderData& render, const std::vector<uint32_t>& vertices);
+  IndexBuffer(const InitData& init, const RenderData& render, const uint32_t* indices, VkDeviceSize size);
   void Bind() override;
 };
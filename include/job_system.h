@@ -0,0 +1,111 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::function<void()> Job;
+
+// Counts outstanding jobs. Every job submitted against a counter bumps it and
+// drops it when it finishes, so a counter at zero means the whole group is done.
+// Jobs queued with RunAfter are held here until it reaches zero, and the first
+// exception thrown by a job in the group is kept for Wait to rethrow.
+class JobCounter {
+public:
+  bool Done() const { return value_.load(std::memory_order_acquire) == 0; }
+
+private:
+  friend class JobSystem;
+
+  std::atomic<uint32_t> value_{ 0 };
+  std::mutex mutex_;
+  std::vector<Job> continuations_;
+  std::exception_ptr error_;
+};
+
+struct JobStats {
+  uint64_t jobs_run;
+  uint64_t steals;
+};
+
+// Work stealing scheduler. Each worker pushes and pops its own deque from the
+// back, idle workers steal from the front of the others. The thread that calls
+// Init becomes worker 0 and only runs jobs while it is inside Wait/ParallelFor,
+// it also owns the main thread queue (GLFW and anything else that has to stay
+// on the thread that created the window).
+class JobSystem {
+public:
+  JobSystem();
+  ~JobSystem();
+
+  // thread_count includes the calling thread
+  void Init(uint32_t thread_count);
+  // joins the workers, then runs any job still queued on the calling thread so every counter reaches zero.
+  // rethrows the first exception thrown by a job that had no counter
+  void Destroy();
+
+  void Run(Job job, JobCounter* counter = nullptr);
+  // job is only queued once dependency has reached zero
+  void RunAfter(JobCounter& dependency, Job job, JobCounter* counter = nullptr);
+
+  // runs other jobs while waiting, so it is fine to call from inside a job.
+  // rethrows the first exception any job in the group threw
+  void Wait(JobCounter& counter);
+
+  // calls func over [0, count) in chunks of at most grain items and blocks until all are done
+  void ParallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& func);
+
+  // queued until the main thread calls PumpMainThread (or waits on a counter)
+  void RunOnMainThread(Job job, JobCounter* counter = nullptr);
+  void PumpMainThread();
+
+  uint32_t ThreadCount() const { return static_cast<uint32_t>(workers_.size()); }
+  // index of the worker running the caller, 0 for the main thread and any thread outside the system
+  static uint32_t WorkerIndex();
+
+  JobStats GetStats() const;
+
+private:
+  struct QueuedJob {
+    Job func;
+    JobCounter* counter;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<QueuedJob> jobs;
+    std::thread thread;
+  };
+
+  void WorkerLoop(uint32_t index);
+  void Push(QueuedJob job);
+  bool TryRunOne(uint32_t index);
+  void Execute(QueuedJob& job);
+  void Finish(JobCounter* counter);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<uint32_t> next_worker_{ 0 };
+
+  std::thread::id main_thread_;
+  std::mutex main_mutex_;
+  std::vector<QueuedJob> main_jobs_;
+
+  // sleeping workers wait for queued_ to become non zero
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+  std::atomic<int32_t> queued_{ 0 };
+  std::atomic<bool> quit_{ false };
+
+  // first exception of a job without a counter, kept for Destroy
+  std::mutex error_mutex_;
+  std::exception_ptr error_;
+
+  std::atomic<uint64_t> jobs_run_{ 0 };
+  std::atomic<uint64_t> steals_{ 0 };
+};
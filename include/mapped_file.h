@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read only memory mapping of a whole file. Pages are faulted in by the OS on
+// first touch, so opening is cheap no matter how big the file is.
+class MappedFile {
+public:
+  MappedFile();
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // returns false if the file doesn't exist or can't be mapped, an empty file can't be mapped
+  bool Open(const std::string& path);
+  void Close();
+
+  bool IsOpen() const { return data_ != nullptr; }
+  const uint8_t* Data() const { return data_; }
+  size_t Size() const { return size_; }
+
+private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include "vulkan_headers.h"
+#include "block_metadata.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// how the host and the device access a resource. memory types are scored
+// against this instead of asking for exact property flags, so the same call
+// works on discrete, ReBAR, integrated and software (lavapipe) devices
+enum class MemoryUsage {
+  // only the device reads and writes, prefers device local and not host visible
+  GPU_ONLY,
+  // host writes once, device copies from it (staging), prefers system memory
+  CPU_ONLY,
+  // host writes often, device reads directly (uniforms), prefers device local
+  CPU_TO_GPU,
+  // device writes, host reads back, prefers host cached
+  GPU_TO_CPU
+};
+
+// a sub-range of a device memory block. buffers and images are bound at
+// memory + offset instead of owning a VkDeviceMemory each
+struct Allocation {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  // only set for host visible memory, blocks are mapped once when created
+  void* mapped = nullptr;
+  VkMemoryPropertyFlags property_flags = 0;
+
+  uint32_t pool = 0;
+  uint32_t block = 0;
+};
+
+struct AllocatorStats {
+  uint32_t block_count = 0;
+  uint32_t allocation_count = 0;
+  VkDeviceSize bytes_reserved = 0;
+  VkDeviceSize bytes_used = 0;
+  // 1 - largest free range / total free, averaged over the blocks weighted by size
+  float fragmentation = 0.0f;
+};
+
+class MemoryAllocator {
+public:
+  static const VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+  MemoryAllocator();
+
+  void Init(const InitData& init, VkDeviceSize block_size = DEFAULT_BLOCK_SIZE);
+  void Destroy();
+
+  // linear is true for buffers and linear images, false for optimal images.
+  // the two are kept in separate pools so bufferImageGranularity never applies
+  Allocation Allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, bool linear);
+
+  // allocate and bind in one go
+  Allocation AllocateBuffer(VkBuffer buffer, MemoryUsage usage);
+  Allocation AllocateImage(VkImage image, MemoryUsage usage);
+
+  void Free(Allocation& allocation);
+
+  AllocatorStats GetStats() const;
+  void PrintStats() const;
+
+  // heaps, memory types and where each MemoryUsage lands on this device
+  void PrintMemoryReport() const;
+
+  // true when a large device local heap is host visible (ReBAR) or the device
+  // shares system memory (integrated / software). device local data can then
+  // be written in place and the staging copy skipped
+  bool DirectUploadSupported() const { return direct_upload_; }
+
+  // highest scoring memory type allowed by type_filter, throws if none qualify.
+  // Allocate falls back to the next best type when the heap of this one is full
+  uint32_t FindMemoryType(uint32_t type_filter, MemoryUsage usage) const;
+
+private:
+  struct Block {
+    Block(VkDeviceMemory memory, VkDeviceSize size, void* mapped, bool dedicated)
+      : memory(memory), metadata(size), mapped(mapped), dedicated(dedicated) {}
+
+    VkDeviceMemory memory;
+    BlockMetadata metadata;
+    void* mapped;
+    uint32_t allocation_count = 0;
+    // dedicated blocks hold a single oversized allocation and are released with it
+    bool dedicated;
+  };
+
+  struct Pool {
+    uint32_t memory_type = 0;
+    // freed blocks leave a null slot behind so Allocation::block stays valid
+    std::vector<std::unique_ptr<Block>> blocks;
+  };
+
+  // FindMemoryType without the throw, UINT32_MAX if no type qualifies
+  uint32_t BestMemoryType(uint32_t type_filter, MemoryUsage usage) const;
+  // UINT32_MAX when the memory type's heap is out of memory
+  uint32_t CreateBlock(Pool& pool, VkDeviceSize size, bool dedicated);
+  void DestroyBlock(Pool& pool, uint32_t block_index);
+
+  VkDevice device_ = VK_NULL_HANDLE;
+  VkPhysicalDeviceMemoryProperties memory_properties_{};
+  VkPhysicalDeviceProperties device_properties_{};
+  VkDeviceSize block_size_ = DEFAULT_BLOCK_SIZE;
+  bool direct_upload_ = false;
+
+  // indexed by memory_type * 2 + (linear ? 0 : 1)
+  std::vector<Pool> pools_;
+  mutable std::mutex mutex_;
+};
@@ -0,0 +1,36 @@
+#pragma once
+#include "vulkan_headers.h"
+#include <cstdint>
+#include <vector>
+
+// Reordering passes for indexed triangle lists, meant to run in this order
+// after a mesh is loaded and welded:
+//   1. OptimizeVertexCache puts triangles that share vertices next to each other
+//   2. OptimizeOverdraw moves whole runs of triangles so outward facing ones draw first
+//   3. OptimizeVertexFetch lays the vertex array out in the order it is first read
+// None of them change what is drawn, only the order.
+
+const uint32_t VERTEX_CACHE_SIZE = 32;
+
+struct VertexCacheStats {
+  // post transform cache misses per triangle, 0.5 is the best a big regular grid can do and 3 the worst
+  float acmr;
+  // misses per referenced vertex, 1.0 means every vertex is transformed exactly once
+  float atvr;
+  uint32_t misses;
+};
+
+// simulates a FIFO post transform cache, no GPU needed
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertex_count,
+  uint32_t cache_size = VERTEX_CACHE_SIZE);
+
+// Forsyth's linear speed vertex cache optimisation
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertex_count);
+
+// Splits the cache optimized order into clusters wherever the cache restarts anyway and
+// sorts them front to back from the outside of the mesh. A result whose ACMR is more than
+// threshold times worse than the input is thrown away
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold = 1.05f);
+
+// reorders vertices by first use and rewrites indices to match, unreferenced vertices are dropped
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
@@ -0,0 +1,59 @@
+#pragma once
+#include "vulkan_headers.h"
+#include "job_system.h"
+#include <cstdint>
+#include <vector>
+
+enum class MipFilter {
+  // 2x2 average, what a linear blit does as well
+  BOX,
+  // 6 tap Kaiser windowed sinc, keeps detail the box filter blurs away at the cost of slight ringing
+  KAISER
+};
+
+const char* GetMipFilterName(MipFilter filter);
+
+struct MipLevel {
+  uint32_t width;
+  uint32_t height;
+  // into MipChain::data
+  size_t offset;
+};
+
+// every rgba8 level of an image tightly packed back to back, level 0 first,
+// the layout UploadManager::UploadImage takes
+struct MipChain {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<MipLevel> levels;
+  std::vector<uint8_t> data;
+};
+
+// levels down to 1x1, each half the size of the previous one rounded down
+uint32_t MipLevelCount(uint32_t width, uint32_t height);
+// bytes of the first level_count rgba8 levels together
+size_t MipChainSize(uint32_t width, uint32_t height, uint32_t level_count);
+
+// sizes chain for level_count levels, the pixels are left for the caller to fill in
+void LayoutMipChain(uint32_t width, uint32_t height, uint32_t level_count, MipChain& chain);
+
+// whether DownsampleRgba8 has a SIMD path on this CPU, SSE2 on x86-64
+bool MipSimdSupported();
+
+// src is width x height rgba8, dst receives max(1, width / 2) x max(1, height / 2). with srgb the color
+// channels are filtered in linear space, alpha always is. rows are split across the job system when there is one.
+// the box filter drops an odd last row or column
+void DownsampleRgba8(const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst, MipFilter filter, bool srgb,
+  JobSystem* jobs, bool use_simd = true);
+
+// full chain from level 0, each level is downsampled from the one before it
+void GenerateMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, MipFilter filter, bool srgb,
+  JobSystem* jobs, MipChain& chain, bool use_simd = true);
+
+// whether format can be both source and destination of a linearly filtered vkCmdBlitImage with optimal tiling
+bool SupportsLinearBlit(VkPhysicalDevice physical_device, VkFormat format);
+
+// fills levels 1..level_count - 1 from level 0 with one blit per level. expects every level in
+// VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL with level 0 just written by a transfer, and leaves every level in
+// VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL for the fragment shader. the queue has to support graphics
+void RecordMipBlits(VkCommandBuffer command_buffer, VkImage image, uint32_t width, uint32_t height, uint32_t level_count);
@@ -4,6 +4,7 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "vulkan_headers.h"
+#include "job_system.h"
 #include <string>
 #include <vector>
 
@@ -13,18 +14,62 @@
  * 3. Load vertices and indices.
  */
 
-/* Things I need to do:
- * Implement mesh and texture classes
- */
+// one assimp mesh, a range of the model's shared vertex and index arrays.
+// indices are relative to vertex_offset so they can go straight into vkCmdDrawIndexed
+struct Mesh {
+  uint32_t first_index;
+  uint32_t index_count;
+  int32_t vertex_offset;
+  uint32_t vertex_count;
+  uint32_t material;
+  // object space box around the mesh's vertices, used for culling
+  glm::vec3 bounds_min;
+  glm::vec3 bounds_max;
+};
 
+// fills mesh.bounds_min/max from its range of the shared vertex array
+void ComputeMeshBounds(const std::vector<Vertex>& vertices, Mesh& mesh);
 
+// a node that references a mesh, transform is the node's world transform
+struct MeshInstance {
+  uint32_t mesh;
+  glm::mat4 transform;
+};
 
+// texture paths are relative to the model's directory, empty if the material has none
+struct Material {
+  std::string name;
+  std::string diffuse_texture;
+  glm::vec3 diffuse_color;
+};
 
+// Imports a scene through assimp. Parsing is assimp's and single threaded, but
+// converting and optimizing each mesh is independent, so with a job system
+// meshes are processed in parallel and then packed into one arena.
 class Model {
 public:
-  Model(const char* path);
+  // without a job system every mesh is processed on the calling thread
+  Model(const char* path, JobSystem* jobs = nullptr);
+
+  const std::vector<Vertex>& GetVertices() const { return vertices_; }
+  const std::vector<uint32_t>& GetIndices() const { return indices_; }
+  const std::vector<Mesh>& GetMeshes() const { return meshes_; }
+  const std::vector<MeshInstance>& GetInstances() const { return instances_; }
+  const std::vector<Material>& GetMaterials() const { return materials_; }
+  const std::string& GetDirectory() const { return directory_; }
+  // every file the import read, the model file first
+  const std::vector<std::string>& GetSourceFiles() const { return source_files_; }
+
 private:
+  void ProcessNode(const aiNode* node, const glm::mat4& parent_transform);
+  void ProcessMaterials(const aiScene* scene);
+  static void ProcessMesh(const aiMesh* mesh, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
 
-  std::vector<Mesh> meshes;
-  std::string directory;
+  std::vector<Vertex> vertices_;
+  std::vector<uint32_t> indices_;
+  std::vector<Mesh> meshes_;
+  std::vector<MeshInstance> instances_;
+  std::vector<Material> materials_;
+  std::string directory_;
+  std::vector<std::string> source_files_;
 };
@@ -0,0 +1,105 @@
+#pragma once
+#include "vulkan_headers.h"
+#include "vertex_format.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Everything that goes into a graphics pipeline. The render pass only matters
+// through its attachment formats and sample count (render pass compatibility),
+// so a pipeline built against one render pass is reused for a recreated one.
+// Viewport and scissor are always dynamic, the extent never reaches the pipeline.
+struct GraphicsPipelineDesc {
+  const std::vector<uint32_t>* vertex_spirv = nullptr;
+  const std::vector<uint32_t>* fragment_spirv = nullptr;
+  VertexLayout vertex_layout;
+  // per instance streams (e.g. InstanceData) bound next to the layout's per vertex binding
+  std::vector<VkVertexInputBindingDescription> instance_bindings;
+  std::vector<VkVertexInputAttributeDescription> instance_attributes;
+
+  VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+  VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+  VkFrontFace front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+  bool depth_test = true;
+  bool depth_write = true;
+  VkCompareOp depth_compare = VK_COMPARE_OP_LESS;
+
+  // standard alpha blending on every color attachment
+  bool alpha_blend = false;
+
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+  VkRenderPass render_pass = VK_NULL_HANDLE;
+  uint32_t subpass = 0;
+  std::vector<VkFormat> color_formats;
+  VkFormat depth_format = VK_FORMAT_UNDEFINED;
+  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+struct ComputePipelineDesc {
+  const std::vector<uint32_t>* spirv = nullptr;
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+};
+
+struct PipelineStats {
+  uint32_t hits;
+  uint32_t creates;
+  float create_ms;
+  // bytes of driver cache loaded at startup, 0 on a cold start
+  size_t loaded_bytes;
+};
+
+// Owns every pipeline the engine builds, graphics and compute. Descriptions are hashed into a map,
+// so asking for the same state twice returns the existing pipeline. Creation
+// goes through a VkPipelineCache that is saved on Destroy and loaded on the
+// next Init, as long as it was written by the same device and driver.
+class PipelineManager {
+public:
+  PipelineManager();
+
+  // cache_path may be empty, then the driver cache only lives as long as the manager
+  void Init(const InitData& init, const std::string& cache_path);
+  // saves the driver cache and destroys every pipeline, the device must be idle
+  void Destroy();
+
+  VkPipeline GetGraphicsPipeline(const GraphicsPipelineDesc& desc);
+  VkPipeline GetComputePipeline(const ComputePipelineDesc& desc);
+
+  // writes the driver cache through a temporary file
+  bool Save();
+
+  PipelineStats GetStats() const { return stats_; }
+  void PrintStats() const;
+
+private:
+  // layout of the blob written to cache_path, the driver's data follows it
+  struct CacheFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+    uint64_t data_size;
+    uint64_t data_hash;
+  };
+
+  static const uint32_t MAGIC = 0x43504c50;  // "PLPC"
+  static const uint32_t VERSION = 1;
+
+  static uint64_t HashDesc(const GraphicsPipelineDesc& desc);
+  static uint64_t HashDesc(const ComputePipelineDesc& desc);
+  // the driver's initial data, or empty if the file is missing or from another device/driver
+  std::vector<uint8_t> LoadCacheData() const;
+  VkPipeline CreateGraphicsPipeline(const GraphicsPipelineDesc& desc);
+  VkPipeline CreateComputePipeline(const ComputePipelineDesc& desc);
+
+  const InitData* init_ = nullptr;
+  VkPhysicalDeviceProperties properties_{};
+  std::string cache_path_;
+  VkPipelineCache cache_ = VK_NULL_HANDLE;
+  std::unordered_map<uint64_t, VkPipeline> pipelines_;
+  PipelineStats stats_{};
+};
@@ -0,0 +1,189 @@
+#pragma once
+#include "vulkan_headers.h"
+#include "memory_allocator.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+// how a pass touches a resource. each use implies the stages, access and (for
+// images) layout it needs, and whether it writes
+enum class ResourceUse {
+  COLOR_ATTACHMENT,
+  DEPTH_ATTACHMENT,
+  // sampled in a fragment shader
+  SAMPLED,
+  // storage buffer / image in a compute shader
+  STORAGE_READ,
+  STORAGE_WRITE,
+  INDIRECT_READ,
+  TRANSFER_SRC,
+  TRANSFER_DST
+};
+
+// size and format of an image the graph owns. usage is collected from the passes that use it
+struct TransientImageDesc {
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  VkExtent2D extent = { 0, 0 };
+};
+
+typedef std::function<void(VkCommandBuffer command_buffer)> RecordPassFunc;
+
+struct RenderGraphStats {
+  uint32_t pass_count = 0;
+  uint32_t culled_pass_count = 0;
+  uint32_t transient_count = 0;
+  uint32_t transient_allocation_count = 0;
+  // what the transients would take with an allocation each, and what they take aliased
+  VkDeviceSize transient_bytes = 0;
+  VkDeviceSize aliased_bytes = 0;
+  // per Execute
+  uint32_t barrier_batch_count = 0;
+  uint32_t barrier_count = 0;
+};
+
+// Frame graph over one command buffer. Passes are declared in execution order
+// together with every resource they use, Compile then drops passes whose results
+// never reach an imported resource, works out the barriers each pass needs from
+// the previous use of every resource (one batched call per pass, nothing for
+// read after read), and places transient images whose lifetimes don't overlap
+// in the same memory. Compile once, Execute every frame, and Reset + rebuild
+// when the graph or the extent changes.
+//
+// With a vkCmdPipelineBarrier2 function pointer each barrier carries its own
+// stages, without one a pass's barriers are merged into one vkCmdPipelineBarrier.
+class RenderGraph {
+public:
+  RenderGraph();
+  ~RenderGraph();
+
+  // pipeline_barrier2 is optional, VK_KHR_synchronization2's vkCmdPipelineBarrier2KHR
+  void Init(const InitData& init, PFN_vkCmdPipelineBarrier2KHR pipeline_barrier2);
+  void Destroy();
+
+  // drops every pass and resource and frees the transient images
+  void Reset();
+
+  // images that outlive the frame (swapchain images, readback targets). they are handed over in
+  // initial_layout and left in final_layout, and anything that writes them is never culled
+  uint32_t ImportImage(const std::string& name, VkFormat format, VkImageLayout initial_layout, VkImageLayout final_layout);
+  // writes to imported buffers are never culled, their first use in a frame is assumed to be
+  // ordered against the previous frame already (by the frame's fence)
+  uint32_t ImportBuffer(const std::string& name);
+  uint32_t CreateImage(const std::string& name, const TransientImageDesc& desc);
+
+  // imported handles may change every frame (one per swapchain image, one per frame in flight)
+  void SetImportedImage(uint32_t resource, VkImage image);
+  void SetImportedBuffer(uint32_t resource, VkBuffer buffer);
+
+  uint32_t AddPass(const std::string& name, RecordPassFunc record);
+  void UseResource(uint32_t pass, uint32_t resource, ResourceUse use);
+
+  // culls passes, computes barriers and creates the transient images. throws on a use that
+  // doesn't fit the resource (a buffer as an attachment, an image as an indirect buffer)
+  void Compile();
+
+  // records every pass that survived culling with its barriers in front of it
+  void Execute(VkCommandBuffer command_buffer);
+
+  // transients only, valid after Compile
+  VkImage GetImage(uint32_t resource) const;
+  VkImageView GetImageView(uint32_t resource) const;
+
+  bool UsesSync2() const { return pipeline_barrier2_ != nullptr; }
+  const RenderGraphStats& GetStats() const { return stats_; }
+  void PrintStats() const;
+
+private:
+  struct UseInfo {
+    VkPipelineStageFlags2KHR stages;
+    VkAccessFlags2KHR access;
+    VkImageLayout layout;
+    VkImageUsageFlags image_usage;
+    bool write;
+  };
+
+  struct Resource {
+    std::string name;
+    bool is_image = true;
+    bool imported = false;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = { 0, 0 };
+    VkImageLayout initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkBuffer buffer = VK_NULL_HANDLE;
+
+    // filled in by Compile, first and last pass in execution order, -1 if unused
+    int first_pass = -1;
+    int last_pass = -1;
+    VkImageUsageFlags usage = 0;
+    // every stage and write access any pass uses it with, what its first use has to wait for
+    // when the memory was last used by this or an aliased image
+    VkPipelineStageFlags2KHR all_stages = 0;
+    VkAccessFlags2KHR all_write_access = 0;
+    uint32_t memory_slot = 0;
+  };
+
+  struct PassUse {
+    uint32_t resource;
+    ResourceUse use;
+  };
+
+  struct Pass {
+    std::string name;
+    RecordPassFunc record;
+    std::vector<PassUse> uses;
+    bool culled = false;
+    // index into barriers_ of the batch recorded in front of the pass
+    size_t barrier_begin = 0;
+    size_t barrier_end = 0;
+  };
+
+  struct Barrier {
+    uint32_t resource;
+    VkPipelineStageFlags2KHR src_stages;
+    VkAccessFlags2KHR src_access;
+    VkPipelineStageFlags2KHR dst_stages;
+    VkAccessFlags2KHR dst_access;
+    VkImageLayout old_layout;
+    VkImageLayout new_layout;
+  };
+
+  // transients sharing memory, none of their lifetimes overlap
+  struct MemorySlot {
+    VkMemoryRequirements requirements{};
+    std::vector<uint32_t> resources;
+    Allocation allocation;
+  };
+
+  static UseInfo GetUseInfo(ResourceUse use);
+  static VkImageAspectFlags GetAspect(VkFormat format);
+
+  void CullPasses();
+  void ComputeLifetimes();
+  void ComputeBarriers();
+  void CreateTransients();
+  void DestroyTransients();
+  void RecordBarriers(VkCommandBuffer command_buffer, size_t begin, size_t end);
+
+  const InitData* init_ = nullptr;
+  PFN_vkCmdPipelineBarrier2KHR pipeline_barrier2_ = nullptr;
+
+  std::vector<Resource> resources_;
+  std::vector<Pass> passes_;
+  std::vector<Barrier> barriers_;
+  // after the last pass, imported images going to their final layout
+  size_t final_barrier_begin_ = 0;
+  std::vector<MemorySlot> memory_slots_;
+  bool compiled_ = false;
+
+  // reused every Execute
+  std::vector<VkImageMemoryBarrier2KHR> image_barriers2_;
+  std::vector<VkBufferMemoryBarrier2KHR> buffer_barriers2_;
+  std::vector<VkImageMemoryBarrier> image_barriers_;
+  std::vector<VkBufferMemoryBarrier> buffer_barriers_;
+
+  RenderGraphStats stats_;
+};
@@ -1,18 +1,39 @@
 #pragma once
 #include "vulkan_headers.h"
+#include "shader_cache.h"
 #include <shaderc/shaderc.hpp>
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
 enum class ShaderType{
   VERTEX_SHADER, 
-  FRAGMENT_SHADER 
+  FRAGMENT_SHADER,
+  COMPUTE_SHADER
 };
 
+shaderc_shader_kind GetShaderKind(ShaderType type);
+VkShaderStageFlagBits GetShaderStage(ShaderType type);
+
+std::string ReadFile(const char* filepath);
+
+// #include "file" is resolved relative to the including file. shaderc::Compiler isn't meant to be
+// shared between threads, so parallel callers pass their own; null compiles with a temporary one.
+// returns an empty vector if compilation fails, with the message in error or on stderr if error is null
+std::vector<uint32_t> CompileShader(const std::string& source_name, shaderc_shader_kind shader_kind,
+  const std::string& source, const std::vector<std::string>& defines, bool optimize = false,
+  shaderc::Compiler* compiler = nullptr, std::string* error = nullptr);
+
 class Shader {
 public:
-  Shader(const char* file_name, const char* entry_name, ShaderType type , const InitData& init);
+  // defines are passed to the preprocessor to pick a variant, e.g. HAS_COLOR.
+  // a file ending in .spv is loaded as is, defines are ignored then
+  Shader(const char* file_name, const char* entry_name, ShaderType type , const InitData& init,
+    const std::vector<std::string>& defines = {});
+  // wraps SPIR-V that was already compiled, e.g. by a ShaderLibrary
+  Shader(const std::vector<uint32_t>& spirv, const char* entry_name, ShaderType type, const InitData& init);
   ~Shader();
 
   VkShaderModule GetModule() const { return module_; }
@@ -0,0 +1,52 @@
+#pragma once
+#include "asset_cache.h"
+#include <shaderc/shaderc.hpp>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ShaderCacheStats {
+  uint32_t memory_hits;
+  uint32_t disk_hits;
+  uint32_t compiles;
+  float compile_ms;
+  // hashing sources and reading cached SPIR-V
+  float lookup_ms;
+};
+
+// Two level SPIR-V cache in front of shaderc. The key covers the compiler build,
+// the source, every file it #includes, the stage, the defines and the compile
+// options, so a hit is always safe to use. Hits within a run come from memory (swapchain
+// recreation rebuilds the pipeline), hits across runs from the asset cache.
+class ShaderCache {
+public:
+  ShaderCache();
+
+  // disk_cache may be null, then only the in memory level is used
+  void Init(AssetCache* disk_cache, bool optimize = false);
+
+  // SPIR-V for source_path compiled with defines, empty if it failed to compile.
+  // compiler and error are passed through to CompileShader on a miss
+  std::vector<uint32_t> GetSpirv(const std::string& source_path, shaderc_shader_kind kind,
+    const std::vector<std::string>& defines, shaderc::Compiler* compiler = nullptr, std::string* error = nullptr);
+
+  // reads an offline compiled .spv as is
+  static std::vector<uint32_t> LoadSpirv(const std::string& path);
+
+  ShaderCacheStats GetStats() const;
+  void PrintStats() const;
+
+private:
+  // hashes the text of every file reachable through #include lines
+  static void HashIncludes(const std::string& path, const std::string& source, uint64_t& hash,
+    std::vector<std::string>& visited);
+
+  AssetCache* disk_cache_ = nullptr;
+  bool optimize_ = false;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::vector<uint32_t>> memory_;
+  ShaderCacheStats stats_{};
+};
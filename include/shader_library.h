@@ -0,0 +1,60 @@
+#pragma once
+#include "shader.h"
+#include "shader_cache.h"
+#include "job_system.h"
+#include <shaderc/shaderc.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// one permutation of a shader source, defines are passed to the preprocessor as is
+struct ShaderVariant {
+  std::string path;
+  ShaderType type;
+  std::vector<std::string> defines;
+};
+
+// Collects shader variants and compiles them in parallel on the job system.
+// shaderc::Compiler is not shared between threads, so each worker compiles with
+// its own. Variants go through the shader cache when there is one, and every
+// failure in a batch is reported together instead of stopping at the first.
+class ShaderLibrary {
+public:
+  ShaderLibrary();
+
+  // cache may be null. jobs has to keep its thread count until Destroy
+  void Init(JobSystem& jobs, ShaderCache* cache);
+  void Destroy();
+
+  // registers a variant to be built by the next Compile, adding the same variant twice returns the same handle.
+  // a path ending in .spv is loaded as is
+  uint32_t Add(const std::string& path, ShaderType type, const std::vector<std::string>& defines = {});
+
+  // builds everything added since the last call and blocks until done.
+  // throws one exception listing every variant that failed
+  void Compile();
+
+  const ShaderVariant& GetVariant(uint32_t handle) const { return entries_[handle].variant; }
+  const std::vector<uint32_t>& GetSpirv(uint32_t handle) const { return entries_[handle].spirv; }
+  size_t VariantCount() const { return entries_.size(); }
+
+private:
+  struct Entry {
+    ShaderVariant variant;
+    std::vector<uint32_t> spirv;
+  };
+
+  static std::string MakeKey(const ShaderVariant& variant);
+
+  JobSystem* jobs_ = nullptr;
+  ShaderCache* cache_ = nullptr;
+  // indexed by JobSystem::WorkerIndex
+  std::vector<std::unique_ptr<shaderc::Compiler>> compilers_;
+
+  std::vector<Entry> entries_;
+  std::unordered_map<std::string, uint32_t> handles_;
+  // entries_ before this index have been compiled
+  size_t compiled_ = 0;
+};
@@ -0,0 +1,11 @@
+#pragma once
+#include "vulkan_headers.h"
+#include "buffer.h"
+
+// read only shader data uploaded once, e.g. per object transforms
+class StorageBuffer : public Buffer {
+public:
+  StorageBuffer();
+  StorageBuffer(const InitData& init, const RenderData& render, const void* data, VkDeviceSize size);
+  void Bind() override;
+};
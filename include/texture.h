@@ -1,33 +1,30 @@
 #pragma once
 #include "vulkan_headers.h"
+#include "memory_allocator.h"
 #include <string>
 
 
 class Texture {
 public:
-  Texture(const InitData& instance, const std::string& filepath, VkCommandPool command_pool);
+  Texture(const InitData& instance, const std::string& filepath, const RenderData& render);
 
   inline VkImage Image() const { return texture_image_; }
-  inline VkDeviceMemory Memory() const { return texture_image_memory_; }
+  inline VkDeviceMemory Memory() const { return texture_image_allocation_.memory; }
   inline VkImageView ImageView() const { return texture_image_view_; }
   inline VkSampler Sampler() const { return texture_sampler_; }
+  // full chain down to 1x1, what a sampler's maxLod should be
+  inline uint32_t MipLevels() const { return mip_levels_; }
 
 private:
 
-  void CopyBufferToImage(const InitData& instance, VkBuffer buffer, VkImage image,
-    uint32_t width, uint32_t height, VkCommandPool command_pool);
-
-  void CreateImage(const InitData& instance, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
-    VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& image_memory);
-
-  void TransitionImageLayout(const InitData& instance, VkImage image, VkFormat format, VkImageLayout old_layout,
-    VkImageLayout new_layout, VkCommandPool command_pool);
+  void CreateImage(const InitData& instance, uint32_t width, uint32_t height, uint32_t mip_levels, VkFormat format,
+    VkImageTiling tiling, VkImageUsageFlags usage, MemoryUsage memory_usage, VkImage& image, Allocation& image_allocation);
 
   VkImage texture_image_;
-  VkDeviceMemory texture_image_memory_;
+  Allocation texture_image_allocation_;
   VkImageView texture_image_view_;
   VkSampler texture_sampler_;
+  uint32_t mip_levels_ = 1;
 
   InitData instance_;
-  VkCommandPool command_pool_;
 };
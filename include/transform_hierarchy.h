@@ -0,0 +1,80 @@
+#pragma once
+#include "vulkan_headers.h"
+#include "job_system.h"
+#include <glm/gtc/quaternion.hpp>
+#include <cstdint>
+#include <vector>
+
+struct LocalTransform {
+  glm::vec3 translation = glm::vec3(0.0f);
+  // unit quaternion, glm::quat(w, x, y, z)
+  glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+  glm::vec3 scale = glm::vec3(1.0f);
+};
+
+// Scene graph transforms as flat arrays. Nodes are handed out as stable ids but
+// stored sorted by depth, so a parent always sits in an earlier level than its
+// children and Update can walk the levels in order, splitting each one across
+// the job system without any locking. Setting a local transform only marks that
+// node dirty, Update pushes the dirty bits down level by level and only
+// recomputes world matrices under a dirty node.
+class TransformHierarchy {
+public:
+  static constexpr uint32_t INVALID_NODE = UINT32_MAX;
+
+  TransformHierarchy();
+
+  void Reserve(size_t count);
+  void Clear();
+
+  // parent has to exist already, so ids always come after their parent's
+  uint32_t AddNode(uint32_t parent = INVALID_NODE, const LocalTransform& local = LocalTransform());
+
+  void SetLocal(uint32_t node, const LocalTransform& local);
+  void SetTranslation(uint32_t node, const glm::vec3& translation);
+  void SetRotation(uint32_t node, const glm::quat& rotation);
+  void SetScale(uint32_t node, const glm::vec3& scale);
+
+  LocalTransform GetLocal(uint32_t node) const;
+  // as of the last Update, local changes since then aren't reflected
+  const glm::mat4& GetWorld(uint32_t node) const { return world_[slot_of_node_[node]]; }
+  uint32_t GetParent(uint32_t node) const { return parent_node_[node]; }
+
+  // recomputes the world matrix of every dirty node and everything below it.
+  // levels big enough to split go through the job system when there is one.
+  // returns the number of world matrices written
+  size_t Update(JobSystem* jobs);
+
+  // reference result for checking Update, one recursive walk from every root without the dirty bits.
+  // world is indexed by node id
+  void ComputeWorldRecursive(std::vector<glm::mat4>& world) const;
+
+  size_t Size() const { return parent_node_.size(); }
+  uint32_t LevelCount() const { return static_cast<uint32_t>(level_begin_.size()) - 1; }
+
+private:
+  void MarkDirty(uint32_t slot);
+  // re sorts the arrays by depth after nodes were added
+  void Rebuild();
+  size_t UpdateRange(size_t begin, size_t end);
+
+  // per node id
+  std::vector<uint32_t> parent_node_;
+  std::vector<uint32_t> depth_;
+  std::vector<uint32_t> slot_of_node_;
+
+  // per slot, in depth order
+  std::vector<uint32_t> node_of_slot_;
+  std::vector<uint32_t> parent_slot_;
+  std::vector<glm::vec3> translation_;
+  std::vector<glm::quat> rotation_;
+  std::vector<glm::vec3> scale_;
+  std::vector<glm::mat4> world_;
+  std::vector<uint8_t> dirty_;
+
+  // slots [level_begin_[ii], level_begin_[ii + 1]) are at depth ii
+  std::vector<size_t> level_begin_{ 0 };
+  // nothing above this level is dirty
+  uint32_t first_dirty_level_ = 0;
+  bool needs_rebuild_ = false;
+};
@@ -0,0 +1,58 @@
+#pragma once
+#include "vulkan_headers.h"
+#include "memory_allocator.h"
+#include <cstring>
+#include <vector>
+
+// a bump allocated slice of the current frame's buffer. offset is what gets
+// passed as the dynamic offset when the descriptor set is bound
+struct TransientAllocation {
+  VkBuffer buffer = VK_NULL_HANDLE;
+  uint32_t offset = 0;
+  void* data = nullptr;
+};
+
+// Linear per-frame allocator for constants that only live for one frame. Each
+// frame in flight owns one persistently mapped buffer, BeginFrame rewinds it and
+// Allocate just moves an offset, so writing per frame data needs no driver calls.
+class TransientAllocator {
+public:
+  static const VkDeviceSize DEFAULT_FRAME_SIZE = 4ull * 1024 * 1024;
+
+  TransientAllocator();
+
+  void Init(const InitData& init, uint32_t frame_count, VkDeviceSize frame_size = DEFAULT_FRAME_SIZE);
+  void Destroy(const InitData& init);
+
+  // only call once the frame's fence has signalled, the previous contents are overwritten
+  void BeginFrame(uint32_t frame);
+
+  // offsets are aligned to minUniformBufferOffsetAlignment / minStorageBufferOffsetAlignment
+  TransientAllocation Allocate(VkDeviceSize size);
+
+  template <typename T>
+  TransientAllocation Push(const T& value) {
+    TransientAllocation allocation = Allocate(sizeof(T));
+    memcpy(allocation.data, &value, sizeof(T));
+    return allocation;
+  }
+
+  VkBuffer GetBuffer(uint32_t frame) const { return frames_[frame].buffer; }
+  VkDeviceSize GetFrameSize() const { return frame_size_; }
+  // most bytes any single frame has used so far
+  VkDeviceSize GetHighWaterMark() const { return high_water_mark_; }
+
+private:
+  struct Frame {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    Allocation allocation;
+  };
+
+  std::vector<Frame> frames_;
+  VkDeviceSize frame_size_ = 0;
+  VkDeviceSize alignment_ = 256;
+
+  uint32_t current_frame_ = 0;
+  VkDeviceSize head_ = 0;
+  VkDeviceSize high_water_mark_ = 0;
+};
@@ -0,0 +1,123 @@
+#pragma once
+#include "vulkan_headers.h"
+#include "memory_allocator.h"
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
+
+// identifies a submitted batch of copies, tickets increase with every Flush
+typedef uint64_t UploadTicket;
+
+struct UploadStats {
+  uint32_t submits = 0;
+  // times the host had to block on an upload fence
+  uint32_t waits = 0;
+  uint32_t buffer_copies = 0;
+  uint32_t image_copies = 0;
+  // levels filled by blitting from the level above instead of copied
+  uint32_t mip_blits = 0;
+  VkDeviceSize bytes = 0;
+};
+
+// Batches buffer and image copies into one command buffer fed from a persistently
+// mapped staging ring. Nothing is submitted until Flush, and callers poll or wait
+// on the returned ticket instead of idling the queue after every copy.
+// Not thread safe, uploads are recorded from the thread that owns the queue.
+class UploadManager {
+public:
+  static const VkDeviceSize DEFAULT_RING_SIZE = 32ull * 1024 * 1024;
+
+  UploadManager();
+
+  // when the device has a transfer only family the copies run there and the
+  // resources are handed over to the graphics family at the end of the batch
+  void Init(const InitData& init, uint32_t graphics_family, std::optional<uint32_t> transfer_family,
+    VkDeviceSize ring_size = DEFAULT_RING_SIZE);
+  void Destroy();
+
+  // data is copied into the staging ring before these return
+  void UploadBuffer(VkBuffer dst_buffer, VkDeviceSize dst_offset, const void* data, VkDeviceSize size);
+  // the image ends up in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL. with level_count > 1 data holds that many
+  // levels back to back, level 0 first, each half the size of the one before rounded down
+  void UploadImage(VkImage dst_image, uint32_t width, uint32_t height, const void* data, VkDeviceSize size,
+    uint32_t level_count = 1);
+  // data is level 0 only, levels 1..level_count - 1 are blitted from it on the graphics queue. the image needs
+  // transfer src usage and a format SupportsLinearBlit accepts
+  void UploadImageGenerateMips(VkImage dst_image, uint32_t width, uint32_t height, const void* data, VkDeviceSize size,
+    uint32_t level_count);
+
+  // submits everything recorded since the last flush
+  UploadTicket Flush();
+  bool IsComplete(UploadTicket ticket);
+  void Wait(UploadTicket ticket);
+  void WaitIdle();
+
+  const UploadStats& GetStats() const { return stats_; }
+  void PrintStats() const;
+
+private:
+  struct Batch {
+    VkCommandBuffer transfer_commands = VK_NULL_HANDLE;
+    // only used with a dedicated transfer family, acquires ownership on the graphics queue
+    VkCommandBuffer acquire_commands = VK_NULL_HANDLE;
+    VkSemaphore transfer_done = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+
+    UploadTicket ticket = 0;
+    // ring position this batch's staging data ends at
+    uint64_t ring_end = 0;
+    // uploads bigger than the ring get their own staging buffer until the batch retires
+    std::vector<std::pair<VkBuffer, Allocation>> oversized;
+  };
+
+  void BeginBatch();
+  // stages data and copies it into the first copy_level_count of level_count levels, leaving all of them in
+  // VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+  void CopyToImage(VkImage dst_image, uint32_t width, uint32_t height, const void* data, VkDeviceSize size,
+    uint32_t copy_level_count, uint32_t level_count);
+  void Stage(const void* data, VkDeviceSize size, VkBuffer& src_buffer, VkDeviceSize& src_offset);
+  void CollectCompleted();
+  void RetireOldest();
+
+  bool Dedicated() const { return transfer_family_ != graphics_family_; }
+
+  VkDevice device_ = VK_NULL_HANDLE;
+  MemoryAllocator* allocator_ = nullptr;
+
+  uint32_t graphics_family_ = 0;
+  uint32_t transfer_family_ = 0;
+  VkQueue graphics_queue_ = VK_NULL_HANDLE;
+  VkQueue transfer_queue_ = VK_NULL_HANDLE;
+  VkCommandPool transfer_pool_ = VK_NULL_HANDLE;
+  VkCommandPool acquire_pool_ = VK_NULL_HANDLE;
+
+  VkBuffer ring_buffer_ = VK_NULL_HANDLE;
+  Allocation ring_allocation_;
+  VkDeviceSize ring_size_ = 0;
+  // monotonic positions, the physical offset is position % ring_size_
+  uint64_t ring_head_ = 0;
+  uint64_t ring_tail_ = 0;
+
+  Batch current_;
+  bool recording_ = false;
+  std::vector<VkBufferMemoryBarrier> buffer_barriers_;
+  std::vector<VkImageMemoryBarrier> image_barriers_;
+
+  struct PendingMips {
+    VkImage image;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+  };
+  // with a dedicated transfer family the blits wait for the acquire on the graphics queue
+  std::vector<PendingMips> pending_mips_;
+
+  std::deque<Batch> in_flight_;
+  std::vector<Batch> free_batches_;
+
+  UploadTicket last_submitted_ = 0;
+  UploadTicket last_completed_ = 0;
+
+  UploadStats stats_;
+};
@@ -7,5 +7,7 @@ class VertexBuffer : public Buffer {
 public:
   VertexBuffer();
   VertexBuffer(const InitData& init, const RenderData& render, const std::vector<Vertex>& vertices);
+  // already encoded vertices, e.g. a QuantizedMesh
+  VertexBuffer(const InitData& init, const RenderData& render, const void* data, VkDeviceSize size);
   void Bind() override;
 };
@@ -0,0 +1,86 @@
+#pragma once
+#include "vulkan_headers.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compact vertex layouts. Quantized positions are stored in [-1, 1] relative to
+// the mesh bounds and expanded again in the vertex shader with the scale and
+// offset in MeshConstants. Attribute locations never move (position 0, color 1,
+// uv 2, normal 3), a dropped attribute just isn't declared by the shader variant.
+
+enum class PositionFormat {
+  FLOAT32,  // 12 bytes
+  HALF,     // 8 bytes, bounds relative
+  SNORM16   // 8 bytes, bounds relative
+};
+
+enum class ColorFormat {
+  NONE,     // shader uses white
+  FLOAT32,  // 12 bytes
+  UNORM8    // 4 bytes
+};
+
+enum class TexCoordFormat {
+  FLOAT32,  // 8 bytes
+  HALF,     // 4 bytes
+  UNORM16   // 4 bytes, only for uvs inside [0, 1]
+};
+
+enum class NormalFormat {
+  NONE,
+  OCT_SNORM16  // 4 bytes, octahedral encoded
+};
+
+struct VertexLayout {
+  PositionFormat position = PositionFormat::FLOAT32;
+  ColorFormat color = ColorFormat::FLOAT32;
+  TexCoordFormat tex_coord = TexCoordFormat::FLOAT32;
+  NormalFormat normal = NormalFormat::NONE;
+
+  // same bytes as Vertex
+  static VertexLayout Full();
+
+  uint32_t Stride() const;
+  VkVertexInputBindingDescription GetBindingDescription() const;
+  std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions() const;
+  // preprocessor defines for the vertex shader variant that reads this layout
+  std::vector<std::string> GetShaderDefines() const;
+};
+
+struct QuantizedMesh {
+  VertexLayout layout;
+  std::vector<uint8_t> data;
+  uint32_t vertex_count = 0;
+  // pushed per draw, identity for float positions
+  MeshConstants constants;
+};
+
+struct QuantizationReport {
+  uint32_t stride_before;
+  uint32_t stride_after;
+  size_t bytes_before;
+  size_t bytes_after;
+  // largest round trip error in model units / uv units / degrees
+  float max_position_error;
+  float max_tex_coord_error;
+  float max_normal_error;
+};
+
+// smallest layout whose position error stays under position_tolerance (in model units).
+// normals is optional since Vertex doesn't carry them yet
+VertexLayout SelectVertexLayout(const std::vector<Vertex>& vertices, float position_tolerance,
+  const std::vector<glm::vec3>* normals = nullptr);
+
+QuantizedMesh QuantizeVertices(const std::vector<Vertex>& vertices, const VertexLayout& layout,
+  const std::vector<glm::vec3>* normals = nullptr);
+
+// decodes mesh again on the CPU and compares against the source
+QuantizationReport AnalyzeQuantization(const std::vector<Vertex>& vertices, const QuantizedMesh& mesh,
+  const std::vector<glm::vec3>* normals = nullptr);
+
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+// unit vector to two snorm values on the octahedron and back
+glm::vec2 OctEncode(const glm::vec3& normal);
+glm::vec3 OctDecode(const glm::vec2& encoded);
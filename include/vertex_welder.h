@@ -0,0 +1,29 @@
+#pragma once
+#include "vulkan_headers.h"
+#include <cstdint>
+#include <vector>
+
+// Builds an indexed mesh out of a stream of vertices by merging bitwise
+// identical ones. Lookups go through an open addressing table of indices into
+// the output array, sized up front from the expected vertex count so loading a
+// mesh normally never rehashes.
+class VertexWelder {
+public:
+  // vertices is appended to and only what is added through the welder is merged, expected_vertices is an upper bound on how many unique ones will be added
+  VertexWelder(std::vector<Vertex>& vertices, size_t expected_vertices);
+
+  // returns the index of vertex in the output array, adding it if it's new
+  uint32_t Add(const Vertex& vertex);
+
+private:
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+
+  static uint32_t Hash(const Vertex& vertex);
+  void Grow();
+
+  std::vector<Vertex>& vertices_;
+  // first vertex this welder owns
+  size_t base_ = 0;
+  std::vector<uint32_t> slots_;
+  size_t mask_ = 0;
+};
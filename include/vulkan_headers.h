@@ -9,6 +9,9 @@
 #include <vector>
 
 class Texture;
+class MemoryAllocator;
+class UploadManager;
+class ShaderCache;
 
 
 struct Vertex {
@@ -47,11 +50,57 @@ struct Vertex {
   }
 };
 
-struct Mesh {
-  std::vector<Vertex> vertices_;
-  std::vector<uint32_t> indices_;
-  // can a model have multiple textures?
-  std::vector<Texture> textures_;
+// per instance stream of an instanced draw, read at binding 1 with VK_VERTEX_INPUT_RATE_INSTANCE.
+// the mat4 takes four locations, starting after the vertex attributes
+struct InstanceData {
+  glm::mat4 transform;
+
+  static const uint32_t BINDING = 1;
+  static const uint32_t FIRST_LOCATION = 4;
+
+  static VkVertexInputBindingDescription GetBindingDescription() {
+    VkVertexInputBindingDescription binding_description{};
+    binding_description.binding = BINDING;
+    binding_description.stride = sizeof(InstanceData);
+    binding_description.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    return binding_description;
+  }
+
+  // one vec4 column per location
+  static std::array<VkVertexInputAttributeDescription, 4> GetAttributeDescription() {
+    std::array<VkVertexInputAttributeDescription, 4> attribute_descriptions{};
+    for (uint32_t ii = 0; ii < 4; ii++) {
+      attribute_descriptions[ii].binding = BINDING;
+      attribute_descriptions[ii].location = FIRST_LOCATION + ii;
+      attribute_descriptions[ii].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+      attribute_descriptions[ii].offset = offsetof(InstanceData, transform) + sizeof(glm::vec4) * ii;
+    }
+
+    return attribute_descriptions;
+  }
+};
+
+// per draw push constants, expands quantized positions back into model space
+struct MeshConstants {
+  glm::vec4 position_scale = glm::vec4(1.0f);
+  glm::vec4 position_offset = glm::vec4(0.0f);
+};
+
+// everything a recording thread needs to issue one draw
+struct DrawItem {
+  VkBuffer vertex_buffer;
+  VkBuffer index_buffer;
+  uint32_t index_count;
+  uint32_t first_index;
+  int32_t vertex_offset;
+  // dynamic offset of the draw's uniforms in the frame's transient buffer
+  uint32_t ubo_offset;
+  MeshConstants constants;
+  // instanced draws read instance_count InstanceData from instance_buffer at instance_offset
+  uint32_t instance_count = 1;
+  VkBuffer instance_buffer = VK_NULL_HANDLE;
+  VkDeviceSize instance_offset = 0;
 };
 
 struct UniformBufferObject {
@@ -74,10 +123,16 @@ struct InitData {
   VkQueue graphics_queue;
   VkQueue presentation_queue;
 
+  // device memory for buffers and images is sub-allocated from here
+  MemoryAllocator* allocator = nullptr;
+  // compiled SPIR-V is looked up here before running shaderc, optional
+  ShaderCache* shader_cache = nullptr;
 };
 
 
 // TO BE EXPANDED
 struct RenderData {
   VkCommandPool command_pool;
+  // staging copies are batched here instead of submitted one by one
+  UploadManager* uploader = nullptr;
 };
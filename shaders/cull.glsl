@@ -0,0 +1,68 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// one invocation per object, writes the draw for every object that touches the frustum
+layout(local_size_x = 64) in;
+
+#include "gpu_object.glsl"
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand {
+  uint index_count;
+  uint instance_count;
+  uint first_index;
+  int vertex_offset;
+  uint first_instance;
+};
+
+layout(std430, binding = 0) readonly buffer Objects {
+  GpuObject objects[];
+};
+
+layout(std430, binding = 1) writeonly buffer DrawCommands {
+  DrawCommand draws[];
+};
+
+layout(std430, binding = 2) buffer DrawCount {
+  uint draw_count;
+};
+
+// planes point inwards, matches CullConstants in gpu_culling.h
+layout(push_constant) uniform CullConstants {
+  vec4 planes[6];
+  uint object_count;
+  uint compact;
+} cull;
+
+void main() {
+  uint index = gl_GlobalInvocationID.x;
+  if (index >= cull.object_count) {
+    return;
+  }
+
+  GpuObject object = objects[index];
+  bool visible = true;
+  for (int ii = 0; ii < 6; ii++) {
+    vec4 plane = cull.planes[ii];
+    float center_distance = dot(plane.xyz, object.center.xyz) + plane.w;
+    float radius = dot(abs(plane.xyz), object.extent.xyz);
+    visible = visible && center_distance + radius >= 0.0;
+  }
+
+  // first_instance carries the object index through to gl_InstanceIndex in the vertex shader
+  DrawCommand draw = DrawCommand(object.index_count, visible ? 1u : 0u, object.first_index, object.vertex_offset, index);
+
+  // with a draw count the visible draws are packed to the front, without one
+  // every object keeps its slot and a culled one draws zero instances
+  if (cull.compact != 0) {
+    if (visible) {
+      draws[atomicAdd(draw_count, 1u)] = draw;
+    }
+  }
+  else {
+    draws[index] = draw;
+    if (visible) {
+      atomicAdd(draw_count, 1u);
+    }
+  }
+}
@@ -0,0 +1,11 @@
+// one entry of the object buffer, matches GpuObject in gpu_culling.h (std430)
+struct GpuObject {
+  mat4 transform;
+  // world space box around the mesh, w unused
+  vec4 center;
+  vec4 extent;
+  uint first_index;
+  uint index_count;
+  int vertex_offset;
+  uint padding;
+};
@@ -0,0 +1,7 @@
+// inverse of OctEncode in vertex_format.cpp, encoded is in [-1, 1]
+vec3 OctDecode(vec2 encoded) {
+  vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+  float fold = max(-normal.z, 0.0);
+  normal.xy += mix(vec2(fold), vec2(-fold), greaterThanEqual(normal.xy, vec2(0.0)));
+  return normalize(normal);
+}
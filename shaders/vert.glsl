@@ -1,12 +1,29 @@
 #version 440
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
 
+// HAS_COLOR / HAS_NORMAL are defined by the engine when the mesh's vertex layout carries them.
+// positions may be quantized to [-1, 1] inside the mesh bounds, mesh.position_* expands them.
+// GPU_DRIVEN draws come from the cull shader, the object transform is looked up by instance index.
+// INSTANCED draws get their transform from a per instance stream
 layout(location = 0) in vec3 in_position;
+#ifdef HAS_COLOR
 layout(location = 1) in vec3 in_color;
+#endif
 layout(location = 2) in vec2 in_tex_coord;
+#ifdef HAS_NORMAL
+layout(location = 3) in vec2 in_normal;
+#endif
+#ifdef INSTANCED
+// locations 4 to 7, InstanceData in vulkan_headers.h
+layout(location = 4) in mat4 in_instance_transform;
+#endif
 
 layout(location = 0) out vec3 frag_color;
 layout(location = 1) out vec2 frag_tex_coord;
+#ifdef HAS_NORMAL
+layout(location = 2) out vec3 frag_normal;
+#endif
 
 layout(binding = 0) uniform UniformBufferObject {
   mat4 model;
@@ -14,8 +31,41 @@ layout(binding = 0) uniform UniformBufferObject {
   mat4 proj;
 } ubo;
 
+#ifdef GPU_DRIVEN
+#include "gpu_object.glsl"
+
+layout(std430, binding = 2) readonly buffer Objects {
+  GpuObject objects[];
+};
+#endif
+
+layout(push_constant) uniform MeshConstants {
+  vec4 position_scale;
+  vec4 position_offset;
+} mesh;
+
+#ifdef HAS_NORMAL
+#include "octahedral.glsl"
+#endif
+
 void main() {
-  gl_Position = ubo.proj * ubo.view * ubo.model * vec4(in_position, 1.0); 
+#if defined(GPU_DRIVEN)
+  mat4 model = ubo.model * objects[gl_InstanceIndex].transform;
+#elif defined(INSTANCED)
+  mat4 model = ubo.model * in_instance_transform;
+#else
+  mat4 model = ubo.model;
+#endif
+
+  vec3 position = in_position * mesh.position_scale.xyz + mesh.position_offset.xyz;
+  gl_Position = ubo.proj * ubo.view * model * vec4(position, 1.0); 
+#ifdef HAS_COLOR
   frag_color = in_color; 
+#else
+  frag_color = vec3(1.0);
+#endif
   frag_tex_coord = in_tex_coord;
+#ifdef HAS_NORMAL
+  frag_normal = mat3(model) * OctDecode(in_normal);
+#endif
 }
@@ -3,9 +3,108 @@
 #include "tiny_obj_loader.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
 
-int main() {
-  VulkanEngine app;
+int main(int argc, char** argv) {
+  EngineOptions options;
+
+  for (int ii = 1; ii < argc; ii++) {
+    std::string arg = argv[ii];
+    if (arg == "--bench-recording") {
+      options.bench_recording = true;
+    }
+    else if (arg == "--bench-jobs") {
+      options.bench_jobs = true;
+    }
+    else if (arg == "--test-jobs") {
+      options.test_jobs = true;
+    }
+    else if (arg == "--full-vertices") {
+      options.full_precision_vertices = true;
+    }
+    else if (arg == "--model" && ii + 1 < argc) {
+      options.model_path = argv[++ii];
+    }
+    else if (arg == "--bench-model-load" && ii + 1 < argc) {
+      options.bench_model_meshes = std::stoul(argv[++ii]);
+    }
+    else if (arg == "--no-bake") {
+      options.bake_meshes = false;
+    }
+    else if (arg == "--bench-mesh-load") {
+      options.bench_mesh_load = true;
+    }
+    else if (arg == "--no-cache") {
+      options.use_asset_cache = false;
+    }
+    else if (arg == "--cache-dir" && ii + 1 < argc) {
+      options.cache_directory = argv[++ii];
+    }
+    else if (arg == "--prewarm-cache") {
+      options.prewarm_cache = true;
+    }
+    else if (arg == "--bench-draws" && ii + 1 < argc) {
+      options.bench_draw_count = std::stoul(argv[++ii]);
+    }
+    else if (arg == "--precompiled-shaders") {
+      options.precompiled_shaders = true;
+    }
+    else if (arg == "--bench-shaders") {
+      options.bench_shaders = true;
+    }
+    else if (arg == "--bench-resize" && ii + 1 < argc) {
+      options.bench_resize_count = static_cast<uint32_t>(std::stoul(argv[++ii]));
+    }
+    else if (arg == "--headless" && ii + 1 < argc) {
+      options.headless = true;
+      options.headless_frames = static_cast<uint32_t>(std::stoul(argv[++ii]));
+    }
+    else if (arg == "--headless-output" && ii + 1 < argc) {
+      options.headless_output = argv[++ii];
+    }
+    else if (arg == "--gpu-trace" && ii + 1 < argc) {
+      options.gpu_trace_path = argv[++ii];
+    }
+    else if (arg == "--cpu-trace" && ii + 1 < argc) {
+      options.cpu_trace_path = argv[++ii];
+    }
+    else if (arg == "--no-culling") {
+      options.frustum_culling = false;
+    }
+    else if (arg == "--bench-culling") {
+      options.bench_culling = true;
+    }
+    else if (arg == "--bench-transforms") {
+      options.bench_transforms = true;
+    }
+    else if (arg == "--gpu-driven") {
+      options.gpu_driven = true;
+    }
+    else if (arg == "--no-sync2") {
+      options.sync2 = false;
+    }
+    else if (arg == "--no-instancing") {
+      options.instancing = false;
+    }
+    else if (arg == "--cpu-mips") {
+      options.gpu_mips = false;
+    }
+    else if (arg == "--kaiser-mips") {
+      options.mip_filter = MipFilter::KAISER;
+    }
+    else if (arg == "--bench-mips") {
+      options.bench_mips = true;
+    }
+    else if (arg == "--bench-allocator") {
+      options.bench_allocator = true;
+    }
+    else if (arg == "--scatter" && ii + 1 < argc) {
+      options.scatter_count = static_cast<uint32_t>(std::stoul(argv[++ii]));
+    }
+  }
+
+  VulkanEngine app(options);
 
   try {
     app.run();
@@ -0,0 +1,221 @@
+#include "asset_cache.h"
+#include "hash.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+AssetCache::AssetCache()
+{
+}
+
+bool AssetCache::Init(const std::string& directory, uint64_t max_size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  directory_ = directory;
+  max_size_ = max_size;
+  entries_.clear();
+  total_size_ = 0;
+
+  std::error_code error;
+  std::filesystem::create_directories(directory_, error);
+  if (error) {
+    enabled_ = false;
+    return false;
+  }
+
+  // another process may be evicting from the same directory, a file that is gone by the time it is
+  // looked at is skipped rather than thrown over
+  std::filesystem::directory_iterator end;
+  for (std::filesystem::directory_iterator it(directory_, error); !error && it != end; it.increment(error)) {
+    const auto& file = *it;
+    std::error_code file_error;
+    if (!file.is_regular_file(file_error)) {
+      continue;
+    }
+
+    // leftovers of a store that never finished
+    if (file.path().extension() == ".tmp") {
+      std::filesystem::remove(file.path(), file_error);
+      continue;
+    }
+
+    Entry entry;
+    entry.size = file.file_size(file_error);
+    if (file_error) {
+      continue;
+    }
+    entry.last_used = file.last_write_time(file_error);
+    if (file_error) {
+      continue;
+    }
+    entries_[file.path().filename().string()] = entry;
+    total_size_ += entry.size;
+  }
+
+  enabled_ = true;
+  EvictLocked();
+  return true;
+}
+
+std::string AssetCache::MakeKey(const std::string& kind, const std::string& source_path, const std::string& settings) const {
+  MappedFile source;
+  if (!source.Open(source_path)) {
+    return std::string();
+  }
+  return MakeKey(kind, source.Data(), source.Size(), settings);
+}
+
+std::string AssetCache::MakeKey(const std::string& kind, const void* data, size_t size, const std::string& settings) const {
+  uint64_t hash = Hash64(data, size);
+  hash = Hash64(settings, hash);
+  return kind + "-" + HashToString(hash);
+}
+
+bool AssetCache::Lookup(const std::string& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!enabled_ || key.empty()) {
+    return false;
+  }
+
+  auto entry = entries_.find(key);
+  if (entry == entries_.end()) {
+    stats_.misses++;
+    return false;
+  }
+
+  stats_.hits++;
+  entry->second.last_used = std::filesystem::file_time_type::clock::now();
+
+  // the write time is the only place last use survives between runs
+  std::error_code error;
+  std::filesystem::last_write_time(directory_ / key, entry->second.last_used, error);
+  if (error) {
+    // someone deleted it behind our back
+    total_size_ -= entry->second.size;
+    entries_.erase(entry);
+    stats_.hits--;
+    stats_.misses++;
+    return false;
+  }
+  return true;
+}
+
+std::string AssetCache::GetPath(const std::string& key) const {
+  return (directory_ / key).string();
+}
+
+void AssetCache::Insert(const std::string& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!enabled_ || key.empty()) {
+    return;
+  }
+
+  std::error_code error;
+  uint64_t size = std::filesystem::file_size(directory_ / key, error);
+  if (error) {
+    return;
+  }
+
+  auto existing = entries_.find(key);
+  if (existing != entries_.end()) {
+    total_size_ -= existing->second.size;
+  }
+
+  Entry& entry = entries_[key];
+  entry.size = size;
+  entry.last_used = std::filesystem::file_time_type::clock::now();
+  total_size_ += size;
+  stats_.stores++;
+
+  EvictLocked();
+}
+
+bool AssetCache::Store(const std::string& key, const void* data, size_t size) {
+  if (!IsEnabled() || key.empty()) {
+    return false;
+  }
+
+  // unique per thread so two workers producing the same key don't write the same temp file
+  std::string path = GetPath(key);
+  std::string temp_path = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    if (!file) {
+      file.close();
+      std::remove(temp_path.c_str());
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temp_path, path, error);
+  if (error) {
+    std::remove(temp_path.c_str());
+    return false;
+  }
+
+  Insert(key);
+  return true;
+}
+
+bool AssetCache::Load(const std::string& key, std::vector<uint8_t>& data) {
+  if (!Lookup(key)) {
+    return false;
+  }
+
+  std::ifstream file(GetPath(key), std::ios::binary | std::ios::ate);
+  if (!file) {
+    return false;
+  }
+
+  data.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+  return static_cast<bool>(file);
+}
+
+AssetCacheStats AssetCache::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  AssetCacheStats stats = stats_;
+  stats.bytes = total_size_;
+  stats.entries = entries_.size();
+  return stats;
+}
+
+void AssetCache::PrintStats() const {
+  AssetCacheStats stats = GetStats();
+  std::cout << "asset cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.stores
+    << " stores, " << stats.evictions << " evictions, " << stats.entries << " entries using "
+    << stats.bytes / (1024 * 1024) << " MiB" << std::endl;
+}
+
+void AssetCache::EvictLocked() {
+  if (total_size_ <= max_size_) {
+    return;
+  }
+
+  std::vector<std::pair<std::filesystem::file_time_type, std::string>> by_age;
+  by_age.reserve(entries_.size());
+  for (const auto& entry : entries_) {
+    by_age.emplace_back(entry.second.last_used, entry.first);
+  }
+  std::sort(by_age.begin(), by_age.end());
+
+  for (const auto& oldest : by_age) {
+    if (total_size_ <= max_size_) {
+      break;
+    }
+
+    std::error_code error;
+    std::filesystem::remove(directory_ / oldest.second, error);
+
+    total_size_ -= entries_[oldest.second].size;
+    entries_.erase(oldest.second);
+    stats_.evictions++;
+  }
+}
@@ -0,0 +1,186 @@
+#include "baked_mesh.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+  const uint64_t SECTION_ALIGNMENT = 16;
+
+  uint64_t AlignSection(uint64_t offset) {
+    return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+  }
+
+  void WritePadding(std::ofstream& file, uint64_t& position, uint64_t target) {
+    static const char zeros[SECTION_ALIGNMENT] = {};
+    file.write(zeros, static_cast<std::streamsize>(target - position));
+    position = target;
+  }
+
+  void WriteSection(std::ofstream& file, uint64_t& position, uint64_t offset, const void* data, uint64_t size) {
+    WritePadding(file, position, offset);
+    file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    position += size;
+  }
+
+}
+
+BakedMesh::BakedMesh()
+{
+}
+
+bool BakedMesh::GetSourceStamp(const std::string& source_path, uint64_t& size, int64_t& time) {
+  std::error_code error;
+  size = std::filesystem::file_size(source_path, error);
+  if (error) {
+    return false;
+  }
+
+  auto write_time = std::filesystem::last_write_time(source_path, error);
+  if (error) {
+    return false;
+  }
+
+  time = static_cast<int64_t>(write_time.time_since_epoch().count());
+  return true;
+}
+
+bool BakedMesh::Write(const std::string& path, const std::string& source_path, const QuantizedMesh& vertices,
+  const std::vector<uint32_t>& indices, const std::vector<Mesh>& meshes, const std::vector<MeshInstance>& instances) {
+  BakedMeshHeader header{};
+  header.magic = MAGIC;
+  header.version = VERSION;
+
+  if (!GetSourceStamp(source_path, header.source_size, header.source_time)) {
+    return false;
+  }
+
+  header.position_format = static_cast<uint32_t>(vertices.layout.position);
+  header.color_format = static_cast<uint32_t>(vertices.layout.color);
+  header.tex_coord_format = static_cast<uint32_t>(vertices.layout.tex_coord);
+  header.normal_format = static_cast<uint32_t>(vertices.layout.normal);
+  header.vertex_stride = vertices.layout.Stride();
+
+  header.vertex_count = vertices.vertex_count;
+  header.index_count = static_cast<uint32_t>(indices.size());
+  header.mesh_count = static_cast<uint32_t>(meshes.size());
+  header.instance_count = static_cast<uint32_t>(instances.size());
+
+  // quantized positions span [-1, 1] around the offset
+  for (int ii = 0; ii < 3; ii++) {
+    header.bounds_min[ii] = vertices.constants.position_offset[ii] - vertices.constants.position_scale[ii];
+    header.bounds_max[ii] = vertices.constants.position_offset[ii] + vertices.constants.position_scale[ii];
+  }
+  header.constants = vertices.constants;
+
+  header.mesh_offset = AlignSection(sizeof(BakedMeshHeader));
+  header.instance_offset = AlignSection(header.mesh_offset + sizeof(Mesh) * meshes.size());
+  header.vertex_offset = AlignSection(header.instance_offset + sizeof(MeshInstance) * instances.size());
+  header.index_offset = AlignSection(header.vertex_offset + vertices.data.size());
+
+  std::string temp_path = path + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      return false;
+    }
+
+    uint64_t position = 0;
+    WriteSection(file, position, 0, &header, sizeof(header));
+    WriteSection(file, position, header.mesh_offset, meshes.data(), sizeof(Mesh) * meshes.size());
+    WriteSection(file, position, header.instance_offset, instances.data(), sizeof(MeshInstance) * instances.size());
+    WriteSection(file, position, header.vertex_offset, vertices.data.data(), vertices.data.size());
+    WriteSection(file, position, header.index_offset, indices.data(), sizeof(uint32_t) * indices.size());
+
+    if (!file) {
+      file.close();
+      std::remove(temp_path.c_str());
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temp_path, path, error);
+  if (error) {
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool BakedMesh::Open(const std::string& path) {
+  Close();
+
+  if (!file_.Open(path) || file_.Size() < sizeof(BakedMeshHeader)) {
+    Close();
+    return false;
+  }
+
+  header_ = reinterpret_cast<const BakedMeshHeader*>(file_.Data());
+  uint64_t size = file_.Size();
+
+  bool valid = header_->magic == MAGIC && header_->version == VERSION &&
+    header_->mesh_offset + sizeof(Mesh) * header_->mesh_count <= size &&
+    header_->instance_offset + sizeof(MeshInstance) * header_->instance_count <= size &&
+    header_->vertex_offset + static_cast<uint64_t>(header_->vertex_stride) * header_->vertex_count <= size &&
+    header_->index_offset + sizeof(uint32_t) * static_cast<uint64_t>(header_->index_count) <= size &&
+    header_->vertex_stride == GetLayout().Stride();
+
+  // draws index straight into the blobs, so every table entry has to stay inside them
+  for (uint32_t ii = 0; valid && ii < header_->mesh_count; ii++) {
+    Mesh mesh;
+    memcpy(&mesh, file_.Data() + header_->mesh_offset + sizeof(Mesh) * ii, sizeof(Mesh));
+    valid = static_cast<uint64_t>(mesh.first_index) + mesh.index_count <= header_->index_count &&
+      mesh.vertex_offset >= 0 && static_cast<uint64_t>(mesh.vertex_offset) + mesh.vertex_count <= header_->vertex_count;
+  }
+  for (uint32_t ii = 0; valid && ii < header_->instance_count; ii++) {
+    uint32_t mesh;
+    memcpy(&mesh, file_.Data() + header_->instance_offset + sizeof(MeshInstance) * ii + offsetof(MeshInstance, mesh),
+      sizeof(mesh));
+    valid = mesh < header_->mesh_count;
+  }
+
+  if (!valid) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void BakedMesh::Close() {
+  file_.Close();
+  header_ = nullptr;
+}
+
+bool BakedMesh::IsUpToDate(const std::string& source_path) const {
+  uint64_t size;
+  int64_t time;
+  if (!GetSourceStamp(source_path, size, time)) {
+    // nothing to compare against, the bake is all there is
+    return true;
+  }
+  return size == header_->source_size && time == header_->source_time;
+}
+
+VertexLayout BakedMesh::GetLayout() const {
+  VertexLayout layout;
+  layout.position = static_cast<PositionFormat>(header_->position_format);
+  layout.color = static_cast<ColorFormat>(header_->color_format);
+  layout.tex_coord = static_cast<TexCoordFormat>(header_->tex_coord_format);
+  layout.normal = static_cast<NormalFormat>(header_->normal_format);
+  return layout;
+}
+
+std::vector<Mesh> BakedMesh::GetMeshes() const {
+  std::vector<Mesh> meshes(header_->mesh_count);
+  memcpy(meshes.data(), file_.Data() + header_->mesh_offset, sizeof(Mesh) * meshes.size());
+  return meshes;
+}
+
+std::vector<MeshInstance> BakedMesh::GetInstances() const {
+  std::vector<MeshInstance> instances(header_->instance_count);
+  memcpy(instances.data(), file_.Data() + header_->instance_offset, sizeof(MeshInstance) * instances.size());
+  return instances;
+}
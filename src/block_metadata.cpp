@@ -0,0 +1,95 @@
+#include "block_metadata.h"
+#include <iterator>
+#include <stdexcept>
+
+BlockMetadata::BlockMetadata(uint64_t size) : size_(size) {
+  InsertFreeRange(0, size);
+}
+
+bool BlockMetadata::Allocate(uint64_t size, uint64_t alignment, uint64_t& offset) {
+  if (size == 0) {
+    return false;
+  }
+
+  // ranges are visited smallest first, the first one that still fits after
+  // alignment padding is the best fit
+  for (auto it = free_by_size_.lower_bound(size); it != free_by_size_.end(); ++it) {
+    uint64_t range_offset = it->second;
+    uint64_t range_size = it->first;
+    uint64_t aligned_offset = AlignUp(range_offset, alignment);
+    uint64_t padding = aligned_offset - range_offset;
+
+    if (padding + size > range_size) {
+      continue;
+    }
+
+    EraseFreeRange(free_by_offset_.find(range_offset));
+
+    // the padding in front stays free, it can still hold a less aligned request
+    if (padding > 0) {
+      InsertFreeRange(range_offset, padding);
+    }
+
+    uint64_t tail = range_size - padding - size;
+    if (tail > 0) {
+      InsertFreeRange(aligned_offset + size, tail);
+    }
+
+    used_ += size;
+    offset = aligned_offset;
+    return true;
+  }
+
+  return false;
+}
+
+void BlockMetadata::Free(uint64_t offset, uint64_t size) {
+  if (offset + size > size_ || size > used_) {
+    throw std::invalid_argument("freed range is outside of the block");
+  }
+
+  used_ -= size;
+
+  // merge with the range right after the freed one
+  auto next = free_by_offset_.lower_bound(offset);
+  if (next != free_by_offset_.end() && next->first == offset + size) {
+    size += next->second;
+    next = std::next(next);
+    EraseFreeRange(std::prev(next));
+  }
+
+  // merge with the range right before the freed one
+  if (next != free_by_offset_.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      offset = prev->first;
+      size += prev->second;
+      EraseFreeRange(prev);
+    }
+  }
+
+  InsertFreeRange(offset, size);
+}
+
+uint64_t BlockMetadata::LargestFreeRange() const {
+  if (free_by_size_.empty()) {
+    return 0;
+  }
+  return free_by_size_.rbegin()->first;
+}
+
+void BlockMetadata::InsertFreeRange(uint64_t offset, uint64_t size) {
+  free_by_offset_.emplace(offset, size);
+  free_by_size_.emplace(size, offset);
+}
+
+void BlockMetadata::EraseFreeRange(std::map<uint64_t, uint64_t>::iterator it) {
+  auto range = free_by_size_.equal_range(it->second);
+  for (auto size_it = range.first; size_it != range.second; ++size_it) {
+    if (size_it->second == it->first) {
+      free_by_size_.erase(size_it);
+      break;
+    }
+  }
+  free_by_offset_.erase(it);
+}
@@ -0,0 +1,114 @@
+#include "command_recorder.h"
+#include <stdexcept>
+
+CommandRecorder::CommandRecorder()
+{
+}
+
+CommandRecorder::~CommandRecorder() {
+  Destroy();
+}
+
+void CommandRecorder::Init(const InitData& init, JobSystem& jobs, uint32_t queue_family, uint32_t frame_count) {
+  device_ = init.device;
+  jobs_ = &jobs;
+
+  workers_.resize(jobs.ThreadCount());
+  for (auto& worker : workers_) {
+    worker.frames.resize(frame_count);
+
+    for (auto& frame : worker.frames) {
+      VkCommandPoolCreateInfo pool_info{};
+      pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+      pool_info.queueFamilyIndex = queue_family;
+      // reset as a whole every frame, never per buffer
+      pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+      if (vkCreateCommandPool(device_, &pool_info, nullptr, &frame.pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create worker command pool!");
+      }
+    }
+  }
+}
+
+void CommandRecorder::Destroy() {
+  for (auto& worker : workers_) {
+    for (auto& frame : worker.frames) {
+      vkDestroyCommandPool(device_, frame.pool, nullptr);
+    }
+  }
+  workers_.clear();
+}
+
+void CommandRecorder::BeginFrame(uint32_t frame) {
+  for (auto& worker : workers_) {
+    vkResetCommandPool(device_, worker.frames[frame].pool, 0);
+    worker.frames[frame].used = 0;
+  }
+}
+
+const std::vector<VkCommandBuffer>& CommandRecorder::Record(uint32_t frame, const VkCommandBufferInheritanceInfo& inheritance,
+  size_t item_count, const RecordFunc& record) {
+  size_t chunk_count = workers_.size();
+  results_.assign(chunk_count, VK_NULL_HANDLE);
+
+  JobCounter counter;
+  for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+    size_t begin = item_count * chunk / chunk_count;
+    size_t end = item_count * (chunk + 1) / chunk_count;
+    if (begin == end) {
+      continue;
+    }
+
+    jobs_->Run([this, frame, &inheritance, &record, chunk, begin, end] {
+      VkCommandBuffer command_buffer = AcquireBuffer(frame);
+
+      VkCommandBufferBeginInfo begin_info{};
+      begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+      begin_info.pInheritanceInfo = &inheritance;
+
+      if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording secondary command buffer");
+      }
+
+      record(command_buffer, begin, end);
+
+      if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record secondary command buffer");
+      }
+
+      results_[chunk] = command_buffer;
+    }, &counter);
+  }
+  jobs_->Wait(counter);
+
+  size_t count = 0;
+  for (auto command_buffer : results_) {
+    if (command_buffer != VK_NULL_HANDLE) {
+      results_[count++] = command_buffer;
+    }
+  }
+  results_.resize(count);
+  return results_;
+}
+
+VkCommandBuffer CommandRecorder::AcquireBuffer(uint32_t frame) {
+  FramePool& frame_pool = workers_[JobSystem::WorkerIndex()].frames[frame];
+
+  if (frame_pool.used == frame_pool.buffers.size()) {
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = frame_pool.pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    alloc_info.commandBufferCount = 1;
+
+    VkCommandBuffer command_buffer;
+    if (vkAllocateCommandBuffers(device_, &alloc_info, &command_buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate secondary command buffer");
+    }
+    frame_pool.buffers.push_back(command_buffer);
+  }
+
+  return frame_pool.buffers[frame_pool.used++];
+}
@@ -0,0 +1,250 @@
+#include "cpu_profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
+namespace {
+  std::mutex rings_mutex;
+
+  // only the main loop's thread marks frames, the mutex is for readers
+  std::mutex frame_mutex;
+  std::vector<float> frame_times;
+  uint64_t frame_count = 0;
+  uint64_t last_frame_ns = 0;
+
+  float Percentile(const std::vector<float>& sorted, float percentile) {
+    size_t index = static_cast<size_t>(percentile * (sorted.size() - 1) + 0.5f);
+    return sorted[std::min(index, sorted.size() - 1)];
+  }
+}
+
+void WriteJsonEscaped(std::ostream& out, const std::string& value) {
+  const char* hex = "0123456789abcdef";
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    }
+    else if (static_cast<unsigned char>(c) < 0x20) {
+      out << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+    }
+    else {
+      out << c;
+    }
+  }
+}
+
+uint64_t CpuProfiler::Now() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+std::vector<std::unique_ptr<CpuProfiler::ThreadRing>>& CpuProfiler::Rings() {
+  // rings are owned here rather than by their thread, so a worker's events stay readable after it exits
+  static std::vector<std::unique_ptr<ThreadRing>> rings;
+  return rings;
+}
+
+std::vector<CpuProfiler::ThreadRing*>& CpuProfiler::FreeRings() {
+  static std::vector<ThreadRing*> free_rings;
+  return free_rings;
+}
+
+CpuProfiler::ThreadRing& CpuProfiler::LocalRing() {
+  // hands the ring back when the thread exits. the next new thread carries on writing into it, so a job
+  // system that is torn down and started again reuses its workers' rings instead of adding new ones
+  struct Owner {
+    ThreadRing* ring = nullptr;
+    ~Owner() {
+      if (ring) {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        FreeRings().push_back(ring);
+      }
+    }
+  };
+  thread_local Owner owner;
+
+  if (!owner.ring) {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    if (!FreeRings().empty()) {
+      owner.ring = FreeRings().back();
+      FreeRings().pop_back();
+    }
+    else {
+      auto created = std::make_unique<ThreadRing>();
+      created->events = std::make_unique<EventSlot[]>(RING_SIZE);
+      created->index = static_cast<uint32_t>(Rings().size());
+      owner.ring = created.get();
+      Rings().push_back(std::move(created));
+    }
+    owner.ring->name = "thread " + std::to_string(owner.ring->index);
+  }
+  return *owner.ring;
+}
+
+void CpuProfiler::Record(const char* name, uint64_t start_ns, uint64_t end_ns) {
+  ThreadRing& ring = LocalRing();
+  uint64_t head = ring.head.load(std::memory_order_relaxed);
+  EventSlot& slot = ring.events[head % RING_SIZE];
+  // release, so a reader that sees any of these stores also sees head and knows which event was being replaced.
+  // plain stores on x86
+  slot.name.store(name, std::memory_order_release);
+  slot.start_ns.store(start_ns, std::memory_order_release);
+  slot.end_ns.store(end_ns, std::memory_order_release);
+  // publishes the event to readers
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+void CpuProfiler::SetThreadName(const std::string& name) {
+  ThreadRing& ring = LocalRing();
+  std::lock_guard<std::mutex> lock(rings_mutex);
+  ring.name = name;
+}
+
+void CpuProfiler::FrameMark() {
+  uint64_t now = Now();
+
+  std::lock_guard<std::mutex> lock(frame_mutex);
+  if (last_frame_ns != 0) {
+    float ms = (now - last_frame_ns) / 1e6f;
+    if (frame_times.size() < MAX_FRAMES) {
+      frame_times.push_back(ms);
+    }
+    else {
+      frame_times[frame_count % MAX_FRAMES] = ms;
+    }
+    frame_count++;
+  }
+  last_frame_ns = now;
+
+  Record("frame", now, now);
+}
+
+CpuFrameStats CpuProfiler::GetFrameStats() {
+  std::vector<float> sorted;
+  {
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    sorted = frame_times;
+  }
+
+  CpuFrameStats stats{};
+  if (sorted.empty()) {
+    return stats;
+  }
+  std::sort(sorted.begin(), sorted.end());
+
+  float total = 0.0f;
+  for (float ms : sorted) {
+    total += ms;
+  }
+
+  stats.frames = static_cast<uint32_t>(sorted.size());
+  stats.average_ms = total / sorted.size();
+  stats.p50_ms = Percentile(sorted, 0.50f);
+  stats.p95_ms = Percentile(sorted, 0.95f);
+  stats.p99_ms = Percentile(sorted, 0.99f);
+  stats.max_ms = sorted.back();
+  return stats;
+}
+
+void CpuProfiler::PrintFrameStats() {
+  CpuFrameStats stats = GetFrameStats();
+  if (stats.frames == 0) {
+    return;
+  }
+
+  std::cout << "cpu frame time over " << stats.frames << " frames: " << stats.average_ms << " ms average, p50 "
+    << stats.p50_ms << ", p95 " << stats.p95_ms << ", p99 " << stats.p99_ms << ", max " << stats.max_ms << std::endl;
+
+  // buckets at the usual refresh intervals, 144 / 120 / 60 / 30 Hz
+  const float bounds[] = { 6.94f, 8.33f, 16.67f, 33.33f };
+  const char* labels[] = { "< 6.9 ms", "< 8.3 ms", "< 16.7 ms", "< 33.3 ms", ">= 33.3 ms" };
+  uint32_t counts[5] = {};
+
+  {
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    for (float ms : frame_times) {
+      size_t bucket = 0;
+      while (bucket < 4 && ms >= bounds[bucket]) {
+        bucket++;
+      }
+      counts[bucket]++;
+    }
+  }
+
+  for (size_t ii = 0; ii < 5; ii++) {
+    uint32_t width = static_cast<uint32_t>(50.0f * counts[ii] / stats.frames + 0.5f);
+    std::cout << "  " << labels[ii] << "\t" << std::string(width, '#') << " " << counts[ii] << std::endl;
+  }
+}
+
+bool CpuProfiler::WriteChromeTrace(const std::string& path) {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    return false;
+  }
+
+  uint64_t origin = ~0ull;
+  struct Track {
+    std::string name;
+    uint32_t index;
+    std::vector<CpuEvent> events;
+  };
+  std::vector<Track> tracks;
+
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    for (const auto& ring : Rings()) {
+      Track track{ ring->name, ring->index, {} };
+
+      uint64_t head = ring->head.load(std::memory_order_acquire);
+      uint64_t first = head - std::min<uint64_t>(head, RING_SIZE);
+      for (uint64_t ii = first; ii < head; ii++) {
+        const EventSlot& slot = ring->events[ii % RING_SIZE];
+        track.events.push_back({ slot.name.load(std::memory_order_acquire), slot.start_ns.load(std::memory_order_acquire),
+          slot.end_ns.load(std::memory_order_acquire) });
+      }
+
+      // a thread still recording may have rewritten slots while they were copied. event latest is the newest
+      // one that can have started, it replaces latest - RING_SIZE, so everything up to that one is suspect
+      uint64_t latest = ring->head.load(std::memory_order_relaxed);
+      uint64_t valid = latest >= RING_SIZE ? latest - RING_SIZE + 1 : 0;
+      if (valid > first) {
+        track.events.erase(track.events.begin(), track.events.begin() + std::min(valid - first, head - first));
+      }
+
+      for (const auto& event : track.events) {
+        origin = std::min(origin, event.start_ns);
+      }
+      tracks.push_back(std::move(track));
+    }
+  }
+
+  file << "{\"traceEvents\":[\n";
+  bool first = true;
+  for (const auto& track : tracks) {
+    file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << track.index
+      << ",\"args\":{\"name\":\"";
+    WriteJsonEscaped(file, track.name);
+    file << "\"}}";
+    first = false;
+
+    for (const auto& event : track.events) {
+      // zero length events are frame markers
+      bool instant = event.start_ns == event.end_ns;
+      file << ",\n{\"name\":\"";
+      WriteJsonEscaped(file, event.name);
+      file << "\",\"cat\":\"cpu\",\"ph\":\"" << (instant ? "i" : "X") << "\",\"pid\":0,\"tid\":" << track.index
+        << ",\"ts\":" << std::fixed << (event.start_ns - origin) / 1e3;
+      if (instant) {
+        file << ",\"s\":\"t\"}";
+      }
+      else {
+        file << ",\"dur\":" << (event.end_ns - event.start_ns) / 1e3 << "}";
+      }
+    }
+  }
+  file << "\n]}\n";
+  return static_cast<bool>(file);
+}
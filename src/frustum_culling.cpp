@@ -0,0 +1,282 @@
+#include "frustum_culling.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CULL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC emits AVX intrinsics without a per function opt in
+#define CULL_TARGET_AVX
+#else
+#define CULL_TARGET_AVX __attribute__((target("avx")))
+#endif
+#endif
+
+namespace {
+  // objects per job, a multiple of 8 so only the last chunk has a scalar tail
+  const size_t CULL_GRAIN = 16 * 1024;
+
+  struct CullPlanes {
+    float nx[6], ny[6], nz[6], w[6];
+    // absolute normals, projecting the half extents onto them gives the box's radius along the plane
+    float ax[6], ay[6], az[6];
+  };
+
+  CullPlanes PreparePlanes(const Frustum& frustum) {
+    CullPlanes planes;
+    for (int ii = 0; ii < 6; ii++) {
+      const glm::vec4& plane = frustum.planes[ii];
+      planes.nx[ii] = plane.x;
+      planes.ny[ii] = plane.y;
+      planes.nz[ii] = plane.z;
+      planes.w[ii] = plane.w;
+      planes.ax[ii] = std::fabs(plane.x);
+      planes.ay[ii] = std::fabs(plane.y);
+      planes.az[ii] = std::fabs(plane.z);
+    }
+    return planes;
+  }
+
+  size_t CullScalar(const CullPlanes& planes, const BoundsTable& bounds, size_t begin, size_t end, uint8_t* visible) {
+    const float* cx = bounds.CenterX();
+    const float* cy = bounds.CenterY();
+    const float* cz = bounds.CenterZ();
+    const float* ex = bounds.ExtentX();
+    const float* ey = bounds.ExtentY();
+    const float* ez = bounds.ExtentZ();
+
+    size_t count = 0;
+    for (size_t ii = begin; ii < end; ii++) {
+      bool inside = true;
+      for (int plane = 0; plane < 6 && inside; plane++) {
+        float distance = planes.nx[plane] * cx[ii] + planes.ny[plane] * cy[ii] + planes.nz[plane] * cz[ii] + planes.w[plane];
+        float radius = planes.ax[plane] * ex[ii] + planes.ay[plane] * ey[ii] + planes.az[plane] * ez[ii];
+        inside = distance + radius >= 0.0f;
+      }
+      visible[ii] = inside ? 1 : 0;
+      count += inside ? 1 : 0;
+    }
+    return count;
+  }
+
+#ifdef CULL_X86
+  // every object tests all six planes, branching out early costs more than it saves at this width
+  size_t CullSse(const CullPlanes& planes, const BoundsTable& bounds, size_t begin, size_t end, uint8_t* visible) {
+    const float* cx = bounds.CenterX();
+    const float* cy = bounds.CenterY();
+    const float* cz = bounds.CenterZ();
+    const float* ex = bounds.ExtentX();
+    const float* ey = bounds.ExtentY();
+    const float* ez = bounds.ExtentZ();
+
+    __m128 zero = _mm_setzero_ps();
+    size_t count = 0;
+    size_t ii = begin;
+    for (; ii + 4 <= end; ii += 4) {
+      __m128 x = _mm_loadu_ps(cx + ii);
+      __m128 y = _mm_loadu_ps(cy + ii);
+      __m128 z = _mm_loadu_ps(cz + ii);
+      __m128 hx = _mm_loadu_ps(ex + ii);
+      __m128 hy = _mm_loadu_ps(ey + ii);
+      __m128 hz = _mm_loadu_ps(ez + ii);
+
+      __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+      for (int plane = 0; plane < 6; plane++) {
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(planes.nx[plane])),
+          _mm_mul_ps(y, _mm_set1_ps(planes.ny[plane]))),
+          _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(planes.nz[plane])), _mm_set1_ps(planes.w[plane])));
+        __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(hx, _mm_set1_ps(planes.ax[plane])),
+          _mm_mul_ps(hy, _mm_set1_ps(planes.ay[plane]))), _mm_mul_ps(hz, _mm_set1_ps(planes.az[plane])));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+      }
+
+      int mask = _mm_movemask_ps(inside);
+      for (int lane = 0; lane < 4; lane++) {
+        uint8_t bit = static_cast<uint8_t>((mask >> lane) & 1);
+        visible[ii + lane] = bit;
+        count += bit;
+      }
+    }
+    return count + CullScalar(planes, bounds, ii, end, visible);
+  }
+
+  CULL_TARGET_AVX
+  size_t CullAvx(const CullPlanes& planes, const BoundsTable& bounds, size_t begin, size_t end, uint8_t* visible) {
+    const float* cx = bounds.CenterX();
+    const float* cy = bounds.CenterY();
+    const float* cz = bounds.CenterZ();
+    const float* ex = bounds.ExtentX();
+    const float* ey = bounds.ExtentY();
+    const float* ez = bounds.ExtentZ();
+
+    __m256 zero = _mm256_setzero_ps();
+    size_t count = 0;
+    size_t ii = begin;
+    for (; ii + 8 <= end; ii += 8) {
+      __m256 x = _mm256_loadu_ps(cx + ii);
+      __m256 y = _mm256_loadu_ps(cy + ii);
+      __m256 z = _mm256_loadu_ps(cz + ii);
+      __m256 hx = _mm256_loadu_ps(ex + ii);
+      __m256 hy = _mm256_loadu_ps(ey + ii);
+      __m256 hz = _mm256_loadu_ps(ez + ii);
+
+      __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+      for (int plane = 0; plane < 6; plane++) {
+        __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(planes.nx[plane])),
+          _mm256_mul_ps(y, _mm256_set1_ps(planes.ny[plane]))),
+          _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(planes.nz[plane])), _mm256_set1_ps(planes.w[plane])));
+        __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(hx, _mm256_set1_ps(planes.ax[plane])),
+          _mm256_mul_ps(hy, _mm256_set1_ps(planes.ay[plane]))), _mm256_mul_ps(hz, _mm256_set1_ps(planes.az[plane])));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_GE_OQ));
+      }
+
+      int mask = _mm256_movemask_ps(inside);
+      for (int lane = 0; lane < 8; lane++) {
+        uint8_t bit = static_cast<uint8_t>((mask >> lane) & 1);
+        visible[ii + lane] = bit;
+        count += bit;
+      }
+    }
+    return count + CullScalar(planes, bounds, ii, end, visible);
+  }
+#endif
+}
+
+Frustum ExtractFrustum(const glm::mat4& view_proj) {
+  // rows of the matrix, glm is column major
+  glm::vec4 row[4];
+  for (int ii = 0; ii < 4; ii++) {
+    row[ii] = glm::vec4(view_proj[0][ii], view_proj[1][ii], view_proj[2][ii], view_proj[3][ii]);
+  }
+
+  Frustum frustum;
+  frustum.planes[0] = row[3] + row[0];  // left
+  frustum.planes[1] = row[3] - row[0];  // right
+  frustum.planes[2] = row[3] + row[1];  // bottom
+  frustum.planes[3] = row[3] - row[1];  // top
+  frustum.planes[4] = row[2];           // near, z >= 0
+  frustum.planes[5] = row[3] - row[2];  // far
+
+  for (auto& plane : frustum.planes) {
+    float length = glm::length(glm::vec3(plane));
+    if (length > 0.0f) {
+      plane /= length;
+    }
+  }
+  return frustum;
+}
+
+BoundsTable::BoundsTable()
+{
+}
+
+void BoundsTable::Reserve(size_t count) {
+  for (auto* values : { &center_x_, &center_y_, &center_z_, &extent_x_, &extent_y_, &extent_z_ }) {
+    values->reserve(count);
+  }
+}
+
+void BoundsTable::Clear() {
+  for (auto* values : { &center_x_, &center_y_, &center_z_, &extent_x_, &extent_y_, &extent_z_ }) {
+    values->clear();
+  }
+}
+
+uint32_t BoundsTable::AddAabb(const glm::vec3& min, const glm::vec3& max) {
+  glm::vec3 center = (min + max) * 0.5f;
+  glm::vec3 extent = (max - min) * 0.5f;
+
+  center_x_.push_back(center.x);
+  center_y_.push_back(center.y);
+  center_z_.push_back(center.z);
+  extent_x_.push_back(extent.x);
+  extent_y_.push_back(extent.y);
+  extent_z_.push_back(extent.z);
+  return static_cast<uint32_t>(center_x_.size() - 1);
+}
+
+uint32_t BoundsTable::AddSphere(const glm::vec3& center, float radius) {
+  return AddAabb(center - glm::vec3(radius), center + glm::vec3(radius));
+}
+
+uint32_t BoundsTable::AddTransformedAabb(const glm::vec3& min, const glm::vec3& max, const glm::mat4& transform) {
+  glm::vec3 center = glm::vec3(transform * glm::vec4((min + max) * 0.5f, 1.0f));
+  glm::vec3 extent = (max - min) * 0.5f;
+
+  // each new half extent is the old ones projected through the absolute rotation / scale
+  glm::vec3 new_extent(0.0f);
+  for (int axis = 0; axis < 3; axis++) {
+    for (int column = 0; column < 3; column++) {
+      new_extent[axis] += std::fabs(transform[column][axis]) * extent[column];
+    }
+  }
+  return AddAabb(center - new_extent, center + new_extent);
+}
+
+CullIsa DetectCullIsa() {
+#ifdef CULL_X86
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  // the OS has to save the upper halves of the ymm registers as well
+  if (osxsave && avx && (_xgetbv(0) & 6) == 6) {
+    return CullIsa::AVX;
+  }
+  return CullIsa::SSE;
+#else
+  if (__builtin_cpu_supports("avx")) {
+    return CullIsa::AVX;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return CullIsa::SSE;
+  }
+#endif
+#endif
+  return CullIsa::SCALAR;
+}
+
+const char* GetCullIsaName(CullIsa isa) {
+  switch (isa) {
+  case CullIsa::SSE:
+    return "SSE";
+  case CullIsa::AVX:
+    return "AVX";
+  default:
+    return "scalar";
+  }
+}
+
+size_t CullRange(const Frustum& frustum, const BoundsTable& bounds, size_t begin, size_t end,
+  uint8_t* visible, CullIsa isa) {
+  CullPlanes planes = PreparePlanes(frustum);
+
+#ifdef CULL_X86
+  if (isa == CullIsa::AVX) {
+    return CullAvx(planes, bounds, begin, end, visible);
+  }
+  if (isa == CullIsa::SSE) {
+    return CullSse(planes, bounds, begin, end, visible);
+  }
+#endif
+  return CullScalar(planes, bounds, begin, end, visible);
+}
+
+size_t CullObjects(const Frustum& frustum, const BoundsTable& bounds, std::vector<uint8_t>& visible,
+  JobSystem* jobs, CullIsa isa) {
+  visible.resize(bounds.Size());
+
+  if (!jobs) {
+    return CullRange(frustum, bounds, 0, bounds.Size(), visible.data(), isa);
+  }
+
+  std::atomic<size_t> count{ 0 };
+  jobs->ParallelFor(bounds.Size(), CULL_GRAIN, [&](size_t begin, size_t end) {
+    count.fetch_add(CullRange(frustum, bounds, begin, end, visible.data(), isa), std::memory_order_relaxed);
+  });
+  return count.load();
+}
@@ -0,0 +1,262 @@
+#include "gpu_culling.h"
+#include <array>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+  // local_size_x in shaders/cull.glsl
+  const uint32_t CULL_GROUP_SIZE = 64;
+}
+
+GpuCuller::GpuCuller()
+{
+}
+
+void GpuCuller::Init(const InitData& init, const RenderData& render, PipelineManager& pipelines,
+  const std::vector<uint32_t>& cull_spirv, const std::vector<GpuObject>& objects,
+  uint32_t frame_count, const GpuCullFeatures& features) {
+  if (objects.empty()) {
+    throw std::runtime_error("gpu culling needs at least one object");
+  }
+
+  init_ = &init;
+  features_ = features;
+  object_count_ = static_cast<uint32_t>(objects.size());
+  stats_ = GpuCullStats{};
+  stats_.object_count = object_count_;
+
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(init.physical_device, &properties);
+  non_coherent_atom_size_ = properties.limits.nonCoherentAtomSize;
+
+  objects_ = StorageBuffer(init, render, objects.data(), GetObjectBufferSize());
+
+  frames_.resize(frame_count);
+  for (auto& frame : frames_) {
+    frame.draws = CreateBuffer(sizeof(VkDrawIndexedIndirectCommand) * object_count_,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MemoryUsage::GPU_ONLY, frame.draws_allocation);
+    frame.count = CreateBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GPU_ONLY, frame.count_allocation);
+    frame.readback = CreateBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GPU_TO_CPU,
+      frame.readback_allocation);
+  }
+
+  CreateDescriptors(frame_count);
+
+  ComputePipelineDesc desc;
+  desc.spirv = &cull_spirv;
+  desc.layout = pipeline_layout_;
+  pipeline_ = pipelines.GetComputePipeline(desc);
+}
+
+void GpuCuller::Destroy() {
+  if (!init_) {
+    return;
+  }
+
+  for (auto& frame : frames_) {
+    vkDestroyBuffer(init_->device, frame.draws, nullptr);
+    init_->allocator->Free(frame.draws_allocation);
+    vkDestroyBuffer(init_->device, frame.count, nullptr);
+    init_->allocator->Free(frame.count_allocation);
+    vkDestroyBuffer(init_->device, frame.readback, nullptr);
+    init_->allocator->Free(frame.readback_allocation);
+  }
+  frames_.clear();
+
+  vkDestroyDescriptorPool(init_->device, descriptor_pool_, nullptr);
+  vkDestroyPipelineLayout(init_->device, pipeline_layout_, nullptr);
+  vkDestroyDescriptorSetLayout(init_->device, descriptor_set_layout_, nullptr);
+  objects_.Destroy(*init_);
+  init_ = nullptr;
+}
+
+void GpuCuller::RecordCull(VkCommandBuffer command_buffer, uint32_t frame, const Frustum& frustum) {
+  Frame& current = frames_[frame];
+
+  vkCmdFillBuffer(command_buffer, current.count, 0, sizeof(uint32_t), 0);
+
+  // the clear has to land before the shader counts, and last frame's draws from this slot are
+  // covered by the fence the caller waited on
+  VkMemoryBarrier clear_barrier{};
+  clear_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  clear_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  clear_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    0, 1, &clear_barrier, 0, nullptr, 0, nullptr);
+
+  CullConstants constants{};
+  for (int ii = 0; ii < 6; ii++) {
+    constants.planes[ii] = frustum.planes[ii];
+  }
+  constants.object_count = object_count_;
+  constants.compact = features_.draw_indirect_count ? 1 : 0;
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_,
+    0, 1, &current.descriptor_set, 0, nullptr);
+  vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &constants);
+  vkCmdDispatch(command_buffer, (object_count_ + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+  // the count is copied out below, the indirect draw's side is up to the caller
+  VkMemoryBarrier cull_barrier{};
+  cull_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  cull_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  cull_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &cull_barrier, 0, nullptr, 0, nullptr);
+
+  VkBufferCopy region{};
+  region.size = sizeof(uint32_t);
+  vkCmdCopyBuffer(command_buffer, current.count, current.readback, 1, &region);
+
+  VkMemoryBarrier host_barrier{};
+  host_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+    0, 1, &host_barrier, 0, nullptr, 0, nullptr);
+
+  current.culled = true;
+}
+
+void GpuCuller::RecordDraws(VkCommandBuffer command_buffer, uint32_t frame) {
+  const Frame& current = frames_[frame];
+  const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+  if (features_.draw_indirect_count) {
+    features_.draw_indirect_count(command_buffer, current.draws, 0, current.count, 0, object_count_, stride);
+  }
+  else if (features_.multi_draw_indirect) {
+    vkCmdDrawIndexedIndirect(command_buffer, current.draws, 0, object_count_, stride);
+  }
+  else {
+    for (uint32_t ii = 0; ii < object_count_; ii++) {
+      vkCmdDrawIndexedIndirect(command_buffer, current.draws, static_cast<VkDeviceSize>(ii) * stride, 1, stride);
+    }
+  }
+}
+
+bool GpuCuller::Collect(uint32_t frame, uint32_t& visible) {
+  Frame& current = frames_[frame];
+  if (!current.culled) {
+    return false;
+  }
+
+  if (!(current.readback_allocation.property_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = current.readback_allocation.memory;
+    range.offset = current.readback_allocation.offset / non_coherent_atom_size_ * non_coherent_atom_size_;
+    range.size = VK_WHOLE_SIZE;
+    vkInvalidateMappedMemoryRanges(init_->device, 1, &range);
+  }
+
+  visible = *static_cast<const uint32_t*>(current.readback_allocation.mapped);
+  current.culled = false;
+
+  stats_.frames++;
+  stats_.visible += visible;
+  stats_.last_visible = visible;
+  return true;
+}
+
+void GpuCuller::PrintStats() const {
+  float average = stats_.frames > 0 ? static_cast<float>(stats_.visible) / stats_.frames : 0.0f;
+  std::cout << "gpu culling: " << stats_.object_count << " objects, " << average << " visible on average over "
+    << stats_.frames << " frames, " << (features_.draw_indirect_count ? "indirect count" :
+      features_.multi_draw_indirect ? "multi draw indirect" : "one indirect draw per object") << std::endl;
+}
+
+void GpuCuller::CreateDescriptors(uint32_t frame_count) {
+  std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+  for (uint32_t ii = 0; ii < bindings.size(); ii++) {
+    bindings[ii].binding = ii;
+    bindings[ii].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[ii].descriptorCount = 1;
+    bindings[ii].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layout_info{};
+  layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+  layout_info.pBindings = bindings.data();
+
+  if (vkCreateDescriptorSetLayout(init_->device, &layout_info, nullptr, &descriptor_set_layout_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create cull descriptor set layout!");
+  }
+
+  VkPushConstantRange push_constant_range{};
+  push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  push_constant_range.offset = 0;
+  push_constant_range.size = sizeof(CullConstants);
+
+  VkPipelineLayoutCreateInfo pipeline_layout_info{};
+  pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipeline_layout_info.setLayoutCount = 1;
+  pipeline_layout_info.pSetLayouts = &descriptor_set_layout_;
+  pipeline_layout_info.pushConstantRangeCount = 1;
+  pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+  if (vkCreatePipelineLayout(init_->device, &pipeline_layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create cull pipeline layout!");
+  }
+
+  VkDescriptorPoolSize pool_size{};
+  pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  pool_size.descriptorCount = static_cast<uint32_t>(bindings.size()) * frame_count;
+
+  VkDescriptorPoolCreateInfo pool_info{};
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.poolSizeCount = 1;
+  pool_info.pPoolSizes = &pool_size;
+  pool_info.maxSets = frame_count;
+
+  if (vkCreateDescriptorPool(init_->device, &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create cull descriptor pool!");
+  }
+
+  for (auto& frame : frames_) {
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = descriptor_pool_;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &descriptor_set_layout_;
+
+    if (vkAllocateDescriptorSets(init_->device, &alloc_info, &frame.descriptor_set) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate cull descriptor set!");
+    }
+
+    std::array<VkDescriptorBufferInfo, 3> buffer_infos{};
+    buffer_infos[0] = { objects_.GetBuffer(), 0, VK_WHOLE_SIZE };
+    buffer_infos[1] = { frame.draws, 0, VK_WHOLE_SIZE };
+    buffer_infos[2] = { frame.count, 0, VK_WHOLE_SIZE };
+
+    std::array<VkWriteDescriptorSet, 3> writes{};
+    for (uint32_t ii = 0; ii < writes.size(); ii++) {
+      writes[ii].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[ii].dstSet = frame.descriptor_set;
+      writes[ii].dstBinding = ii;
+      writes[ii].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      writes[ii].descriptorCount = 1;
+      writes[ii].pBufferInfo = &buffer_infos[ii];
+    }
+    vkUpdateDescriptorSets(init_->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+  }
+}
+
+VkBuffer GpuCuller::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memory_usage, Allocation& allocation) {
+  VkBufferCreateInfo buffer_info{};
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = size;
+  buffer_info.usage = usage;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VkBuffer buffer;
+  if (vkCreateBuffer(init_->device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create cull buffer");
+  }
+
+  allocation = init_->allocator->AllocateBuffer(buffer, memory_usage);
+  return buffer;
+}
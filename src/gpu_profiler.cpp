@@ -0,0 +1,212 @@
+#include "gpu_profiler.h"
+#include "cpu_profiler.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+  // events kept for the trace, a few minutes of a handful of scopes per frame
+  const size_t MAX_TRACE_EVENTS = 1 << 20;
+
+  float Percentile(const std::vector<float>& sorted, float percentile) {
+    size_t index = static_cast<size_t>(percentile * (sorted.size() - 1) + 0.5f);
+    return sorted[std::min(index, sorted.size() - 1)];
+  }
+}
+
+GpuProfiler::GpuProfiler()
+{
+}
+
+void GpuProfiler::Init(const InitData& init, uint32_t queue_family, uint32_t frame_count) {
+  device_ = init.device;
+
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(init.physical_device, &properties);
+
+  uint32_t family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(init.physical_device, &family_count, nullptr);
+  std::vector<VkQueueFamilyProperties> families(family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(init.physical_device, &family_count, families.data());
+
+  uint32_t valid_bits = queue_family < family_count ? families[queue_family].timestampValidBits : 0;
+  enabled_ = valid_bits > 0 && properties.limits.timestampPeriod > 0.0f;
+  if (!enabled_) {
+    std::cerr << "gpu profiler disabled, the graphics queue has no timestamps" << std::endl;
+    return;
+  }
+
+  period_ = properties.limits.timestampPeriod;
+  valid_mask_ = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+  frames_.resize(frame_count);
+  for (auto& frame : frames_) {
+    VkQueryPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    // a begin and an end per scope
+    pool_info.queryCount = MAX_SCOPES * 2;
+
+    if (vkCreateQueryPool(device_, &pool_info, nullptr, &frame.pool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create timestamp query pool");
+    }
+  }
+}
+
+void GpuProfiler::Destroy() {
+  for (auto& frame : frames_) {
+    vkDestroyQueryPool(device_, frame.pool, nullptr);
+  }
+  frames_.clear();
+  enabled_ = false;
+}
+
+void GpuProfiler::Collect(uint32_t frame) {
+  if (!enabled_) {
+    return;
+  }
+
+  Frame& slot = frames_[frame];
+  if (slot.frame_number == 0 || slot.scopes.empty()) {
+    return;
+  }
+
+  // every pair plus an availability word, without WAIT so an unfinished frame is skipped instead of stalling
+  uint32_t query_count = static_cast<uint32_t>(slot.scopes.size() * 2);
+  std::vector<uint64_t> results(query_count * 2);
+  VkResult result = vkGetQueryPoolResults(device_, slot.pool, 0, query_count, results.size() * sizeof(uint64_t),
+    results.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+  if (result != VK_SUCCESS && result != VK_NOT_READY) {
+    slot.scopes.clear();
+    return;
+  }
+
+  for (size_t ii = 0; ii < slot.scopes.size(); ii++) {
+    uint64_t begin = results[ii * 4] & valid_mask_;
+    uint64_t end = results[ii * 4 + 2] & valid_mask_;
+    if (results[ii * 4 + 1] == 0 || results[ii * 4 + 3] == 0 || end < begin) {
+      continue;
+    }
+
+    if (!has_origin_) {
+      origin_ = begin;
+      has_origin_ = true;
+    }
+
+    float duration_ms = (end - begin) * period_ / 1e6f;
+    const std::string& name = slot.scopes[ii];
+
+    auto& history = history_[name];
+    if (history.empty() && std::find(order_.begin(), order_.end(), name) == order_.end()) {
+      order_.push_back(name);
+    }
+    history.push_back(duration_ms);
+    if (history.size() > WINDOW) {
+      history.pop_front();
+    }
+
+    if (trace_.size() < MAX_TRACE_EVENTS && begin >= origin_) {
+      trace_.push_back({ name, slot.frame_number, (begin - origin_) * period_ / 1e3, (end - begin) * period_ / 1e3 });
+    }
+  }
+
+  slot.scopes.clear();
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer command_buffer, uint32_t frame) {
+  if (!enabled_) {
+    return;
+  }
+
+  current_ = frame;
+  Frame& slot = frames_[frame];
+  slot.scopes.clear();
+  slot.frame_number = ++frame_number_;
+
+  vkCmdResetQueryPool(command_buffer, slot.pool, 0, MAX_SCOPES * 2);
+}
+
+uint32_t GpuProfiler::BeginScope(VkCommandBuffer command_buffer, const char* name) {
+  if (!enabled_) {
+    return 0;
+  }
+
+  Frame& slot = frames_[current_];
+  if (slot.scopes.size() >= MAX_SCOPES) {
+    return MAX_SCOPES;
+  }
+
+  uint32_t scope = static_cast<uint32_t>(slot.scopes.size());
+  slot.scopes.push_back(name);
+  vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot.pool, scope * 2);
+  return scope;
+}
+
+void GpuProfiler::EndScope(VkCommandBuffer command_buffer, uint32_t scope) {
+  if (!enabled_ || scope >= MAX_SCOPES) {
+    return;
+  }
+
+  vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frames_[current_].pool, scope * 2 + 1);
+}
+
+std::vector<GpuScopeStats> GpuProfiler::GetStats() const {
+  std::vector<GpuScopeStats> stats;
+  for (const auto& name : order_) {
+    const auto& history = history_.at(name);
+    if (history.empty()) {
+      continue;
+    }
+
+    std::vector<float> sorted(history.begin(), history.end());
+    std::sort(sorted.begin(), sorted.end());
+
+    float total = 0.0f;
+    for (float sample : sorted) {
+      total += sample;
+    }
+
+    GpuScopeStats scope{};
+    scope.name = name;
+    scope.samples = static_cast<uint32_t>(sorted.size());
+    scope.average_ms = total / sorted.size();
+    scope.p50_ms = Percentile(sorted, 0.50f);
+    scope.p95_ms = Percentile(sorted, 0.95f);
+    scope.p99_ms = Percentile(sorted, 0.99f);
+    stats.push_back(scope);
+  }
+  return stats;
+}
+
+void GpuProfiler::PrintStats() const {
+  if (!enabled_) {
+    return;
+  }
+
+  std::cout << "gpu timings over the last " << WINDOW << " frames:" << std::endl;
+  for (const auto& scope : GetStats()) {
+    std::cout << "  " << scope.name << ": " << scope.average_ms << " ms average, p50 " << scope.p50_ms
+      << ", p95 " << scope.p95_ms << ", p99 " << scope.p99_ms << " (" << scope.samples << " samples)" << std::endl;
+  }
+}
+
+bool GpuProfiler::WriteChromeTrace(const std::string& path) const {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    return false;
+  }
+
+  file << "{\"traceEvents\":[\n";
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"GPU graphics queue\"}}";
+  for (const auto& event : trace_) {
+    file << ",\n{\"name\":\"";
+    WriteJsonEscaped(file, event.name);
+    file << "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":"
+      << std::fixed << event.start_us << ",\"dur\":" << event.duration_us
+      << ",\"args\":{\"frame\":" << event.frame_number << "}}";
+  }
+  file << "\n]}\n";
+  return static_cast<bool>(file);
+}
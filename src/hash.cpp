@@ -0,0 +1,50 @@
+#include "hash.h"
+#include <cstring>
+
+uint64_t Hash64(const void* data, size_t size, uint64_t seed) {
+  const uint64_t m = 0xc6a4a7935bd1e995ull;
+  const int r = 47;
+
+  uint64_t hash = seed ^ (size * m);
+
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  const uint8_t* end = bytes + (size / 8) * 8;
+
+  for (; bytes != end; bytes += 8) {
+    uint64_t k;
+    memcpy(&k, bytes, sizeof(k));
+
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+
+    hash ^= k;
+    hash *= m;
+  }
+
+  switch (size & 7) {
+  case 7: hash ^= static_cast<uint64_t>(bytes[6]) << 48; [[fallthrough]];
+  case 6: hash ^= static_cast<uint64_t>(bytes[5]) << 40; [[fallthrough]];
+  case 5: hash ^= static_cast<uint64_t>(bytes[4]) << 32; [[fallthrough]];
+  case 4: hash ^= static_cast<uint64_t>(bytes[3]) << 24; [[fallthrough]];
+  case 3: hash ^= static_cast<uint64_t>(bytes[2]) << 16; [[fallthrough]];
+  case 2: hash ^= static_cast<uint64_t>(bytes[1]) << 8; [[fallthrough]];
+  case 1: hash ^= static_cast<uint64_t>(bytes[0]);
+    hash *= m;
+  }
+
+  hash ^= hash >> r;
+  hash *= m;
+  hash ^= hash >> r;
+  return hash;
+}
+
+std::string HashToString(uint64_t hash) {
+  static const char digits[] = "0123456789abcdef";
+  std::string result(16, '0');
+  for (int ii = 15; ii >= 0; ii--) {
+    result[ii] = digits[hash & 0xf];
+    hash >>= 4;
+  }
+  return result;
+}
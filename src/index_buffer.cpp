@@ -9,6 +9,11 @@ IndexBuffer::IndexBuffer(const InitData& init, const RenderData& render, const s
     (void*)vertices.data()) {
 }
 
+IndexBuffer::IndexBuffer(const InitData& init, const RenderData& render, const uint32_t* indices, VkDeviceSize size)
+  : Buffer(init, render, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+    const_cast<uint32_t*>(indices)) {
+}
+
 void IndexBuffer::Bind() {
   return;
 }
@@ -0,0 +1,292 @@
+#include "job_system.h"
+#include "cpu_profiler.h"
+#include <algorithm>
+
+namespace {
+  thread_local uint32_t worker_index = 0;
+}
+
+JobSystem::JobSystem()
+{
+}
+
+JobSystem::~JobSystem() {
+  // an exception kept for Destroy has nowhere to go from a destructor
+  try {
+    Destroy();
+  }
+  catch (...) {
+  }
+}
+
+void JobSystem::Init(uint32_t thread_count) {
+  quit_ = false;
+  worker_index = 0;
+  main_thread_ = std::this_thread::get_id();
+
+  workers_.resize(thread_count < 1 ? 1 : thread_count);
+  for (auto& worker : workers_) {
+    worker = std::make_unique<Worker>();
+  }
+
+  for (uint32_t ii = 1; ii < workers_.size(); ii++) {
+    workers_[ii]->thread = std::thread(&JobSystem::WorkerLoop, this, ii);
+  }
+}
+
+void JobSystem::Destroy() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    quit_ = true;
+  }
+  sleep_cv_.notify_all();
+
+  for (auto& worker : workers_) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+
+  // whatever the workers left queued runs here on the calling thread, dropping it would leave its counter
+  // above zero and anyone waiting on it stuck. jobs queued by these jobs are picked up by the same loop
+  if (!workers_.empty()) {
+    for (;;) {
+      PumpMainThread();
+      if (TryRunOne(0)) {
+        continue;
+      }
+      std::lock_guard<std::mutex> lock(main_mutex_);
+      if (main_jobs_.empty()) {
+        break;
+      }
+    }
+  }
+  workers_.clear();
+  main_jobs_.clear();
+  queued_ = 0;
+
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    error.swap(error_);
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+uint32_t JobSystem::WorkerIndex() {
+  return worker_index;
+}
+
+void JobSystem::Run(Job job, JobCounter* counter) {
+  if (counter) {
+    counter->value_.fetch_add(1, std::memory_order_relaxed);
+  }
+  Push({ std::move(job), counter });
+}
+
+void JobSystem::RunAfter(JobCounter& dependency, Job job, JobCounter* counter) {
+  if (counter) {
+    counter->value_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(dependency.mutex_);
+    if (!dependency.Done()) {
+      dependency.continuations_.push_back([this, job = std::move(job), counter]() mutable {
+        Push({ std::move(job), counter });
+      });
+      return;
+    }
+  }
+  Push({ std::move(job), counter });
+}
+
+void JobSystem::RunOnMainThread(Job job, JobCounter* counter) {
+  if (counter) {
+    counter->value_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::lock_guard<std::mutex> lock(main_mutex_);
+  main_jobs_.push_back({ std::move(job), counter });
+}
+
+void JobSystem::PumpMainThread() {
+  std::vector<QueuedJob> jobs;
+  {
+    std::lock_guard<std::mutex> lock(main_mutex_);
+    jobs.swap(main_jobs_);
+  }
+
+  for (auto& job : jobs) {
+    Execute(job);
+  }
+}
+
+void JobSystem::Wait(JobCounter& counter) {
+  uint32_t index = worker_index;
+  while (!counter.Done()) {
+    if (std::this_thread::get_id() == main_thread_) {
+      PumpMainThread();
+    }
+    if (!TryRunOne(index)) {
+      std::this_thread::yield();
+    }
+  }
+
+  // also waits out the finisher that made the counter reach zero, it still holds the mutex until it is done with it
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(counter.mutex_);
+    error.swap(counter.error_);
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void JobSystem::ParallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& func) {
+  if (count == 0) {
+    return;
+  }
+  grain = std::max<size_t>(grain, 1);
+
+  // a single chunk is not worth a round trip through the queues
+  if (count <= grain || workers_.size() < 2) {
+    func(0, count);
+    return;
+  }
+
+  JobCounter counter;
+  for (size_t begin = 0; begin < count; begin += grain) {
+    size_t end = std::min(begin + grain, count);
+    Run([&func, begin, end] { func(begin, end); }, &counter);
+  }
+  Wait(counter);
+}
+
+JobStats JobSystem::GetStats() const {
+  JobStats stats{};
+  stats.jobs_run = jobs_run_.load();
+  stats.steals = steals_.load();
+  return stats;
+}
+
+void JobSystem::Push(QueuedJob job) {
+  // jobs from inside the system stay on their worker for locality, the rest are spread round robin
+  uint32_t index = worker_index;
+  if (index == 0 && workers_.size() > 1) {
+    index = next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+  }
+
+  Worker& worker = *workers_[index];
+  {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.jobs.push_back(std::move(job));
+  }
+
+  queued_.fetch_add(1, std::memory_order_release);
+  {
+    // a worker that just saw queued_ == 0 is either still holding the lock or already waiting
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+  }
+  sleep_cv_.notify_one();
+}
+
+bool JobSystem::TryRunOne(uint32_t index) {
+  QueuedJob job;
+  bool found = false;
+
+  {
+    Worker& own = *workers_[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.jobs.empty()) {
+      job = std::move(own.jobs.back());
+      own.jobs.pop_back();
+      found = true;
+    }
+  }
+
+  for (size_t ii = 1; !found && ii < workers_.size(); ii++) {
+    Worker& victim = *workers_[(index + ii) % workers_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.jobs.empty()) {
+      job = std::move(victim.jobs.front());
+      victim.jobs.pop_front();
+      found = true;
+      steals_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  if (!found) {
+    return false;
+  }
+
+  queued_.fetch_sub(1, std::memory_order_relaxed);
+  Execute(job);
+  return true;
+}
+
+void JobSystem::Execute(QueuedJob& job) {
+  CPU_PROFILE_SCOPE("job");
+  try {
+    job.func();
+  }
+  catch (...) {
+    // nobody waits on a job without a counter, its exception is kept for Destroy. rethrowing it here would
+    // terminate a worker, drop the rest of a main thread pump or surface from some unrelated Wait
+    std::mutex& mutex = job.counter ? job.counter->mutex_ : error_mutex_;
+    std::exception_ptr& error = job.counter ? job.counter->error_ : error_;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!error) {
+      error = std::current_exception();
+    }
+  }
+  jobs_run_.fetch_add(1, std::memory_order_relaxed);
+  Finish(job.counter);
+}
+
+void JobSystem::Finish(JobCounter* counter) {
+  if (!counter) {
+    return;
+  }
+
+  // decrements that leave other jobs outstanding don't need the lock
+  uint32_t value = counter->value_.load(std::memory_order_relaxed);
+  while (value > 1) {
+    if (counter->value_.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+      return;
+    }
+  }
+
+  // the counter may be destroyed as soon as it reads zero, so the last decrement happens under its mutex
+  // together with taking the continuations, and Wait takes the same mutex before returning. nothing
+  // touches the counter once the lock is released. a job of the group may have added to it since the load,
+  // then this isn't the last decrement after all
+  std::vector<Job> continuations;
+  {
+    std::lock_guard<std::mutex> lock(counter->mutex_);
+    if (counter->value_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+    continuations.swap(counter->continuations_);
+  }
+  for (auto& continuation : continuations) {
+    continuation();
+  }
+}
+
+void JobSystem::WorkerLoop(uint32_t index) {
+  worker_index = index;
+  CPU_PROFILE_THREAD("worker " + std::to_string(index));
+
+  while (!quit_) {
+    if (TryRunOne(index)) {
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    sleep_cv_.wait(lock, [this] { return quit_ || queued_.load(std::memory_order_acquire) > 0; });
+  }
+}
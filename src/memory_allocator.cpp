@@ -0,0 +1,373 @@
+#include "memory_allocator.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <bitset>
+#include <string>
+
+// BAR windows without resizable BAR are 256 MiB, anything bigger is treated as ReBAR
+static const VkDeviceSize REBAR_MIN_HEAP_SIZE = 256ull * 1024 * 1024;
+
+struct UsageFlags {
+  VkMemoryPropertyFlags required;
+  VkMemoryPropertyFlags preferred;
+  VkMemoryPropertyFlags not_preferred;
+};
+
+static UsageFlags GetUsageFlags(MemoryUsage usage) {
+  switch (usage) {
+  case MemoryUsage::GPU_ONLY:
+    return { 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT };
+  case MemoryUsage::CPU_ONLY:
+    return { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT };
+  case MemoryUsage::CPU_TO_GPU:
+    return { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT };
+  case MemoryUsage::GPU_TO_CPU:
+    return { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      VK_MEMORY_PROPERTY_HOST_CACHED_BIT, 0 };
+  }
+  throw std::invalid_argument("unknown memory usage");
+}
+
+static const char* UsageName(MemoryUsage usage) {
+  switch (usage) {
+  case MemoryUsage::GPU_ONLY: return "GPU_ONLY";
+  case MemoryUsage::CPU_ONLY: return "CPU_ONLY";
+  case MemoryUsage::CPU_TO_GPU: return "CPU_TO_GPU";
+  case MemoryUsage::GPU_TO_CPU: return "GPU_TO_CPU";
+  }
+  return "?";
+}
+
+static std::string PropertyFlagsString(VkMemoryPropertyFlags flags) {
+  std::string out;
+  if (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) out += "DEVICE_LOCAL ";
+  if (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) out += "HOST_VISIBLE ";
+  if (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) out += "HOST_COHERENT ";
+  if (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) out += "HOST_CACHED ";
+  if (flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) out += "LAZILY_ALLOCATED ";
+  return out.empty() ? "none" : out;
+}
+
+MemoryAllocator::MemoryAllocator()
+{
+}
+
+void MemoryAllocator::Init(const InitData& init, VkDeviceSize block_size) {
+  device_ = init.device;
+  vkGetPhysicalDeviceMemoryProperties(init.physical_device, &memory_properties_);
+  vkGetPhysicalDeviceProperties(init.physical_device, &device_properties_);
+
+  block_size_ = block_size;
+
+  pools_.resize(memory_properties_.memoryTypeCount * 2);
+  for (uint32_t ii = 0; ii < memory_properties_.memoryTypeCount; ii++) {
+    pools_[ii * 2].memory_type = ii;
+    pools_[ii * 2 + 1].memory_type = ii;
+  }
+
+  // integrated and software devices share system memory, any device local type is as good as another
+  direct_upload_ = device_properties_.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+    device_properties_.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+
+  const VkMemoryPropertyFlags direct_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  for (uint32_t ii = 0; ii < memory_properties_.memoryTypeCount; ii++) {
+    const VkMemoryType& type = memory_properties_.memoryTypes[ii];
+    if ((type.propertyFlags & direct_flags) == direct_flags &&
+      memory_properties_.memoryHeaps[type.heapIndex].size > REBAR_MIN_HEAP_SIZE) {
+      direct_upload_ = true;
+    }
+  }
+}
+
+void MemoryAllocator::Destroy() {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (auto& pool : pools_) {
+    for (uint32_t ii = 0; ii < pool.blocks.size(); ii++) {
+      if (!pool.blocks[ii]) {
+        continue;
+      }
+      if (pool.blocks[ii]->allocation_count != 0) {
+        std::cerr << "memory allocator: " << pool.blocks[ii]->allocation_count
+          << " allocation(s) still live in memory type " << pool.memory_type << std::endl;
+      }
+      DestroyBlock(pool, ii);
+    }
+  }
+  pools_.clear();
+}
+
+Allocation MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, bool linear) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  uint32_t memory_type = FindMemoryType(requirements.memoryTypeBits, usage);
+  uint32_t pool_index = 0;
+  uint64_t offset = 0;
+  uint32_t block_index = UINT32_MAX;
+
+  // when the best type's heap is full (the 256 MiB BAR window of a dGPU without ReBAR) the next best allowed
+  // type is tried, down to plain host visible system memory
+  uint32_t allowed_types = requirements.memoryTypeBits;
+  while (block_index == UINT32_MAX) {
+    pool_index = memory_type * 2 + (linear ? 0 : 1);
+    Pool& pool = pools_[pool_index];
+
+    // anything bigger than half a block would waste most of it, so it gets its own memory
+    if (requirements.size > block_size_ / 2) {
+      block_index = CreateBlock(pool, requirements.size, true);
+      if (block_index != UINT32_MAX) {
+        pool.blocks[block_index]->metadata.Allocate(requirements.size, requirements.alignment, offset);
+      }
+    }
+    else {
+      for (uint32_t ii = 0; ii < pool.blocks.size(); ii++) {
+        Block* block = pool.blocks[ii].get();
+        if (block && !block->dedicated &&
+          block->metadata.Allocate(requirements.size, requirements.alignment, offset)) {
+          block_index = ii;
+          break;
+        }
+      }
+
+      if (block_index == UINT32_MAX) {
+        block_index = CreateBlock(pool, block_size_, false);
+        if (block_index != UINT32_MAX) {
+          pool.blocks[block_index]->metadata.Allocate(requirements.size, requirements.alignment, offset);
+        }
+      }
+    }
+
+    if (block_index != UINT32_MAX) {
+      break;
+    }
+
+    allowed_types &= ~(1u << memory_type);
+    memory_type = BestMemoryType(allowed_types, usage);
+    if (memory_type == UINT32_MAX) {
+      throw std::runtime_error("out of memory in every memory type the allocation allows");
+    }
+  }
+
+  Pool& pool = pools_[pool_index];
+  Block& block = *pool.blocks[block_index];
+  block.allocation_count++;
+
+  Allocation allocation{};
+  allocation.memory = block.memory;
+  allocation.offset = offset;
+  allocation.size = requirements.size;
+  allocation.property_flags = memory_properties_.memoryTypes[memory_type].propertyFlags;
+  allocation.pool = pool_index;
+  allocation.block = block_index;
+  if (block.mapped) {
+    allocation.mapped = static_cast<char*>(block.mapped) + offset;
+  }
+
+  return allocation;
+}
+
+Allocation MemoryAllocator::AllocateBuffer(VkBuffer buffer, MemoryUsage usage) {
+  VkMemoryRequirements memory_requirements;
+  vkGetBufferMemoryRequirements(device_, buffer, &memory_requirements);
+
+  Allocation allocation = Allocate(memory_requirements, usage, true);
+  vkBindBufferMemory(device_, buffer, allocation.memory, allocation.offset);
+
+  return allocation;
+}
+
+Allocation MemoryAllocator::AllocateImage(VkImage image, MemoryUsage usage) {
+  VkMemoryRequirements memory_requirements;
+  vkGetImageMemoryRequirements(device_, image, &memory_requirements);
+
+  Allocation allocation = Allocate(memory_requirements, usage, false);
+  vkBindImageMemory(device_, image, allocation.memory, allocation.offset);
+
+  return allocation;
+}
+
+void MemoryAllocator::Free(Allocation& allocation) {
+  if (allocation.memory == VK_NULL_HANDLE) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  Pool& pool = pools_[allocation.pool];
+  Block& block = *pool.blocks[allocation.block];
+  block.metadata.Free(allocation.offset, allocation.size);
+  block.allocation_count--;
+
+  if (block.allocation_count == 0) {
+    // keep a single empty block per pool around so load / unload cycles
+    // don't turn into vkAllocateMemory / vkFreeMemory churn
+    bool other_empty_block = false;
+    for (uint32_t ii = 0; ii < pool.blocks.size(); ii++) {
+      if (ii != allocation.block && pool.blocks[ii] && !pool.blocks[ii]->dedicated &&
+        pool.blocks[ii]->allocation_count == 0) {
+        other_empty_block = true;
+        break;
+      }
+    }
+
+    if (block.dedicated || other_empty_block) {
+      DestroyBlock(pool, allocation.block);
+    }
+  }
+
+  allocation = Allocation{};
+}
+
+AllocatorStats MemoryAllocator::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  AllocatorStats stats{};
+  VkDeviceSize free_bytes = 0;
+  VkDeviceSize unusable_bytes = 0;
+
+  for (const auto& pool : pools_) {
+    for (const auto& block : pool.blocks) {
+      if (!block) {
+        continue;
+      }
+      stats.block_count++;
+      stats.allocation_count += block->allocation_count;
+      stats.bytes_reserved += block->metadata.Size();
+      stats.bytes_used += block->metadata.Used();
+
+      VkDeviceSize block_free = block->metadata.Size() - block->metadata.Used();
+      free_bytes += block_free;
+      unusable_bytes += block_free - block->metadata.LargestFreeRange();
+    }
+  }
+
+  if (free_bytes > 0) {
+    stats.fragmentation = static_cast<float>(unusable_bytes) / static_cast<float>(free_bytes);
+  }
+
+  return stats;
+}
+
+void MemoryAllocator::PrintStats() const {
+  AllocatorStats stats = GetStats();
+
+  std::cout << "memory allocator: " << stats.allocation_count << " allocations in "
+    << stats.block_count << " blocks, " << stats.bytes_used / 1024 << " KiB used of "
+    << stats.bytes_reserved / 1024 << " KiB reserved, fragmentation "
+    << stats.fragmentation * 100.0f << "%" << std::endl;
+}
+
+void MemoryAllocator::PrintMemoryReport() const {
+  std::cout << "memory report for " << device_properties_.deviceName << std::endl;
+
+  for (uint32_t ii = 0; ii < memory_properties_.memoryHeapCount; ii++) {
+    const VkMemoryHeap& heap = memory_properties_.memoryHeaps[ii];
+    std::cout << "  heap " << ii << ": " << heap.size / (1024 * 1024) << " MiB"
+      << ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " DEVICE_LOCAL" : "") << std::endl;
+  }
+
+  for (uint32_t ii = 0; ii < memory_properties_.memoryTypeCount; ii++) {
+    const VkMemoryType& type = memory_properties_.memoryTypes[ii];
+    std::cout << "  type " << ii << " (heap " << type.heapIndex << "): "
+      << PropertyFlagsString(type.propertyFlags) << std::endl;
+  }
+
+  for (MemoryUsage usage : { MemoryUsage::GPU_ONLY, MemoryUsage::CPU_ONLY,
+    MemoryUsage::CPU_TO_GPU, MemoryUsage::GPU_TO_CPU }) {
+    std::cout << "  " << UsageName(usage) << " -> ";
+    try {
+      std::cout << "type " << FindMemoryType(UINT32_MAX, usage) << std::endl;
+    }
+    catch (const std::runtime_error&) {
+      std::cout << "unsupported" << std::endl;
+    }
+  }
+
+  std::cout << "  direct upload (ReBAR / UMA): " << (direct_upload_ ? "yes" : "no") << std::endl;
+}
+
+uint32_t MemoryAllocator::FindMemoryType(uint32_t type_filter, MemoryUsage usage) const {
+  uint32_t memory_type = BestMemoryType(type_filter, usage);
+  if (memory_type == UINT32_MAX) {
+    throw std::runtime_error("failed to find suitable memory type!");
+  }
+  return memory_type;
+}
+
+uint32_t MemoryAllocator::BestMemoryType(uint32_t type_filter, MemoryUsage usage) const {
+  UsageFlags flags = GetUsageFlags(usage);
+
+  uint32_t best_type = UINT32_MAX;
+  int best_score = 0;
+  VkDeviceSize best_heap_size = 0;
+
+  for (uint32_t ii = 0; ii < memory_properties_.memoryTypeCount; ii++) {
+    VkMemoryPropertyFlags type_flags = memory_properties_.memoryTypes[ii].propertyFlags;
+    if (!(type_filter & (1 << ii)) || (type_flags & flags.required) != flags.required) {
+      continue;
+    }
+
+    // every preferred flag present outweighs every unwanted one
+    int score = 2 * static_cast<int>(std::bitset<32>(type_flags & flags.preferred).count()) -
+      static_cast<int>(std::bitset<32>(type_flags & flags.not_preferred).count());
+    VkDeviceSize heap_size = memory_properties_.memoryHeaps[memory_properties_.memoryTypes[ii].heapIndex].size;
+
+    // on a tie the bigger heap wins, which keeps small BAR windows for last
+    if (best_type == UINT32_MAX || score > best_score || (score == best_score && heap_size > best_heap_size)) {
+      best_type = ii;
+      best_score = score;
+      best_heap_size = heap_size;
+    }
+  }
+
+  return best_type;
+}
+
+uint32_t MemoryAllocator::CreateBlock(Pool& pool, VkDeviceSize size, bool dedicated) {
+  VkMemoryAllocateInfo alloc_info{};
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.allocationSize = size;
+  alloc_info.memoryTypeIndex = pool.memory_type;
+
+  VkDeviceMemory memory;
+  VkResult result = vkAllocateMemory(device_, &alloc_info, nullptr, &memory);
+  if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY) {
+    return UINT32_MAX;
+  }
+  if (result != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate memory block");
+  }
+
+  void* mapped = nullptr;
+  if (memory_properties_.memoryTypes[pool.memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    // a memory object can only be mapped once, so it is mapped for its whole lifetime
+    if (vkMapMemory(device_, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+      vkFreeMemory(device_, memory, nullptr);
+      throw std::runtime_error("failed to map memory block");
+    }
+  }
+
+  auto block = std::make_unique<Block>(memory, size, mapped, dedicated);
+
+  auto free_slot = std::find(pool.blocks.begin(), pool.blocks.end(), nullptr);
+  if (free_slot != pool.blocks.end()) {
+    *free_slot = std::move(block);
+    return static_cast<uint32_t>(free_slot - pool.blocks.begin());
+  }
+
+  pool.blocks.push_back(std::move(block));
+  return static_cast<uint32_t>(pool.blocks.size() - 1);
+}
+
+void MemoryAllocator::DestroyBlock(Pool& pool, uint32_t block_index) {
+  Block& block = *pool.blocks[block_index];
+  if (block.mapped) {
+    vkUnmapMemory(device_, block.memory);
+  }
+  vkFreeMemory(device_, block.memory, nullptr);
+  pool.blocks[block_index].reset();
+}
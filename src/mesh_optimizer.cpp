@@ -0,0 +1,270 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+  // scoring constants straight from Forsyth's write up
+  const float CACHE_DECAY_POWER = 1.5f;
+  const float LAST_TRIANGLE_SCORE = 0.75f;
+  const float VALENCE_BOOST_SCALE = 2.0f;
+  const float VALENCE_BOOST_POWER = 0.5f;
+
+  float VertexScore(int32_t cache_position, uint32_t remaining_triangles) {
+    if (remaining_triangles == 0) {
+      return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cache_position >= 0) {
+      if (cache_position < 3) {
+        // the last triangle's vertices get a fixed score so the next one doesn't just reuse its edge
+        score = LAST_TRIANGLE_SCORE;
+      }
+      else {
+        float scale = 1.0f / (VERTEX_CACHE_SIZE - 3);
+        score = std::pow(1.0f - (cache_position - 3) * scale, CACHE_DECAY_POWER);
+      }
+    }
+
+    // vertices with few triangles left are worth finishing off
+    score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining_triangles), -VALENCE_BOOST_POWER);
+    return score;
+  }
+
+}
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertex_count, uint32_t cache_size) {
+  // timestamps instead of a real FIFO, a vertex is cached if it was pushed less than cache_size misses ago
+  std::vector<uint32_t> cached_at(vertex_count, 0);
+  std::vector<bool> referenced(vertex_count, false);
+  uint32_t timestamp = cache_size + 1;
+  uint32_t misses = 0;
+  uint32_t unique = 0;
+
+  for (uint32_t index : indices) {
+    if (timestamp - cached_at[index] > cache_size) {
+      cached_at[index] = timestamp++;
+      misses++;
+    }
+    if (!referenced[index]) {
+      referenced[index] = true;
+      unique++;
+    }
+  }
+
+  VertexCacheStats stats{};
+  stats.misses = misses;
+  stats.acmr = indices.empty() ? 0.0f : static_cast<float>(misses) / (indices.size() / 3);
+  stats.atvr = unique == 0 ? 0.0f : static_cast<float>(misses) / unique;
+  return stats;
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertex_count) {
+  size_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0) {
+    return;
+  }
+
+  // per vertex list of triangles that still have to be emitted
+  std::vector<uint32_t> remaining(vertex_count, 0);
+  for (uint32_t index : indices) {
+    remaining[index]++;
+  }
+
+  std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+  for (size_t ii = 0; ii < vertex_count; ii++) {
+    adjacency_offsets[ii + 1] = adjacency_offsets[ii] + remaining[ii];
+  }
+
+  std::vector<uint32_t> adjacency(indices.size());
+  std::vector<uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+  for (uint32_t tri = 0; tri < triangle_count; tri++) {
+    for (uint32_t corner = 0; corner < 3; corner++) {
+      adjacency[fill[indices[tri * 3 + corner]]++] = tri;
+    }
+  }
+
+  std::vector<int32_t> cache_position(vertex_count, -1);
+  std::vector<float> vertex_score(vertex_count);
+  for (size_t ii = 0; ii < vertex_count; ii++) {
+    vertex_score[ii] = VertexScore(-1, remaining[ii]);
+  }
+
+  std::vector<float> triangle_score(triangle_count);
+  std::vector<bool> emitted(triangle_count, false);
+  uint32_t best_triangle = 0;
+  for (uint32_t tri = 0; tri < triangle_count; tri++) {
+    triangle_score[tri] = vertex_score[indices[tri * 3]] + vertex_score[indices[tri * 3 + 1]] +
+      vertex_score[indices[tri * 3 + 2]];
+    if (triangle_score[tri] > triangle_score[best_triangle]) {
+      best_triangle = tri;
+    }
+  }
+
+  // room for the three vertices pushed in front of a full cache
+  std::vector<uint32_t> cache;
+  std::vector<uint32_t> new_cache;
+  cache.reserve(VERTEX_CACHE_SIZE + 3);
+  new_cache.reserve(VERTEX_CACHE_SIZE + 3);
+
+  std::vector<uint32_t> output;
+  output.reserve(indices.size());
+  // triangles are scanned in order once the cache runs dry
+  uint32_t scan_cursor = 0;
+
+  for (size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++) {
+    const uint32_t* triangle = &indices[best_triangle * 3];
+    emitted[best_triangle] = true;
+    output.insert(output.end(), triangle, triangle + 3);
+
+    new_cache.assign(triangle, triangle + 3);
+    for (uint32_t vertex : cache) {
+      if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) {
+        new_cache.push_back(vertex);
+      }
+    }
+
+    for (uint32_t corner = 0; corner < 3; corner++) {
+      uint32_t vertex = triangle[corner];
+      uint32_t* begin = &adjacency[adjacency_offsets[vertex]];
+      uint32_t* end = begin + remaining[vertex];
+      *std::find(begin, end, best_triangle) = end[-1];
+      remaining[vertex]--;
+    }
+
+    // update every vertex that is or was in the cache and find the best triangle touching them
+    float best_score = -1.0f;
+    best_triangle = UINT32_MAX;
+    for (size_t ii = 0; ii < new_cache.size(); ii++) {
+      uint32_t vertex = new_cache[ii];
+      cache_position[vertex] = ii < VERTEX_CACHE_SIZE ? static_cast<int32_t>(ii) : -1;
+
+      float score = VertexScore(cache_position[vertex], remaining[vertex]);
+      float delta = score - vertex_score[vertex];
+      vertex_score[vertex] = score;
+
+      for (uint32_t jj = 0; jj < remaining[vertex]; jj++) {
+        uint32_t tri = adjacency[adjacency_offsets[vertex] + jj];
+        triangle_score[tri] += delta;
+        if (triangle_score[tri] > best_score) {
+          best_score = triangle_score[tri];
+          best_triangle = tri;
+        }
+      }
+    }
+
+    if (new_cache.size() > VERTEX_CACHE_SIZE) {
+      new_cache.resize(VERTEX_CACHE_SIZE);
+    }
+    cache.swap(new_cache);
+
+    if (best_triangle == UINT32_MAX) {
+      while (scan_cursor < triangle_count && emitted[scan_cursor]) {
+        scan_cursor++;
+      }
+      best_triangle = scan_cursor;
+    }
+  }
+
+  indices.swap(output);
+}
+
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold) {
+  size_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0) {
+    return;
+  }
+
+  // cluster boundaries go where every corner misses, moving those runs around costs almost nothing
+  std::vector<uint32_t> cluster_starts;
+  std::vector<uint32_t> cached_at(vertices.size(), 0);
+  uint32_t timestamp = VERTEX_CACHE_SIZE + 1;
+
+  for (uint32_t tri = 0; tri < triangle_count; tri++) {
+    uint32_t triangle_misses = 0;
+    for (uint32_t corner = 0; corner < 3; corner++) {
+      uint32_t index = indices[tri * 3 + corner];
+      if (timestamp - cached_at[index] > VERTEX_CACHE_SIZE) {
+        cached_at[index] = timestamp++;
+        triangle_misses++;
+      }
+    }
+    if (tri == 0 || triangle_misses == 3) {
+      cluster_starts.push_back(tri);
+    }
+  }
+
+  glm::vec3 mesh_centroid(0.0f);
+  for (uint32_t index : indices) {
+    mesh_centroid += vertices[index].pos;
+  }
+  mesh_centroid /= static_cast<float>(indices.size());
+
+  // clusters facing away from the middle of the mesh are the likely occluders, draw them first
+  size_t cluster_count = cluster_starts.size();
+  std::vector<float> sort_key(cluster_count);
+  for (size_t cluster = 0; cluster < cluster_count; cluster++) {
+    uint32_t begin = cluster_starts[cluster];
+    uint32_t end = cluster + 1 < cluster_count ? cluster_starts[cluster + 1] : static_cast<uint32_t>(triangle_count);
+
+    glm::vec3 centroid(0.0f);
+    glm::vec3 normal(0.0f);
+    float area = 0.0f;
+
+    for (uint32_t tri = begin; tri < end; tri++) {
+      const glm::vec3& p0 = vertices[indices[tri * 3]].pos;
+      const glm::vec3& p1 = vertices[indices[tri * 3 + 1]].pos;
+      const glm::vec3& p2 = vertices[indices[tri * 3 + 2]].pos;
+
+      // the cross product's length is twice the area, so this is an area weighted sum
+      glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+      float tri_area = glm::length(cross);
+
+      centroid += (p0 + p1 + p2) * (tri_area / 3.0f);
+      normal += cross;
+      area += tri_area;
+    }
+
+    if (area > 0.0f) {
+      centroid /= area;
+    }
+    float normal_length = glm::length(normal);
+    sort_key[cluster] = normal_length > 0.0f ? glm::dot(centroid - mesh_centroid, normal / normal_length) : 0.0f;
+  }
+
+  std::vector<uint32_t> order(cluster_count);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sort_key[a] > sort_key[b]; });
+
+  std::vector<uint32_t> output;
+  output.reserve(indices.size());
+  for (uint32_t cluster : order) {
+    uint32_t begin = cluster_starts[cluster];
+    uint32_t end = cluster + 1 < cluster_count ? cluster_starts[cluster + 1] : static_cast<uint32_t>(triangle_count);
+    output.insert(output.end(), indices.begin() + begin * 3, indices.begin() + end * 3);
+  }
+
+  float before = AnalyzeVertexCache(indices, vertices.size()).acmr;
+  float after = AnalyzeVertexCache(output, vertices.size()).acmr;
+  if (after <= before * threshold) {
+    indices.swap(output);
+  }
+}
+
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+  std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+  std::vector<Vertex> output;
+  output.reserve(vertices.size());
+
+  for (uint32_t& index : indices) {
+    if (remap[index] == UINT32_MAX) {
+      remap[index] = static_cast<uint32_t>(output.size());
+      output.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+
+  vertices.swap(output);
+}
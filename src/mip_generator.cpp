@@ -0,0 +1,398 @@
+#include "mip_generator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+// SSE2 is part of the x86-64 baseline, no runtime check needed
+#define MIP_SSE 1
+#include <immintrin.h>
+#endif
+
+namespace {
+  // source pixels per job, big enough that the rows a block re reads at its edges don't matter
+  const size_t DOWNSAMPLE_GRAIN = 256 * 1024;
+  // linear to sRGB goes through a table this size, fine enough to reach every sRGB code near black
+  const uint32_t ENCODE_TABLE_SIZE = 16 * 1024;
+  const int MAX_TAPS = 6;
+  // decoded rows repeat their edge pixels this far out, so no tap has to clamp
+  const int ROW_PADDING = MAX_TAPS;
+  const float PI = 3.14159265358979f;
+
+  // separable, the same taps run along x and then along y
+  struct Kernel {
+    int tap_count;
+    // tap k of destination pixel x reads source pixel 2 * x + first_offset + k
+    int first_offset;
+    float weights[MAX_TAPS];
+  };
+
+  struct ColorTables {
+    float srgb_to_linear[256];
+    float unorm_to_float[256];
+    uint8_t linear_to_srgb[ENCODE_TABLE_SIZE];
+  };
+
+  float BesselI0(float x) {
+    float sum = 1.0f;
+    float term = 1.0f;
+    for (int k = 1; k < 20; k++) {
+      float factor = x / (2.0f * k);
+      term *= factor * factor;
+      sum += term;
+    }
+    return sum;
+  }
+
+  Kernel MakeKernel(MipFilter filter) {
+    Kernel kernel{};
+    if (filter == MipFilter::BOX) {
+      kernel.tap_count = 2;
+      kernel.first_offset = 0;
+      kernel.weights[0] = 0.5f;
+      kernel.weights[1] = 0.5f;
+      return kernel;
+    }
+
+    // taps 0.5, 1.5 and 2.5 source pixels either side of the destination pixel's center, a sinc
+    // cut off at the destination's Nyquist limit under a Kaiser window reaching zero at 3 pixels
+    const float radius = 3.0f;
+    const float alpha = 4.0f;
+    kernel.tap_count = 6;
+    kernel.first_offset = -2;
+
+    float total = 0.0f;
+    for (int k = 0; k < kernel.tap_count; k++) {
+      float distance = k - 2.5f;
+      float x = PI * distance * 0.5f;
+      float r = distance / radius;
+      float window = BesselI0(alpha * std::sqrt(1.0f - r * r)) / BesselI0(alpha);
+      kernel.weights[k] = std::sin(x) / x * window;
+      total += kernel.weights[k];
+    }
+    for (int k = 0; k < kernel.tap_count; k++) {
+      kernel.weights[k] /= total;
+    }
+    return kernel;
+  }
+
+  ColorTables BuildColorTables() {
+    ColorTables tables;
+    for (uint32_t ii = 0; ii < 256; ii++) {
+      float c = ii / 255.0f;
+      tables.srgb_to_linear[ii] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+      tables.unorm_to_float[ii] = c;
+    }
+    for (uint32_t ii = 0; ii < ENCODE_TABLE_SIZE; ii++) {
+      float l = ii / static_cast<float>(ENCODE_TABLE_SIZE - 1);
+      float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+      tables.linear_to_srgb[ii] = static_cast<uint8_t>(std::min(c, 1.0f) * 255.0f + 0.5f);
+    }
+    return tables;
+  }
+
+  const ColorTables& GetColorTables() {
+    static const ColorTables tables = BuildColorTables();
+    return tables;
+  }
+
+  // table lookups, there is nothing here for SIMD to do. out has ROW_PADDING pixels either side of the
+  // row, filled with copies of the first and last pixel
+  void DecodeRow(const uint8_t* src, uint32_t width, bool srgb, const ColorTables& tables, float* out) {
+    const float* color_table = srgb ? tables.srgb_to_linear : tables.unorm_to_float;
+    float* row = out + ROW_PADDING * 4;
+    for (uint32_t x = 0; x < width; x++) {
+      row[x * 4 + 0] = color_table[src[x * 4 + 0]];
+      row[x * 4 + 1] = color_table[src[x * 4 + 1]];
+      row[x * 4 + 2] = color_table[src[x * 4 + 2]];
+      row[x * 4 + 3] = tables.unorm_to_float[src[x * 4 + 3]];
+    }
+    for (int ii = 0; ii < ROW_PADDING; ii++) {
+      memcpy(out + ii * 4, row, 4 * sizeof(float));
+      memcpy(row + (width + ii) * 4, row + (width - 1) * 4, 4 * sizeof(float));
+    }
+  }
+
+  // row is a padded row from DecodeRow
+  void FilterRowScalar(const float* row, const Kernel& kernel, uint32_t out_width, float* out) {
+    row += (ROW_PADDING + kernel.first_offset) * 4;
+    for (uint32_t x = 0; x < out_width; x++) {
+      float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      for (int k = 0; k < kernel.tap_count; k++) {
+        for (int c = 0; c < 4; c++) {
+          acc[c] += kernel.weights[k] * row[(x * 2 + k) * 4 + c];
+        }
+      }
+      memcpy(out + x * 4, acc, sizeof(acc));
+    }
+  }
+
+  // rows are the tap_count horizontally filtered rows under destination row, out is rgba8
+  void FilterColumnsScalar(const float* const* rows, const Kernel& kernel, uint32_t out_width, bool srgb,
+    const ColorTables& tables, uint8_t* out) {
+    const float color_scale = srgb ? ENCODE_TABLE_SIZE - 1.0f : 255.0f;
+    for (uint32_t x = 0; x < out_width; x++) {
+      float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      for (int k = 0; k < kernel.tap_count; k++) {
+        for (int c = 0; c < 4; c++) {
+          acc[c] += kernel.weights[k] * rows[k][x * 4 + c];
+        }
+      }
+      for (int c = 0; c < 4; c++) {
+        float scale = c == 3 ? 255.0f : color_scale;
+        uint32_t value = static_cast<uint32_t>(std::clamp(acc[c], 0.0f, 1.0f) * scale + 0.5f);
+        out[x * 4 + c] = srgb && c < 3 ? tables.linear_to_srgb[value] : static_cast<uint8_t>(value);
+      }
+    }
+  }
+
+#ifdef MIP_SSE
+  // one rgba pixel per register, same operations in the same order as the scalar path
+  void FilterRowSse(const float* row, const Kernel& kernel, uint32_t out_width, float* out) {
+    __m128 weights[MAX_TAPS];
+    for (int k = 0; k < kernel.tap_count; k++) {
+      weights[k] = _mm_set1_ps(kernel.weights[k]);
+    }
+
+    row += (ROW_PADDING + kernel.first_offset) * 4;
+    for (uint32_t x = 0; x < out_width; x++) {
+      const float* taps = row + x * 8;
+      __m128 acc = _mm_setzero_ps();
+      for (int k = 0; k < kernel.tap_count; k++) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(weights[k], _mm_loadu_ps(taps + k * 4)));
+      }
+      _mm_storeu_ps(out + x * 4, acc);
+    }
+  }
+
+  void FilterColumnsSse(const float* const* rows, const Kernel& kernel, uint32_t out_width, bool srgb,
+    const ColorTables& tables, uint8_t* out) {
+    __m128 weights[MAX_TAPS];
+    for (int k = 0; k < kernel.tap_count; k++) {
+      weights[k] = _mm_set1_ps(kernel.weights[k]);
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    // color scales to an index into the sRGB table, alpha straight to 0..255
+    const float color_scale = srgb ? ENCODE_TABLE_SIZE - 1.0f : 255.0f;
+    const __m128 scale = _mm_setr_ps(color_scale, color_scale, color_scale, 255.0f);
+
+    for (uint32_t x = 0; x < out_width; x++) {
+      __m128 acc = _mm_setzero_ps();
+      for (int k = 0; k < kernel.tap_count; k++) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(weights[k], _mm_loadu_ps(rows[k] + x * 4)));
+      }
+      acc = _mm_min_ps(_mm_max_ps(acc, zero), one);
+      __m128i value = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(acc, scale), half));
+
+      if (srgb) {
+        alignas(16) int32_t index[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(index), value);
+        out[x * 4 + 0] = tables.linear_to_srgb[index[0]];
+        out[x * 4 + 1] = tables.linear_to_srgb[index[1]];
+        out[x * 4 + 2] = tables.linear_to_srgb[index[2]];
+        out[x * 4 + 3] = static_cast<uint8_t>(index[3]);
+      }
+      else {
+        value = _mm_packs_epi32(value, value);
+        value = _mm_packus_epi16(value, value);
+        int32_t packed = _mm_cvtsi128_si32(value);
+        memcpy(out + x * 4, &packed, sizeof(packed));
+      }
+    }
+  }
+#endif
+}
+
+const char* GetMipFilterName(MipFilter filter) {
+  return filter == MipFilter::KAISER ? "kaiser" : "box";
+}
+
+uint32_t MipLevelCount(uint32_t width, uint32_t height) {
+  uint32_t level_count = 1;
+  while (width > 1 || height > 1) {
+    width = std::max(1u, width / 2);
+    height = std::max(1u, height / 2);
+    level_count++;
+  }
+  return level_count;
+}
+
+size_t MipChainSize(uint32_t width, uint32_t height, uint32_t level_count) {
+  size_t size = 0;
+  for (uint32_t ii = 0; ii < level_count; ii++) {
+    size += static_cast<size_t>(width) * height * 4;
+    width = std::max(1u, width / 2);
+    height = std::max(1u, height / 2);
+  }
+  return size;
+}
+
+void LayoutMipChain(uint32_t width, uint32_t height, uint32_t level_count, MipChain& chain) {
+  chain.width = width;
+  chain.height = height;
+  chain.levels.clear();
+
+  size_t offset = 0;
+  for (uint32_t ii = 0; ii < level_count; ii++) {
+    chain.levels.push_back({ width, height, offset });
+    offset += static_cast<size_t>(width) * height * 4;
+    width = std::max(1u, width / 2);
+    height = std::max(1u, height / 2);
+  }
+  chain.data.resize(offset);
+}
+
+bool MipSimdSupported() {
+#ifdef MIP_SSE
+  return true;
+#else
+  return false;
+#endif
+}
+
+void DownsampleRgba8(const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst, MipFilter filter, bool srgb,
+  JobSystem* jobs, bool use_simd) {
+  uint32_t out_width = std::max(1u, width / 2);
+  uint32_t out_height = std::max(1u, height / 2);
+  Kernel kernel = MakeKernel(filter);
+  const ColorTables& tables = GetColorTables();
+  bool simd = use_simd && MipSimdSupported();
+
+  // each block of destination rows filters the source rows under it horizontally into linear
+  // float, then runs the same taps down the columns. blocks next to each other both filter the
+  // few source rows their taps share instead of synchronizing on them
+  auto downsample_rows = [&](size_t begin, size_t end) {
+    int last_row = static_cast<int>(height) - 1;
+    int row_begin = std::max(static_cast<int>(begin) * 2 + kernel.first_offset, 0);
+    int row_end = std::min(static_cast<int>(end - 1) * 2 + kernel.first_offset + kernel.tap_count - 1, last_row) + 1;
+
+    std::vector<float> decoded((static_cast<size_t>(width) + ROW_PADDING * 2) * 4);
+    std::vector<float> filtered(static_cast<size_t>(row_end - row_begin) * out_width * 4);
+    for (int y = row_begin; y < row_end; y++) {
+      DecodeRow(src + static_cast<size_t>(y) * width * 4, width, srgb, tables, decoded.data());
+      float* out = filtered.data() + static_cast<size_t>(y - row_begin) * out_width * 4;
+#ifdef MIP_SSE
+      if (simd) {
+        FilterRowSse(decoded.data(), kernel, out_width, out);
+        continue;
+      }
+#endif
+      FilterRowScalar(decoded.data(), kernel, out_width, out);
+    }
+
+    const float* rows[MAX_TAPS];
+    for (size_t y = begin; y < end; y++) {
+      for (int k = 0; k < kernel.tap_count; k++) {
+        int source = std::clamp(static_cast<int>(y) * 2 + kernel.first_offset + k, 0, last_row);
+        rows[k] = filtered.data() + static_cast<size_t>(source - row_begin) * out_width * 4;
+      }
+      uint8_t* out = dst + y * out_width * 4;
+#ifdef MIP_SSE
+      if (simd) {
+        FilterColumnsSse(rows, kernel, out_width, srgb, tables, out);
+        continue;
+      }
+#endif
+      FilterColumnsScalar(rows, kernel, out_width, srgb, tables, out);
+    }
+  };
+
+  if (!jobs) {
+    downsample_rows(0, out_height);
+    return;
+  }
+  // every destination row covers two source rows
+  size_t grain = std::max<size_t>(1, DOWNSAMPLE_GRAIN / (static_cast<size_t>(width) * 2));
+  jobs->ParallelFor(out_height, grain, downsample_rows);
+}
+
+void GenerateMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, MipFilter filter, bool srgb,
+  JobSystem* jobs, MipChain& chain, bool use_simd) {
+  LayoutMipChain(width, height, MipLevelCount(width, height), chain);
+  memcpy(chain.data.data(), pixels, static_cast<size_t>(width) * height * 4);
+
+  for (size_t ii = 1; ii < chain.levels.size(); ii++) {
+    const MipLevel& source = chain.levels[ii - 1];
+    DownsampleRgba8(chain.data.data() + source.offset, source.width, source.height,
+      chain.data.data() + chain.levels[ii].offset, filter, srgb, jobs, use_simd);
+  }
+}
+
+bool SupportsLinearBlit(VkPhysicalDevice physical_device, VkFormat format) {
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(physical_device, format, &properties);
+
+  VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+    VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  return (properties.optimalTilingFeatures & needed) == needed;
+}
+
+void RecordMipBlits(VkCommandBuffer command_buffer, VkImage image, uint32_t width, uint32_t height, uint32_t level_count) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+
+  int32_t level_width = static_cast<int32_t>(width);
+  int32_t level_height = static_cast<int32_t>(height);
+
+  for (uint32_t level = 1; level < level_count; level++) {
+    // the level above was just written, by the upload or the previous blit
+    barrier.subresourceRange.baseMipLevel = level - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+      0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    int32_t next_width = std::max(1, level_width / 2);
+    int32_t next_height = std::max(1, level_height / 2);
+
+    VkImageBlit blit{};
+    blit.srcOffsets[0] = { 0, 0, 0 };
+    blit.srcOffsets[1] = { level_width, level_height, 1 };
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.mipLevel = level - 1;
+    blit.srcSubresource.baseArrayLayer = 0;
+    blit.srcSubresource.layerCount = 1;
+    blit.dstOffsets[0] = { 0, 0, 0 };
+    blit.dstOffsets[1] = { next_width, next_height, 1 };
+    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.dstSubresource.mipLevel = level;
+    blit.dstSubresource.baseArrayLayer = 0;
+    blit.dstSubresource.layerCount = 1;
+
+    // sRGB formats are converted to linear before filtering and back after
+    vkCmdBlitImage(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      1, &blit, VK_FILTER_LINEAR);
+
+    // nothing reads the level above again but the fragment shader
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+      0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    level_width = next_width;
+    level_height = next_height;
+  }
+
+  // the last level is only ever written
+  barrier.subresourceRange.baseMipLevel = level_count - 1;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+    0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
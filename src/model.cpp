@@ -1 +1,210 @@
-#include "model.h"
\ No newline at end of file
+#include "model.h"
+#include "mesh_optimizer.h"
+#include <assimp/DefaultIOSystem.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+  // assimp matrices are row major
+  glm::mat4 ToGlm(const aiMatrix4x4& matrix) {
+    glm::mat4 result;
+    for (int row = 0; row < 4; row++) {
+      for (int column = 0; column < 4; column++) {
+        result[column][row] = matrix[row][column];
+      }
+    }
+    return result;
+  }
+
+  // assimp's own file access, remembering every file it opened: the model and whatever it references,
+  // like glTF buffers or obj material libraries
+  class RecordingIOSystem : public Assimp::DefaultIOSystem {
+  public:
+    explicit RecordingIOSystem(std::vector<std::string>& opened) : opened_(opened) {}
+
+    Assimp::IOStream* Open(const char* file, const char* mode = "rb") override {
+      Assimp::IOStream* stream = Assimp::DefaultIOSystem::Open(file, mode);
+      if (stream && std::find(opened_.begin(), opened_.end(), file) == opened_.end()) {
+        opened_.push_back(file);
+      }
+      return stream;
+    }
+
+  private:
+    std::vector<std::string>& opened_;
+  };
+
+}
+
+Model::Model(const char* path, JobSystem* jobs) {
+  std::string path_string = path;
+  size_t slash = path_string.find_last_of("/\\");
+  directory_ = slash == std::string::npos ? "" : path_string.substr(0, slash);
+
+  Assimp::Importer importer;
+  // the importer owns the handler and deletes it
+  importer.SetIOHandler(new RecordingIOSystem(source_files_));
+  // flipped uvs match the tinyobj path, which does 1 - v by hand
+  const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices |
+    aiProcess_FlipUVs | aiProcess_SortByPType);
+
+  if (!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) || !scene->mRootNode) {
+    throw std::runtime_error(std::string("failed to load model: ") + importer.GetErrorString());
+  }
+
+  ProcessMaterials(scene);
+
+  // every mesh is converted and optimized on its own, then packed into the arena
+  std::vector<std::vector<Vertex>> mesh_vertices(scene->mNumMeshes);
+  std::vector<std::vector<uint32_t>> mesh_indices(scene->mNumMeshes);
+
+  auto process = [&](size_t begin, size_t end) {
+    for (size_t ii = begin; ii < end; ii++) {
+      ProcessMesh(scene->mMeshes[ii], mesh_vertices[ii], mesh_indices[ii]);
+    }
+  };
+
+  if (jobs) {
+    jobs->ParallelFor(scene->mNumMeshes, 1, process);
+  }
+  else {
+    process(0, scene->mNumMeshes);
+  }
+
+  meshes_.resize(scene->mNumMeshes);
+  size_t vertex_count = 0;
+  size_t index_count = 0;
+  for (uint32_t ii = 0; ii < scene->mNumMeshes; ii++) {
+    Mesh& mesh = meshes_[ii];
+    mesh.first_index = static_cast<uint32_t>(index_count);
+    mesh.index_count = static_cast<uint32_t>(mesh_indices[ii].size());
+    mesh.vertex_offset = static_cast<int32_t>(vertex_count);
+    mesh.vertex_count = static_cast<uint32_t>(mesh_vertices[ii].size());
+    mesh.material = scene->mMeshes[ii]->mMaterialIndex;
+
+    vertex_count += mesh.vertex_count;
+    index_count += mesh.index_count;
+  }
+
+  vertices_.resize(vertex_count);
+  indices_.resize(index_count);
+
+  auto pack = [&](size_t begin, size_t end) {
+    for (size_t ii = begin; ii < end; ii++) {
+      Mesh& mesh = meshes_[ii];
+      if (mesh.index_count == 0) {
+        continue;
+      }
+      memcpy(vertices_.data() + mesh.vertex_offset, mesh_vertices[ii].data(), mesh.vertex_count * sizeof(Vertex));
+      memcpy(indices_.data() + mesh.first_index, mesh_indices[ii].data(), mesh.index_count * sizeof(uint32_t));
+      ComputeMeshBounds(vertices_, mesh);
+    }
+  };
+
+  if (jobs) {
+    jobs->ParallelFor(meshes_.size(), 16, pack);
+  }
+  else {
+    pack(0, meshes_.size());
+  }
+
+  ProcessNode(scene->mRootNode, glm::mat4(1.0f));
+}
+
+void ComputeMeshBounds(const std::vector<Vertex>& vertices, Mesh& mesh) {
+  mesh.bounds_min = glm::vec3(0.0f);
+  mesh.bounds_max = glm::vec3(0.0f);
+  if (mesh.vertex_count == 0) {
+    return;
+  }
+
+  mesh.bounds_min = vertices[mesh.vertex_offset].pos;
+  mesh.bounds_max = vertices[mesh.vertex_offset].pos;
+  for (uint32_t ii = 1; ii < mesh.vertex_count; ii++) {
+    const glm::vec3& pos = vertices[mesh.vertex_offset + ii].pos;
+    mesh.bounds_min = glm::min(mesh.bounds_min, pos);
+    mesh.bounds_max = glm::max(mesh.bounds_max, pos);
+  }
+}
+
+void Model::ProcessNode(const aiNode* node, const glm::mat4& parent_transform) {
+  glm::mat4 transform = parent_transform * ToGlm(node->mTransformation);
+
+  for (uint32_t ii = 0; ii < node->mNumMeshes; ii++) {
+    uint32_t mesh = node->mMeshes[ii];
+    // point and line meshes are left empty by ProcessMesh
+    if (meshes_[mesh].index_count > 0) {
+      instances_.push_back({ mesh, transform });
+    }
+  }
+
+  for (uint32_t ii = 0; ii < node->mNumChildren; ii++) {
+    ProcessNode(node->mChildren[ii], transform);
+  }
+}
+
+void Model::ProcessMaterials(const aiScene* scene) {
+  materials_.resize(scene->mNumMaterials);
+
+  for (uint32_t ii = 0; ii < scene->mNumMaterials; ii++) {
+    const aiMaterial* source = scene->mMaterials[ii];
+    Material& material = materials_[ii];
+
+    aiString name;
+    if (source->Get(AI_MATKEY_NAME, name) == AI_SUCCESS) {
+      material.name = name.C_Str();
+    }
+
+    aiColor3D diffuse(1.0f, 1.0f, 1.0f);
+    source->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+    material.diffuse_color = glm::vec3(diffuse.r, diffuse.g, diffuse.b);
+
+    aiString texture_path;
+    if (source->GetTextureCount(aiTextureType_DIFFUSE) > 0 &&
+      source->GetTexture(aiTextureType_DIFFUSE, 0, &texture_path) == AI_SUCCESS) {
+      material.diffuse_texture = texture_path.C_Str();
+    }
+  }
+}
+
+void Model::ProcessMesh(const aiMesh* mesh, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+  // SortByPType splits points and lines into their own meshes, there's no pipeline for those
+  if (!(mesh->mPrimitiveTypes & aiPrimitiveType_TRIANGLE)) {
+    return;
+  }
+
+  vertices.resize(mesh->mNumVertices);
+  for (uint32_t ii = 0; ii < mesh->mNumVertices; ii++) {
+    Vertex& vertex = vertices[ii];
+    vertex.pos = glm::vec3(mesh->mVertices[ii].x, mesh->mVertices[ii].y, mesh->mVertices[ii].z);
+
+    if (mesh->HasVertexColors(0)) {
+      const aiColor4D& color = mesh->mColors[0][ii];
+      vertex.color = glm::vec3(color.r, color.g, color.b);
+    }
+    else {
+      vertex.color = glm::vec3(1.0f);
+    }
+
+    if (mesh->HasTextureCoords(0)) {
+      vertex.tex_coord = glm::vec2(mesh->mTextureCoords[0][ii].x, mesh->mTextureCoords[0][ii].y);
+    }
+    else {
+      vertex.tex_coord = glm::vec2(0.0f);
+    }
+  }
+
+  indices.reserve(static_cast<size_t>(mesh->mNumFaces) * 3);
+  for (uint32_t ii = 0; ii < mesh->mNumFaces; ii++) {
+    const aiFace& face = mesh->mFaces[ii];
+    if (face.mNumIndices == 3) {
+      indices.insert(indices.end(), face.mIndices, face.mIndices + 3);
+    }
+  }
+
+  OptimizeVertexCache(indices, vertices.size());
+  OptimizeOverdraw(indices, vertices);
+  OptimizeVertexFetch(vertices, indices);
+}
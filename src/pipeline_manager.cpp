@@ -0,0 +1,382 @@
+#include "pipeline_manager.h"
+#include "shader.h"
+#include "hash.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+  template <typename T>
+  void HashValue(uint64_t& hash, const T& value) {
+    hash = Hash64(&value, sizeof(T), hash);
+  }
+
+  void HashWords(uint64_t& hash, const std::vector<uint32_t>* words) {
+    if (words) {
+      hash = Hash64(words->data(), words->size() * sizeof(uint32_t), hash);
+    }
+    HashValue(hash, words ? words->size() : 0);
+  }
+}
+
+PipelineManager::PipelineManager()
+{
+}
+
+void PipelineManager::Init(const InitData& init, const std::string& cache_path) {
+  init_ = &init;
+  cache_path_ = cache_path;
+  vkGetPhysicalDeviceProperties(init.physical_device, &properties_);
+
+  std::vector<uint8_t> initial_data = LoadCacheData();
+  stats_.loaded_bytes = initial_data.size();
+
+  VkPipelineCacheCreateInfo cache_info{};
+  cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cache_info.initialDataSize = initial_data.size();
+  cache_info.pInitialData = initial_data.empty() ? nullptr : initial_data.data();
+
+  if (vkCreatePipelineCache(init.device, &cache_info, nullptr, &cache_) != VK_SUCCESS) {
+    // the driver may still refuse data that passed our checks, start cold instead of failing
+    cache_info.initialDataSize = 0;
+    cache_info.pInitialData = nullptr;
+    stats_.loaded_bytes = 0;
+
+    if (vkCreatePipelineCache(init.device, &cache_info, nullptr, &cache_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create pipeline cache!");
+    }
+  }
+}
+
+void PipelineManager::Destroy() {
+  if (!init_) {
+    return;
+  }
+
+  if (!cache_path_.empty() && !Save()) {
+    std::cerr << "failed to save pipeline cache to " << cache_path_ << std::endl;
+  }
+
+  for (auto& pipeline : pipelines_) {
+    vkDestroyPipeline(init_->device, pipeline.second, nullptr);
+  }
+  pipelines_.clear();
+
+  vkDestroyPipelineCache(init_->device, cache_, nullptr);
+  cache_ = VK_NULL_HANDLE;
+  init_ = nullptr;
+}
+
+VkPipeline PipelineManager::GetGraphicsPipeline(const GraphicsPipelineDesc& desc) {
+  uint64_t hash = HashDesc(desc);
+
+  auto existing = pipelines_.find(hash);
+  if (existing != pipelines_.end()) {
+    stats_.hits++;
+    return existing->second;
+  }
+
+  auto start_time = std::chrono::high_resolution_clock::now();
+  VkPipeline pipeline = CreateGraphicsPipeline(desc);
+  auto end_time = std::chrono::high_resolution_clock::now();
+
+  stats_.creates++;
+  stats_.create_ms += std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count();
+
+  pipelines_[hash] = pipeline;
+  return pipeline;
+}
+
+VkPipeline PipelineManager::GetComputePipeline(const ComputePipelineDesc& desc) {
+  uint64_t hash = HashDesc(desc);
+
+  auto existing = pipelines_.find(hash);
+  if (existing != pipelines_.end()) {
+    stats_.hits++;
+    return existing->second;
+  }
+
+  auto start_time = std::chrono::high_resolution_clock::now();
+  VkPipeline pipeline = CreateComputePipeline(desc);
+  auto end_time = std::chrono::high_resolution_clock::now();
+
+  stats_.creates++;
+  stats_.create_ms += std::chrono::duration<float, std::chrono::milliseconds::period>(end_time - start_time).count();
+
+  pipelines_[hash] = pipeline;
+  return pipeline;
+}
+
+bool PipelineManager::Save() {
+  size_t size = 0;
+  if (vkGetPipelineCacheData(init_->device, cache_, &size, nullptr) != VK_SUCCESS) {
+    return false;
+  }
+  std::vector<uint8_t> data(size);
+  if (vkGetPipelineCacheData(init_->device, cache_, &size, data.data()) != VK_SUCCESS) {
+    return false;
+  }
+  data.resize(size);
+
+  CacheFileHeader header{};
+  header.magic = MAGIC;
+  header.version = VERSION;
+  header.vendor_id = properties_.vendorID;
+  header.device_id = properties_.deviceID;
+  header.driver_version = properties_.driverVersion;
+  memcpy(header.pipeline_cache_uuid, properties_.pipelineCacheUUID, VK_UUID_SIZE);
+  header.data_size = data.size();
+  header.data_hash = Hash64(data.data(), data.size());
+
+  std::string temp_path = cache_path_ + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+
+    if (!file) {
+      file.close();
+      std::remove(temp_path.c_str());
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temp_path, cache_path_, error);
+  if (error) {
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+void PipelineManager::PrintStats() const {
+  std::cout << "pipelines: " << stats_.creates << " created in " << stats_.create_ms << " ms, " << stats_.hits
+    << " reused, " << (stats_.loaded_bytes > 0 ? "warm" : "cold") << " driver cache ("
+    << stats_.loaded_bytes << " bytes loaded)" << std::endl;
+}
+
+uint64_t PipelineManager::HashDesc(const GraphicsPipelineDesc& desc) {
+  uint64_t hash = 0;
+  HashWords(hash, desc.vertex_spirv);
+  HashWords(hash, desc.fragment_spirv);
+
+  VkVertexInputBindingDescription binding = desc.vertex_layout.GetBindingDescription();
+  HashValue(hash, binding);
+  for (const auto& attribute : desc.vertex_layout.GetAttributeDescriptions()) {
+    HashValue(hash, attribute);
+  }
+  for (const auto& instance_binding : desc.instance_bindings) {
+    HashValue(hash, instance_binding);
+  }
+  for (const auto& attribute : desc.instance_attributes) {
+    HashValue(hash, attribute);
+  }
+  HashValue(hash, desc.instance_bindings.size());
+  HashValue(hash, desc.instance_attributes.size());
+
+  HashValue(hash, desc.topology);
+  HashValue(hash, desc.polygon_mode);
+  HashValue(hash, desc.cull_mode);
+  HashValue(hash, desc.front_face);
+  HashValue(hash, desc.depth_test);
+  HashValue(hash, desc.depth_write);
+  HashValue(hash, desc.depth_compare);
+  HashValue(hash, desc.alpha_blend);
+  HashValue(hash, desc.layout);
+
+  // render pass compatibility rather than the handle
+  HashValue(hash, desc.subpass);
+  for (VkFormat format : desc.color_formats) {
+    HashValue(hash, format);
+  }
+  HashValue(hash, desc.color_formats.size());
+  HashValue(hash, desc.depth_format);
+  HashValue(hash, desc.samples);
+  return hash;
+}
+
+uint64_t PipelineManager::HashDesc(const ComputePipelineDesc& desc) {
+  // shares the map with the graphics pipelines, the bind point keeps the two apart
+  uint64_t hash = 0;
+  HashValue(hash, VK_PIPELINE_BIND_POINT_COMPUTE);
+  HashWords(hash, desc.spirv);
+  HashValue(hash, desc.layout);
+  return hash;
+}
+
+std::vector<uint8_t> PipelineManager::LoadCacheData() const {
+  if (cache_path_.empty()) {
+    return {};
+  }
+
+  std::ifstream file(cache_path_, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return {};
+  }
+
+  size_t file_size = static_cast<size_t>(file.tellg());
+  if (file_size < sizeof(CacheFileHeader)) {
+    return {};
+  }
+  file.seekg(0);
+
+  CacheFileHeader header{};
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+  // a driver update or a different GPU invalidates the blob, feeding it in anyway is at best wasted work
+  if (!file || header.magic != MAGIC || header.version != VERSION ||
+    header.vendor_id != properties_.vendorID || header.device_id != properties_.deviceID ||
+    header.driver_version != properties_.driverVersion ||
+    memcmp(header.pipeline_cache_uuid, properties_.pipelineCacheUUID, VK_UUID_SIZE) != 0 ||
+    header.data_size != file_size - sizeof(CacheFileHeader)) {
+    return {};
+  }
+
+  std::vector<uint8_t> data(header.data_size);
+  file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+  if (!file || Hash64(data.data(), data.size()) != header.data_hash) {
+    return {};
+  }
+
+  // the driver's own header has to agree as well
+  VkPipelineCacheHeaderVersionOne driver_header{};
+  if (data.size() < sizeof(driver_header)) {
+    return {};
+  }
+  memcpy(&driver_header, data.data(), sizeof(driver_header));
+  if (driver_header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+    driver_header.headerSize < sizeof(driver_header) || driver_header.headerSize > data.size() ||
+    driver_header.vendorID != properties_.vendorID || driver_header.deviceID != properties_.deviceID ||
+    memcmp(driver_header.pipelineCacheUUID, properties_.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+    return {};
+  }
+
+  return data;
+}
+
+VkPipeline PipelineManager::CreateGraphicsPipeline(const GraphicsPipelineDesc& desc) {
+  Shader vert_shader(*desc.vertex_spirv, "main", ShaderType::VERTEX_SHADER, *init_);
+  Shader frag_shader(*desc.fragment_spirv, "main", ShaderType::FRAGMENT_SHADER, *init_);
+
+  VkPipelineShaderStageCreateInfo shader_stages[] = { vert_shader.GetInfo(), frag_shader.GetInfo() };
+
+  std::vector<VkVertexInputBindingDescription> binding_descriptions = { desc.vertex_layout.GetBindingDescription() };
+  binding_descriptions.insert(binding_descriptions.end(), desc.instance_bindings.begin(), desc.instance_bindings.end());
+  auto attribute_descriptions = desc.vertex_layout.GetAttributeDescriptions();
+  attribute_descriptions.insert(attribute_descriptions.end(), desc.instance_attributes.begin(), desc.instance_attributes.end());
+
+  VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+  vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(binding_descriptions.size());
+  vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribute_descriptions.size());
+  vertex_input_info.pVertexBindingDescriptions = binding_descriptions.data();
+  vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions.data();
+
+  VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+  input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  input_assembly.topology = desc.topology;
+  input_assembly.primitiveRestartEnable = VK_FALSE;
+
+  // set with vkCmdSetViewport / vkCmdSetScissor, so a resize doesn't need a new pipeline
+  VkPipelineViewportStateCreateInfo viewport_state{};
+  viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewport_state.viewportCount = 1;
+  viewport_state.scissorCount = 1;
+
+  VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+  VkPipelineDynamicStateCreateInfo dynamic_state{};
+  dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamic_state.dynamicStateCount = 2;
+  dynamic_state.pDynamicStates = dynamic_states;
+
+  VkPipelineRasterizationStateCreateInfo rasterizer{};
+  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizer.depthClampEnable = VK_FALSE;
+  rasterizer.rasterizerDiscardEnable = VK_FALSE;
+  rasterizer.polygonMode = desc.polygon_mode;
+  rasterizer.lineWidth = 1.0f;
+  rasterizer.cullMode = desc.cull_mode;
+  rasterizer.frontFace = desc.front_face;
+  rasterizer.depthBiasEnable = VK_FALSE;
+
+  VkPipelineMultisampleStateCreateInfo multisampling{};
+  multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampling.sampleShadingEnable = VK_FALSE;
+  multisampling.rasterizationSamples = desc.samples;
+
+  VkPipelineColorBlendAttachmentState blend_attachment{};
+  blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  blend_attachment.blendEnable = desc.alpha_blend ? VK_TRUE : VK_FALSE;
+  blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+  blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+  blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+  blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+  std::vector<VkPipelineColorBlendAttachmentState> blend_attachments(desc.color_formats.size(), blend_attachment);
+
+  VkPipelineColorBlendStateCreateInfo color_blending{};
+  color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  color_blending.logicOpEnable = VK_FALSE;
+  color_blending.logicOp = VK_LOGIC_OP_COPY;
+  color_blending.attachmentCount = static_cast<uint32_t>(blend_attachments.size());
+  color_blending.pAttachments = blend_attachments.data();
+
+  VkPipelineDepthStencilStateCreateInfo depth_stencil{};
+  depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depth_stencil.depthTestEnable = desc.depth_test ? VK_TRUE : VK_FALSE;
+  depth_stencil.depthWriteEnable = desc.depth_write ? VK_TRUE : VK_FALSE;
+  depth_stencil.depthCompareOp = desc.depth_compare;
+  depth_stencil.depthBoundsTestEnable = VK_FALSE;
+  depth_stencil.minDepthBounds = 0.0f;
+  depth_stencil.maxDepthBounds = 1.0f;
+  depth_stencil.stencilTestEnable = VK_FALSE;
+
+  VkGraphicsPipelineCreateInfo pipeline_info{};
+  pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipeline_info.stageCount = 2;
+  pipeline_info.pStages = shader_stages;
+  pipeline_info.pVertexInputState = &vertex_input_info;
+  pipeline_info.pInputAssemblyState = &input_assembly;
+  pipeline_info.pViewportState = &viewport_state;
+  pipeline_info.pRasterizationState = &rasterizer;
+  pipeline_info.pMultisampleState = &multisampling;
+  pipeline_info.pDepthStencilState = desc.depth_format != VK_FORMAT_UNDEFINED ? &depth_stencil : nullptr;
+  pipeline_info.pColorBlendState = &color_blending;
+  pipeline_info.pDynamicState = &dynamic_state;
+  pipeline_info.layout = desc.layout;
+  pipeline_info.renderPass = desc.render_pass;
+  pipeline_info.subpass = desc.subpass;
+  pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+
+  VkPipeline pipeline;
+  if (vkCreateGraphicsPipelines(init_->device, cache_, 1, &pipeline_info, nullptr, &pipeline) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create graphics pipeline!");
+  }
+  return pipeline;
+}
+
+VkPipeline PipelineManager::CreateComputePipeline(const ComputePipelineDesc& desc) {
+  Shader compute_shader(*desc.spirv, "main", ShaderType::COMPUTE_SHADER, *init_);
+
+  VkComputePipelineCreateInfo pipeline_info{};
+  pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipeline_info.stage = compute_shader.GetInfo();
+  pipeline_info.layout = desc.layout;
+  pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+
+  VkPipeline pipeline;
+  if (vkCreateComputePipelines(init_->device, cache_, 1, &pipeline_info, nullptr, &pipeline) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create compute pipeline!");
+  }
+  return pipeline;
+}
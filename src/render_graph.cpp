@@ -0,0 +1,620 @@
+#include "render_graph.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+  // only these make sense as the source access of a barrier, reads have nothing to make available
+  const VkAccessFlags2KHR WRITE_ACCESS = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR |
+    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR | VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+
+  bool LifetimesOverlap(int first_a, int last_a, int first_b, int last_b) {
+    return !(last_a < first_b || last_b < first_a);
+  }
+}
+
+RenderGraph::RenderGraph()
+{
+}
+
+RenderGraph::~RenderGraph() {
+  Destroy();
+}
+
+void RenderGraph::Init(const InitData& init, PFN_vkCmdPipelineBarrier2KHR pipeline_barrier2) {
+  init_ = &init;
+  pipeline_barrier2_ = pipeline_barrier2;
+}
+
+void RenderGraph::Destroy() {
+  if (!init_) {
+    return;
+  }
+  Reset();
+  init_ = nullptr;
+}
+
+void RenderGraph::Reset() {
+  DestroyTransients();
+  resources_.clear();
+  passes_.clear();
+  barriers_.clear();
+  final_barrier_begin_ = 0;
+  compiled_ = false;
+  stats_ = RenderGraphStats{};
+}
+
+uint32_t RenderGraph::ImportImage(const std::string& name, VkFormat format, VkImageLayout initial_layout,
+  VkImageLayout final_layout) {
+  Resource resource;
+  resource.name = name;
+  resource.imported = true;
+  resource.format = format;
+  resource.initial_layout = initial_layout;
+  resource.final_layout = final_layout;
+  resources_.push_back(resource);
+  compiled_ = false;
+  return static_cast<uint32_t>(resources_.size() - 1);
+}
+
+uint32_t RenderGraph::ImportBuffer(const std::string& name) {
+  Resource resource;
+  resource.name = name;
+  resource.is_image = false;
+  resource.imported = true;
+  resources_.push_back(resource);
+  compiled_ = false;
+  return static_cast<uint32_t>(resources_.size() - 1);
+}
+
+uint32_t RenderGraph::CreateImage(const std::string& name, const TransientImageDesc& desc) {
+  Resource resource;
+  resource.name = name;
+  resource.format = desc.format;
+  resource.extent = desc.extent;
+  resources_.push_back(resource);
+  compiled_ = false;
+  return static_cast<uint32_t>(resources_.size() - 1);
+}
+
+void RenderGraph::SetImportedImage(uint32_t resource, VkImage image) {
+  resources_[resource].image = image;
+}
+
+void RenderGraph::SetImportedBuffer(uint32_t resource, VkBuffer buffer) {
+  resources_[resource].buffer = buffer;
+}
+
+uint32_t RenderGraph::AddPass(const std::string& name, RecordPassFunc record) {
+  Pass pass;
+  pass.name = name;
+  pass.record = std::move(record);
+  passes_.push_back(std::move(pass));
+  compiled_ = false;
+  return static_cast<uint32_t>(passes_.size() - 1);
+}
+
+void RenderGraph::UseResource(uint32_t pass, uint32_t resource, ResourceUse use) {
+  // barriers within one batch aren't ordered against each other, so a second use couldn't get its own
+  for (const auto& existing : passes_[pass].uses) {
+    if (existing.resource == resource) {
+      throw std::runtime_error("render graph pass " + passes_[pass].name + " uses " + resources_[resource].name + " twice");
+    }
+  }
+  passes_[pass].uses.push_back({ resource, use });
+  compiled_ = false;
+}
+
+RenderGraph::UseInfo RenderGraph::GetUseInfo(ResourceUse use) {
+  switch (use) {
+  case ResourceUse::COLOR_ATTACHMENT:
+    return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+      VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR,
+      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true };
+  case ResourceUse::DEPTH_ATTACHMENT:
+    return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR,
+      VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR,
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true };
+  case ResourceUse::SAMPLED:
+    return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, false };
+  case ResourceUse::STORAGE_READ:
+    return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR,
+      VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, false };
+  case ResourceUse::STORAGE_WRITE:
+    return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR,
+      VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, true };
+  case ResourceUse::INDIRECT_READ:
+    return { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR,
+      VK_IMAGE_LAYOUT_UNDEFINED, 0, false };
+  case ResourceUse::TRANSFER_SRC:
+    return { VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, false };
+  case ResourceUse::TRANSFER_DST:
+    return { VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT, true };
+  }
+  throw std::invalid_argument("unknown resource use");
+}
+
+VkImageAspectFlags RenderGraph::GetAspect(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_D16_UNORM:
+  case VK_FORMAT_X8_D24_UNORM_PACK32:
+  case VK_FORMAT_D32_SFLOAT:
+    return VK_IMAGE_ASPECT_DEPTH_BIT;
+  case VK_FORMAT_D16_UNORM_S8_UINT:
+  case VK_FORMAT_D24_UNORM_S8_UINT:
+  case VK_FORMAT_D32_SFLOAT_S8_UINT:
+    return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+  case VK_FORMAT_S8_UINT:
+    return VK_IMAGE_ASPECT_STENCIL_BIT;
+  default:
+    return VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+}
+
+void RenderGraph::Compile() {
+  DestroyTransients();
+
+  CullPasses();
+  ComputeLifetimes();
+  CreateTransients();
+  ComputeBarriers();
+
+  stats_.pass_count = static_cast<uint32_t>(passes_.size());
+  stats_.culled_pass_count = 0;
+  stats_.barrier_batch_count = 0;
+  for (const auto& pass : passes_) {
+    stats_.culled_pass_count += pass.culled ? 1 : 0;
+    stats_.barrier_batch_count += pass.barrier_end > pass.barrier_begin ? 1 : 0;
+  }
+  stats_.barrier_batch_count += barriers_.size() > final_barrier_begin_ ? 1 : 0;
+  stats_.barrier_count = static_cast<uint32_t>(barriers_.size());
+
+  compiled_ = true;
+}
+
+// walks back from the imported resources, a pass is kept if anything it writes is read by a kept pass
+// or leaves the graph. everything a kept pass touches stays live, attachments are read as well as written
+void RenderGraph::CullPasses() {
+  std::vector<uint8_t> live(resources_.size(), 0);
+  for (size_t ii = 0; ii < resources_.size(); ii++) {
+    live[ii] = resources_[ii].imported ? 1 : 0;
+  }
+
+  for (size_t ii = passes_.size(); ii-- > 0;) {
+    Pass& pass = passes_[ii];
+    bool needed = false;
+    for (const auto& use : pass.uses) {
+      needed = needed || (GetUseInfo(use.use).write && live[use.resource]);
+    }
+
+    pass.culled = !needed;
+    if (needed) {
+      for (const auto& use : pass.uses) {
+        live[use.resource] = 1;
+      }
+    }
+  }
+}
+
+void RenderGraph::ComputeLifetimes() {
+  for (auto& resource : resources_) {
+    resource.first_pass = -1;
+    resource.last_pass = -1;
+    resource.usage = 0;
+    resource.all_stages = 0;
+    resource.all_write_access = 0;
+  }
+
+  for (size_t ii = 0; ii < passes_.size(); ii++) {
+    if (passes_[ii].culled) {
+      continue;
+    }
+
+    for (const auto& use : passes_[ii].uses) {
+      Resource& resource = resources_[use.resource];
+      UseInfo info = GetUseInfo(use.use);
+
+      if (resource.is_image && use.use == ResourceUse::INDIRECT_READ) {
+        throw std::runtime_error("render graph image " + resource.name + " can't be read as indirect commands");
+      }
+      if (!resource.is_image && (use.use == ResourceUse::COLOR_ATTACHMENT || use.use == ResourceUse::DEPTH_ATTACHMENT ||
+        use.use == ResourceUse::SAMPLED)) {
+        throw std::runtime_error("render graph buffer " + resource.name + " can't be used as an image");
+      }
+
+      if (resource.first_pass < 0) {
+        resource.first_pass = static_cast<int>(ii);
+      }
+      resource.last_pass = static_cast<int>(ii);
+      resource.usage |= info.image_usage;
+      resource.all_stages |= info.stages;
+      if (info.write) {
+        resource.all_write_access |= info.access & WRITE_ACCESS;
+      }
+    }
+  }
+}
+
+// biggest first, each image goes into the first slot whose images are all dead while it is alive
+void RenderGraph::CreateTransients() {
+  std::vector<uint32_t> transients;
+  std::vector<VkMemoryRequirements> requirements(resources_.size());
+
+  for (uint32_t ii = 0; ii < resources_.size(); ii++) {
+    Resource& resource = resources_[ii];
+    if (resource.imported || !resource.is_image || resource.first_pass < 0) {
+      continue;
+    }
+
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.extent = { resource.extent.width, resource.extent.height, 1 };
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.format = resource.format;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_info.usage = resource.usage;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+
+    if (vkCreateImage(init_->device, &image_info, nullptr, &resource.image) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create render graph image " + resource.name);
+    }
+    vkGetImageMemoryRequirements(init_->device, resource.image, &requirements[ii]);
+    transients.push_back(ii);
+  }
+
+  std::sort(transients.begin(), transients.end(), [&](uint32_t a, uint32_t b) {
+    return requirements[a].size > requirements[b].size;
+  });
+
+  stats_.transient_count = static_cast<uint32_t>(transients.size());
+  stats_.transient_bytes = 0;
+  for (uint32_t index : transients) {
+    Resource& resource = resources_[index];
+    const VkMemoryRequirements& image_requirements = requirements[index];
+    stats_.transient_bytes += image_requirements.size;
+
+    size_t slot_index = 0;
+    for (; slot_index < memory_slots_.size(); slot_index++) {
+      const MemorySlot& slot = memory_slots_[slot_index];
+      if ((slot.requirements.memoryTypeBits & image_requirements.memoryTypeBits) == 0) {
+        continue;
+      }
+
+      bool overlaps = false;
+      for (uint32_t other : slot.resources) {
+        overlaps = overlaps || LifetimesOverlap(resource.first_pass, resource.last_pass,
+          resources_[other].first_pass, resources_[other].last_pass);
+      }
+      if (!overlaps) {
+        break;
+      }
+    }
+
+    if (slot_index == memory_slots_.size()) {
+      memory_slots_.emplace_back();
+      memory_slots_.back().requirements = image_requirements;
+    }
+
+    MemorySlot& slot = memory_slots_[slot_index];
+    slot.requirements.size = std::max(slot.requirements.size, image_requirements.size);
+    slot.requirements.alignment = std::max(slot.requirements.alignment, image_requirements.alignment);
+    slot.requirements.memoryTypeBits &= image_requirements.memoryTypeBits;
+    slot.resources.push_back(index);
+    resource.memory_slot = static_cast<uint32_t>(slot_index);
+  }
+
+  stats_.transient_allocation_count = static_cast<uint32_t>(memory_slots_.size());
+  stats_.aliased_bytes = 0;
+  for (auto& slot : memory_slots_) {
+    slot.allocation = init_->allocator->Allocate(slot.requirements, MemoryUsage::GPU_ONLY, false);
+    stats_.aliased_bytes += slot.requirements.size;
+
+    for (uint32_t index : slot.resources) {
+      Resource& resource = resources_[index];
+      vkBindImageMemory(init_->device, resource.image, slot.allocation.memory, slot.allocation.offset);
+
+      VkImageViewCreateInfo view_info{};
+      view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      view_info.image = resource.image;
+      view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      view_info.format = resource.format;
+      view_info.subresourceRange.aspectMask = GetAspect(resource.format);
+      view_info.subresourceRange.levelCount = 1;
+      view_info.subresourceRange.layerCount = 1;
+
+      if (vkCreateImageView(init_->device, &view_info, nullptr, &resource.view) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create render graph image view " + resource.name);
+      }
+    }
+  }
+}
+
+void RenderGraph::DestroyTransients() {
+  if (!init_) {
+    return;
+  }
+
+  for (auto& resource : resources_) {
+    if (resource.imported) {
+      continue;
+    }
+    vkDestroyImageView(init_->device, resource.view, nullptr);
+    vkDestroyImage(init_->device, resource.image, nullptr);
+    resource.view = VK_NULL_HANDLE;
+    resource.image = VK_NULL_HANDLE;
+  }
+
+  for (auto& slot : memory_slots_) {
+    init_->allocator->Free(slot.allocation);
+  }
+  memory_slots_.clear();
+  compiled_ = false;
+}
+
+// every use is checked against what happened to the resource since its last write: a write waits for
+// the reads since then (or the write itself), a read only waits when it needs a new layout or the write
+// hasn't been made visible to its stage yet
+void RenderGraph::ComputeBarriers() {
+  struct State {
+    bool touched = false;
+    VkPipelineStageFlags2KHR write_stages = 0;
+    VkAccessFlags2KHR write_access = 0;
+    VkPipelineStageFlags2KHR read_stages = 0;
+    // the last write is available to these
+    VkPipelineStageFlags2KHR visible_stages = 0;
+    VkAccessFlags2KHR visible_access = 0;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  };
+  std::vector<State> states(resources_.size());
+
+  // the first use of a transient waits for whatever used its memory last, which is the previous frame's
+  // use of an image in the same slot
+  std::vector<VkPipelineStageFlags2KHR> slot_stages(memory_slots_.size(), 0);
+  std::vector<VkAccessFlags2KHR> slot_write_access(memory_slots_.size(), 0);
+  for (size_t ii = 0; ii < memory_slots_.size(); ii++) {
+    for (uint32_t index : memory_slots_[ii].resources) {
+      slot_stages[ii] |= resources_[index].all_stages;
+      slot_write_access[ii] |= resources_[index].all_write_access;
+    }
+  }
+
+  barriers_.clear();
+  for (auto& pass : passes_) {
+    pass.barrier_begin = barriers_.size();
+    pass.barrier_end = barriers_.size();
+    if (pass.culled) {
+      continue;
+    }
+
+    for (const auto& use : pass.uses) {
+      const Resource& resource = resources_[use.resource];
+      State& state = states[use.resource];
+      UseInfo info = GetUseInfo(use.use);
+      VkImageLayout layout = resource.is_image ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+
+      Barrier barrier{ use.resource, 0, 0, info.stages, info.access, state.layout, layout };
+      bool needed = false;
+
+      if (!state.touched) {
+        if (!resource.imported) {
+          barrier.src_stages = slot_stages[resource.memory_slot];
+          barrier.src_access = slot_write_access[resource.memory_slot];
+          barrier.old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+          needed = true;
+        }
+        else if (resource.is_image && resource.initial_layout != layout) {
+          // same stage on both sides so it chains with whatever handed the image over (the acquire semaphore)
+          barrier.src_stages = info.stages;
+          barrier.old_layout = resource.initial_layout;
+          needed = true;
+        }
+      }
+      else if (info.write) {
+        if (state.read_stages) {
+          barrier.src_stages = state.read_stages;
+        }
+        else {
+          barrier.src_stages = state.write_stages;
+          barrier.src_access = state.write_access;
+        }
+        needed = true;
+      }
+      else if (resource.is_image && layout != state.layout) {
+        barrier.src_stages = state.write_stages | state.read_stages;
+        barrier.src_access = state.write_access;
+        needed = true;
+      }
+      else if (state.write_stages && ((info.stages & ~state.visible_stages) || (info.access & ~state.visible_access))) {
+        barrier.src_stages = state.write_stages | state.visible_stages;
+        barrier.src_access = state.write_access;
+        needed = true;
+      }
+
+      if (needed) {
+        barriers_.push_back(barrier);
+      }
+
+      state.touched = true;
+      state.layout = layout;
+      if (info.write) {
+        state.write_stages = info.stages;
+        state.write_access = info.access & WRITE_ACCESS;
+        state.read_stages = 0;
+        state.visible_stages = info.stages;
+        state.visible_access = info.access;
+      }
+      else {
+        state.read_stages |= info.stages;
+        if (needed) {
+          state.visible_stages |= info.stages;
+          state.visible_access |= info.access;
+        }
+      }
+    }
+    pass.barrier_end = barriers_.size();
+  }
+
+  final_barrier_begin_ = barriers_.size();
+  for (uint32_t ii = 0; ii < resources_.size(); ii++) {
+    const Resource& resource = resources_[ii];
+    const State& state = states[ii];
+    if (!resource.imported || !resource.is_image || !state.touched ||
+      resource.final_layout == VK_IMAGE_LAYOUT_UNDEFINED || resource.final_layout == state.layout) {
+      continue;
+    }
+    // nothing in the graph reads it again, whoever takes the image over waits on the frame's semaphore or fence
+    barriers_.push_back({ ii, state.write_stages | state.read_stages, state.write_access,
+      VK_PIPELINE_STAGE_2_NONE_KHR, 0, state.layout, resource.final_layout });
+  }
+}
+
+void RenderGraph::Execute(VkCommandBuffer command_buffer) {
+  if (!compiled_) {
+    throw std::runtime_error("render graph has to be compiled before it is executed");
+  }
+
+  for (const auto& pass : passes_) {
+    if (pass.culled) {
+      continue;
+    }
+    RecordBarriers(command_buffer, pass.barrier_begin, pass.barrier_end);
+    pass.record(command_buffer);
+  }
+  RecordBarriers(command_buffer, final_barrier_begin_, barriers_.size());
+}
+
+void RenderGraph::RecordBarriers(VkCommandBuffer command_buffer, size_t begin, size_t end) {
+  if (begin == end) {
+    return;
+  }
+
+  for (size_t ii = begin; ii < end; ii++) {
+    const Resource& resource = resources_[barriers_[ii].resource];
+    if (resource.is_image ? resource.image == VK_NULL_HANDLE : resource.buffer == VK_NULL_HANDLE) {
+      throw std::runtime_error("render graph resource " + resource.name + " has no handle this frame");
+    }
+  }
+
+  if (pipeline_barrier2_) {
+    image_barriers2_.clear();
+    buffer_barriers2_.clear();
+
+    for (size_t ii = begin; ii < end; ii++) {
+      const Barrier& barrier = barriers_[ii];
+      const Resource& resource = resources_[barrier.resource];
+
+      if (resource.is_image) {
+        VkImageMemoryBarrier2KHR image_barrier{};
+        image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+        image_barrier.srcStageMask = barrier.src_stages;
+        image_barrier.srcAccessMask = barrier.src_access;
+        image_barrier.dstStageMask = barrier.dst_stages;
+        image_barrier.dstAccessMask = barrier.dst_access;
+        image_barrier.oldLayout = barrier.old_layout;
+        image_barrier.newLayout = barrier.new_layout;
+        image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        image_barrier.image = resource.image;
+        image_barrier.subresourceRange = { GetAspect(resource.format), 0, 1, 0, 1 };
+        image_barriers2_.push_back(image_barrier);
+      }
+      else {
+        VkBufferMemoryBarrier2KHR buffer_barrier{};
+        buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR;
+        buffer_barrier.srcStageMask = barrier.src_stages;
+        buffer_barrier.srcAccessMask = barrier.src_access;
+        buffer_barrier.dstStageMask = barrier.dst_stages;
+        buffer_barrier.dstAccessMask = barrier.dst_access;
+        buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        buffer_barrier.buffer = resource.buffer;
+        buffer_barrier.size = VK_WHOLE_SIZE;
+        buffer_barriers2_.push_back(buffer_barrier);
+      }
+    }
+
+    VkDependencyInfoKHR dependency_info{};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+    dependency_info.imageMemoryBarrierCount = static_cast<uint32_t>(image_barriers2_.size());
+    dependency_info.pImageMemoryBarriers = image_barriers2_.data();
+    dependency_info.bufferMemoryBarrierCount = static_cast<uint32_t>(buffer_barriers2_.size());
+    dependency_info.pBufferMemoryBarriers = buffer_barriers2_.data();
+    pipeline_barrier2_(command_buffer, &dependency_info);
+    return;
+  }
+
+  // one pair of stage masks for the whole batch. the legacy stage and access bits have the same
+  // values in the 2 flags, so they only need narrowing
+  VkPipelineStageFlags src_stages = 0;
+  VkPipelineStageFlags dst_stages = 0;
+  image_barriers_.clear();
+  buffer_barriers_.clear();
+
+  for (size_t ii = begin; ii < end; ii++) {
+    const Barrier& barrier = barriers_[ii];
+    const Resource& resource = resources_[barrier.resource];
+    src_stages |= static_cast<VkPipelineStageFlags>(barrier.src_stages);
+    dst_stages |= static_cast<VkPipelineStageFlags>(barrier.dst_stages);
+
+    if (resource.is_image) {
+      VkImageMemoryBarrier image_barrier{};
+      image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+      image_barrier.srcAccessMask = static_cast<VkAccessFlags>(barrier.src_access);
+      image_barrier.dstAccessMask = static_cast<VkAccessFlags>(barrier.dst_access);
+      image_barrier.oldLayout = barrier.old_layout;
+      image_barrier.newLayout = barrier.new_layout;
+      image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      image_barrier.image = resource.image;
+      image_barrier.subresourceRange = { GetAspect(resource.format), 0, 1, 0, 1 };
+      image_barriers_.push_back(image_barrier);
+    }
+    else {
+      VkBufferMemoryBarrier buffer_barrier{};
+      buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+      buffer_barrier.srcAccessMask = static_cast<VkAccessFlags>(barrier.src_access);
+      buffer_barrier.dstAccessMask = static_cast<VkAccessFlags>(barrier.dst_access);
+      buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      buffer_barrier.buffer = resource.buffer;
+      buffer_barrier.size = VK_WHOLE_SIZE;
+      buffer_barriers_.push_back(buffer_barrier);
+    }
+  }
+
+  // no stages is a valid scope in synchronization2 only
+  if (src_stages == 0) {
+    src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  }
+  if (dst_stages == 0) {
+    dst_stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+  }
+
+  vkCmdPipelineBarrier(command_buffer, src_stages, dst_stages, 0, 0, nullptr,
+    static_cast<uint32_t>(buffer_barriers_.size()), buffer_barriers_.data(),
+    static_cast<uint32_t>(image_barriers_.size()), image_barriers_.data());
+}
+
+VkImage RenderGraph::GetImage(uint32_t resource) const {
+  return resources_[resource].image;
+}
+
+VkImageView RenderGraph::GetImageView(uint32_t resource) const {
+  return resources_[resource].view;
+}
+
+void RenderGraph::PrintStats() const {
+  std::cout << "render graph: " << stats_.pass_count << " passes (" << stats_.culled_pass_count << " culled), "
+    << stats_.transient_count << " transient image(s) in " << stats_.transient_allocation_count << " allocation(s), "
+    << stats_.aliased_bytes / (1024.0f * 1024.0f) << " MB aliased vs "
+    << stats_.transient_bytes / (1024.0f * 1024.0f) << " MB separate, "
+    << stats_.barrier_count << " barrier(s) in " << stats_.barrier_batch_count << " batch(es) per frame, "
+    << (UsesSync2() ? "synchronization2" : "vkCmdPipelineBarrier") << std::endl;
+}
@@ -1,13 +1,80 @@
 #include "shader.h" 
+#include <memory>
+
+namespace {
+  // resolves #include relative to the directory of the file asking for it
+  class FileIncluder : public shaderc::CompileOptions::IncluderInterface {
+  public:
+    shaderc_include_result* GetInclude(const char* requested_source, shaderc_include_type type,
+      const char* requesting_source, size_t include_depth) override {
+      std::string requesting = requesting_source;
+      size_t slash = requesting.find_last_of("/\\");
+
+      auto* include = new Include();
+      include->name = (slash == std::string::npos ? "" : requesting.substr(0, slash + 1)) + requested_source;
+
+      std::ifstream file(include->name);
+      if (file) {
+        std::stringstream sstream;
+        sstream << file.rdbuf();
+        include->content = sstream.str();
+      }
+      else {
+        // an empty source name tells shaderc the include failed, the content is the message
+        include->content = "could not open " + include->name;
+        include->name.clear();
+      }
+
+      include->result.source_name = include->name.c_str();
+      include->result.source_name_length = include->name.size();
+      include->result.content = include->content.c_str();
+      include->result.content_length = include->content.size();
+      include->result.user_data = include;
+      return &include->result;
+    }
+
+    void ReleaseInclude(shaderc_include_result* data) override {
+      delete static_cast<Include*>(data->user_data);
+    }
+
+  private:
+    struct Include {
+      std::string name;
+      std::string content;
+      shaderc_include_result result;
+    };
+  };
+}
+
+shaderc_shader_kind GetShaderKind(ShaderType type) {
+  switch (type) {
+  case ShaderType::VERTEX_SHADER:
+    return shaderc_glsl_vertex_shader;
+  case ShaderType::FRAGMENT_SHADER:
+    return shaderc_glsl_fragment_shader;
+  default:
+    return shaderc_glsl_compute_shader;
+  }
+}
+
+VkShaderStageFlagBits GetShaderStage(ShaderType type) {
+  switch (type) {
+  case ShaderType::VERTEX_SHADER:
+    return VK_SHADER_STAGE_VERTEX_BIT;
+  case ShaderType::FRAGMENT_SHADER:
+    return VK_SHADER_STAGE_FRAGMENT_BIT;
+  default:
+    return VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+}
 
 std::string ReadFile(const char* filepath) {
-  std::ifstream file;
+  std::ifstream file(filepath);
 
   if (file.fail()) {
-    throw std::runtime_error("could not open " + *filepath);
+    throw std::runtime_error(std::string("could not open ") + filepath);
   }
 
-  file.open(filepath);
   std::stringstream sstream;
   sstream << file.rdbuf();
   file.close();
@@ -17,20 +84,35 @@ std::string ReadFile(const char* filepath) {
 }
 
 std::vector<uint32_t> CompileShader(const std::string& source_name, shaderc_shader_kind shader_kind,
-  const std::string& source, bool optimize = false) {
+  const std::string& source, const std::vector<std::string>& defines, bool optimize,
+  shaderc::Compiler* compiler, std::string* error) {
+
+  shaderc::Compiler local_compiler;
+  if (!compiler) {
+    compiler = &local_compiler;
+  }
 
-  shaderc::Compiler compiler;
   shaderc::CompileOptions options;
+  options.SetIncluder(std::make_unique<FileIncluder>());
+
+  for (const auto& define : defines) {
+    options.AddMacroDefinition(define);
+  }
 
   if (optimize) {
     options.SetOptimizationLevel(shaderc_optimization_level_size);
   }
 
   shaderc::SpvCompilationResult module =
-    compiler.CompileGlslToSpv(source, shader_kind, source_name.c_str(), options);
+    compiler->CompileGlslToSpv(source, shader_kind, source_name.c_str(), options);
 
   if (module.GetCompilationStatus() != shaderc_compilation_status_success) {
-    std::cerr << module.GetErrorMessage() << std::endl;
+    if (error) {
+      *error = module.GetErrorMessage();
+    }
+    else {
+      std::cerr << module.GetErrorMessage() << std::endl;
+    }
     return std::vector<uint32_t>();
   }
 
@@ -52,28 +134,38 @@ VkShaderModule CreateShaderModule(const std::vector<uint32_t>& code, const InitD
 }
 
 Shader::Shader(const char* file_name, const char* entry_name, 
-  ShaderType type, const InitData& init) : init_(init) {
+  ShaderType type, const InitData& init, const std::vector<std::string>& defines) : init_(init) {
 
-  std::string shader_source = ReadFile(file_name);
+  shaderc_shader_kind kind = GetShaderKind(type);
 
-  shaderc_shader_kind kind;
-  VkShaderStageFlagBits type_flag;
-
-  if (type == ShaderType::VERTEX_SHADER) {
-    kind = shaderc_glsl_vertex_shader;
-    type_flag = VK_SHADER_STAGE_VERTEX_BIT;
+  // offline compiled binaries skip shaderc entirely, everything else goes through the cache when there is one
+  std::vector<uint32_t> shader_bin;
+  std::string path = file_name;
+  if (path.size() > 4 && path.compare(path.size() - 4, 4, ".spv") == 0) {
+    shader_bin = ShaderCache::LoadSpirv(path);
+  }
+  else if (init.shader_cache) {
+    shader_bin = init.shader_cache->GetSpirv(path, kind, defines);
   }
   else {
-    kind = shaderc_glsl_fragment_shader;
-    type_flag = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shader_bin = CompileShader(file_name, kind, ReadFile(file_name), defines);
   }
 
-  std::vector<uint32_t> shader_bin = CompileShader(file_name, kind, shader_source);
-
   module_ = CreateShaderModule(shader_bin, init);
 
   info_.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  info_.stage = type_flag;
+  info_.stage = GetShaderStage(type);
+  info_.module = module_;
+  info_.pName = entry_name;
+}
+
+Shader::Shader(const std::vector<uint32_t>& spirv, const char* entry_name, ShaderType type,
+  const InitData& init) : init_(init) {
+
+  module_ = CreateShaderModule(spirv, init);
+
+  info_.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  info_.stage = GetShaderStage(type);
   info_.module = module_;
   info_.pName = entry_name;
 }
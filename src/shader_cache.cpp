@@ -0,0 +1,173 @@
+#include "shader_cache.h"
+#include "shader.h"
+#include "hash.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+// names the compiler build in the cache key, so SPIR-V from an older shaderc isn't reused after an upgrade.
+// shaderc has no version string, the build can define this from its package version. the default is when
+// this file was compiled, and it includes the shaderc headers, so upgrading them rebuilds it
+#ifndef SHADER_COMPILER_ID
+#define SHADER_COMPILER_ID __DATE__ " " __TIME__
+#endif
+
+namespace {
+
+  const std::string& CompilerId() {
+    static const std::string id = [] {
+      unsigned int version = 0;
+      unsigned int revision = 0;
+      shaderc_get_spv_version(&version, &revision);
+      return std::string(SHADER_COMPILER_ID) + " spirv " + std::to_string(version) + "." + std::to_string(revision);
+    }();
+    return id;
+  }
+
+}
+
+ShaderCache::ShaderCache()
+{
+}
+
+void ShaderCache::Init(AssetCache* disk_cache, bool optimize) {
+  disk_cache_ = disk_cache;
+  optimize_ = optimize;
+}
+
+std::vector<uint32_t> ShaderCache::GetSpirv(const std::string& source_path, shaderc_shader_kind kind,
+  const std::vector<std::string>& defines, shaderc::Compiler* compiler, std::string* error) {
+  auto start_time = std::chrono::high_resolution_clock::now();
+
+  std::string source = ReadFile(source_path.c_str());
+
+  uint64_t hash = Hash64(source);
+  std::vector<std::string> visited = { source_path };
+  HashIncludes(source_path, source, hash, visited);
+
+  std::stringstream settings;
+  settings << "compiler " << CompilerId() << " stage " << static_cast<int>(kind) << " optimize " << optimize_ << " defines";
+  for (const auto& define : defines) {
+    settings << " " << define;
+  }
+  std::string key = "spirv-" + HashToString(Hash64(settings.str(), hash));
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto cached = memory_.find(key);
+    if (cached != memory_.end()) {
+      stats_.memory_hits++;
+      stats_.lookup_ms += std::chrono::duration<float, std::chrono::milliseconds::period>(
+        std::chrono::high_resolution_clock::now() - start_time).count();
+      return cached->second;
+    }
+  }
+
+  std::vector<uint8_t> bytes;
+  if (disk_cache_ && disk_cache_->Load(key, bytes) && !bytes.empty() && bytes.size() % sizeof(uint32_t) == 0) {
+    std::vector<uint32_t> spirv(bytes.size() / sizeof(uint32_t));
+    memcpy(spirv.data(), bytes.data(), bytes.size());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    memory_[key] = spirv;
+    stats_.disk_hits++;
+    stats_.lookup_ms += std::chrono::duration<float, std::chrono::milliseconds::period>(
+      std::chrono::high_resolution_clock::now() - start_time).count();
+    return spirv;
+  }
+
+  auto compile_start = std::chrono::high_resolution_clock::now();
+  std::vector<uint32_t> spirv = CompileShader(source_path, kind, source, defines, optimize_, compiler, error);
+  auto compile_end = std::chrono::high_resolution_clock::now();
+
+  // failures aren't cached, the next attempt should see the fixed source
+  if (!spirv.empty()) {
+    if (disk_cache_) {
+      disk_cache_->Store(key, spirv.data(), spirv.size() * sizeof(uint32_t));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    memory_[key] = spirv;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.compiles++;
+  stats_.compile_ms += std::chrono::duration<float, std::chrono::milliseconds::period>(compile_end - compile_start).count();
+  stats_.lookup_ms += std::chrono::duration<float, std::chrono::milliseconds::period>(compile_start - start_time).count();
+  return spirv;
+}
+
+std::vector<uint32_t> ShaderCache::LoadSpirv(const std::string& path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    throw std::runtime_error("could not open " + path);
+  }
+
+  size_t size = static_cast<size_t>(file.tellg());
+  if (size == 0 || size % sizeof(uint32_t) != 0) {
+    throw std::runtime_error(path + " is not a SPIR-V binary");
+  }
+
+  std::vector<uint32_t> spirv(size / sizeof(uint32_t));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(spirv.data()), static_cast<std::streamsize>(size));
+  return spirv;
+}
+
+ShaderCacheStats ShaderCache::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void ShaderCache::PrintStats() const {
+  ShaderCacheStats stats = GetStats();
+  std::cout << "shader cache: " << stats.memory_hits << " memory hits, " << stats.disk_hits << " disk hits, "
+    << stats.compiles << " compiles (" << stats.compile_ms << " ms compiling, " << stats.lookup_ms
+    << " ms hashing and loading)" << std::endl;
+}
+
+void ShaderCache::HashIncludes(const std::string& path, const std::string& source, uint64_t& hash,
+  std::vector<std::string>& visited) {
+  size_t slash = path.find_last_of("/\\");
+  std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+  std::istringstream lines(source);
+  std::string line;
+  while (std::getline(lines, line)) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+      continue;
+    }
+
+    // "file" and <file> both resolve relative to the including file, the same as the compiler's includer
+    size_t open = line.find_first_of("\"<", start);
+    size_t close = open == std::string::npos ? open : line.find(line[open] == '<' ? '>' : '"', open + 1);
+    if (close == std::string::npos) {
+      continue;
+    }
+
+    std::string include_path = directory + line.substr(open + 1, close - open - 1);
+    // the name goes into the hash even if it is missing, compilation will report that
+    hash = Hash64(include_path, hash);
+
+    if (std::find(visited.begin(), visited.end(), include_path) != visited.end()) {
+      continue;
+    }
+    visited.push_back(include_path);
+
+    std::ifstream file(include_path);
+    if (!file) {
+      continue;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    std::string include_source = contents.str();
+
+    hash = Hash64(include_source, hash);
+    HashIncludes(include_path, include_source, hash, visited);
+  }
+}
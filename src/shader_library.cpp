@@ -0,0 +1,108 @@
+#include "shader_library.h"
+#include "cpu_profiler.h"
+#include <sstream>
+#include <stdexcept>
+
+ShaderLibrary::ShaderLibrary()
+{
+}
+
+void ShaderLibrary::Init(JobSystem& jobs, ShaderCache* cache) {
+  jobs_ = &jobs;
+  cache_ = cache;
+
+  compilers_.resize(jobs.ThreadCount());
+  for (auto& compiler : compilers_) {
+    compiler = std::make_unique<shaderc::Compiler>();
+  }
+}
+
+void ShaderLibrary::Destroy() {
+  compilers_.clear();
+  entries_.clear();
+  handles_.clear();
+  compiled_ = 0;
+}
+
+uint32_t ShaderLibrary::Add(const std::string& path, ShaderType type, const std::vector<std::string>& defines) {
+  ShaderVariant variant{ path, type, defines };
+  std::string key = MakeKey(variant);
+
+  auto existing = handles_.find(key);
+  if (existing != handles_.end()) {
+    return existing->second;
+  }
+
+  uint32_t handle = static_cast<uint32_t>(entries_.size());
+  entries_.push_back({ std::move(variant), {} });
+  handles_[key] = handle;
+  return handle;
+}
+
+void ShaderLibrary::Compile() {
+  size_t begin = compiled_;
+  size_t count = entries_.size() - begin;
+  if (count == 0) {
+    return;
+  }
+
+  // each slot is only touched by the job compiling that variant
+  std::vector<std::string> errors(count);
+
+  // one variant per chunk, compile times vary too much between variants to batch them
+  jobs_->ParallelFor(count, 1, [&](size_t chunk_begin, size_t chunk_end) {
+    shaderc::Compiler& compiler = *compilers_[JobSystem::WorkerIndex()];
+
+    for (size_t ii = chunk_begin; ii < chunk_end; ii++) {
+      CPU_PROFILE_SCOPE("compile shader variant");
+      Entry& entry = entries_[begin + ii];
+      const ShaderVariant& variant = entry.variant;
+
+      try {
+        if (variant.path.size() > 4 && variant.path.compare(variant.path.size() - 4, 4, ".spv") == 0) {
+          entry.spirv = ShaderCache::LoadSpirv(variant.path);
+        }
+        else if (cache_) {
+          entry.spirv = cache_->GetSpirv(variant.path, GetShaderKind(variant.type), variant.defines,
+            &compiler, &errors[ii]);
+        }
+        else {
+          entry.spirv = CompileShader(variant.path, GetShaderKind(variant.type), ReadFile(variant.path.c_str()),
+            variant.defines, false, &compiler, &errors[ii]);
+        }
+      }
+      catch (const std::exception& e) {
+        errors[ii] = e.what();
+      }
+
+      if (entry.spirv.empty() && errors[ii].empty()) {
+        errors[ii] = "compiled to nothing";
+      }
+    }
+  });
+  compiled_ = entries_.size();
+
+  std::stringstream message;
+  size_t failed = 0;
+  for (size_t ii = 0; ii < count; ii++) {
+    if (errors[ii].empty()) {
+      continue;
+    }
+
+    failed++;
+    message << "\n" << MakeKey(entries_[begin + ii].variant) << ":\n" << errors[ii];
+  }
+
+  if (failed > 0) {
+    throw std::runtime_error(std::to_string(failed) + " of " + std::to_string(count) +
+      " shader variant(s) failed to compile" + message.str());
+  }
+}
+
+std::string ShaderLibrary::MakeKey(const ShaderVariant& variant) {
+  std::string key = variant.path + " [" + std::to_string(static_cast<int>(variant.type));
+  for (const auto& define : variant.defines) {
+    key += " " + define;
+  }
+  return key + "]";
+}
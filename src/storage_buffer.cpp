@@ -0,0 +1,14 @@
+#include "storage_buffer.h"
+
+StorageBuffer::StorageBuffer() : Buffer()
+{
+}
+
+StorageBuffer::StorageBuffer(const InitData& init, const RenderData& render, const void* data, VkDeviceSize size)
+  : Buffer(init, render, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    const_cast<void*>(data)) {
+}
+
+void StorageBuffer::Bind() {
+  return;
+}
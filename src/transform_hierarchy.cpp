@@ -0,0 +1,298 @@
+#include "transform_hierarchy.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64)
+// SSE2 is part of the x86-64 baseline, no runtime check needed
+#define TRANSFORM_SSE 1
+#include <immintrin.h>
+#endif
+
+namespace {
+  // nodes per job, a level smaller than this is updated on the calling thread
+  const size_t UPDATE_GRAIN = 8 * 1024;
+
+  glm::mat4 ComposeLocal(const glm::vec3& t, const glm::quat& q, const glm::vec3& s) {
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    glm::mat4 local;
+    local[0] = glm::vec4((1.0f - 2.0f * (yy + zz)) * s.x, 2.0f * (xy + wz) * s.x, 2.0f * (xz - wy) * s.x, 0.0f);
+    local[1] = glm::vec4(2.0f * (xy - wz) * s.y, (1.0f - 2.0f * (xx + zz)) * s.y, 2.0f * (yz + wx) * s.y, 0.0f);
+    local[2] = glm::vec4(2.0f * (xz + wy) * s.z, 2.0f * (yz - wx) * s.z, (1.0f - 2.0f * (xx + yy)) * s.z, 0.0f);
+    local[3] = glm::vec4(t.x, t.y, t.z, 1.0f);
+    return local;
+  }
+
+  // parent * local where local is affine (bottom row 0 0 0 1), which every composed TRS is
+  void MultiplyAffine(const glm::mat4& parent, const glm::mat4& local, glm::mat4& out) {
+#ifdef TRANSFORM_SSE
+    const float* p = &parent[0][0];
+    const float* l = &local[0][0];
+    float* o = &out[0][0];
+
+    __m128 p0 = _mm_loadu_ps(p);
+    __m128 p1 = _mm_loadu_ps(p + 4);
+    __m128 p2 = _mm_loadu_ps(p + 8);
+    __m128 p3 = _mm_loadu_ps(p + 12);
+
+    for (int column = 0; column < 4; column++) {
+      const float* c = l + column * 4;
+      __m128 result = _mm_mul_ps(p0, _mm_set1_ps(c[0]));
+      result = _mm_add_ps(result, _mm_mul_ps(p1, _mm_set1_ps(c[1])));
+      result = _mm_add_ps(result, _mm_mul_ps(p2, _mm_set1_ps(c[2])));
+      if (column == 3) {
+        result = _mm_add_ps(result, p3);
+      }
+      _mm_storeu_ps(o + column * 4, result);
+    }
+#else
+    out = parent * local;
+#endif
+  }
+}
+
+TransformHierarchy::TransformHierarchy()
+{
+}
+
+void TransformHierarchy::Reserve(size_t count) {
+  parent_node_.reserve(count);
+  depth_.reserve(count);
+  slot_of_node_.reserve(count);
+  node_of_slot_.reserve(count);
+  parent_slot_.reserve(count);
+  translation_.reserve(count);
+  rotation_.reserve(count);
+  scale_.reserve(count);
+  world_.reserve(count);
+  dirty_.reserve(count);
+}
+
+void TransformHierarchy::Clear() {
+  parent_node_.clear();
+  depth_.clear();
+  slot_of_node_.clear();
+  node_of_slot_.clear();
+  parent_slot_.clear();
+  translation_.clear();
+  rotation_.clear();
+  scale_.clear();
+  world_.clear();
+  dirty_.clear();
+  level_begin_ = { 0 };
+  first_dirty_level_ = 0;
+  needs_rebuild_ = false;
+}
+
+uint32_t TransformHierarchy::AddNode(uint32_t parent, const LocalTransform& local) {
+  uint32_t node = static_cast<uint32_t>(parent_node_.size());
+  if (parent != INVALID_NODE && parent >= node) {
+    throw std::runtime_error("transform hierarchy parent has to be added before its children");
+  }
+
+  parent_node_.push_back(parent);
+  depth_.push_back(parent == INVALID_NODE ? 0 : depth_[parent] + 1);
+
+  // lands at the end until the next Rebuild puts it in its level
+  slot_of_node_.push_back(node);
+  node_of_slot_.push_back(node);
+  parent_slot_.push_back(INVALID_NODE);
+  translation_.push_back(local.translation);
+  rotation_.push_back(local.rotation);
+  scale_.push_back(local.scale);
+  world_.push_back(glm::mat4(1.0f));
+  dirty_.push_back(1);
+
+  needs_rebuild_ = true;
+  return node;
+}
+
+void TransformHierarchy::SetLocal(uint32_t node, const LocalTransform& local) {
+  uint32_t slot = slot_of_node_[node];
+  translation_[slot] = local.translation;
+  rotation_[slot] = local.rotation;
+  scale_[slot] = local.scale;
+  MarkDirty(slot);
+}
+
+void TransformHierarchy::SetTranslation(uint32_t node, const glm::vec3& translation) {
+  uint32_t slot = slot_of_node_[node];
+  translation_[slot] = translation;
+  MarkDirty(slot);
+}
+
+void TransformHierarchy::SetRotation(uint32_t node, const glm::quat& rotation) {
+  uint32_t slot = slot_of_node_[node];
+  rotation_[slot] = rotation;
+  MarkDirty(slot);
+}
+
+void TransformHierarchy::SetScale(uint32_t node, const glm::vec3& scale) {
+  uint32_t slot = slot_of_node_[node];
+  scale_[slot] = scale;
+  MarkDirty(slot);
+}
+
+LocalTransform TransformHierarchy::GetLocal(uint32_t node) const {
+  uint32_t slot = slot_of_node_[node];
+  LocalTransform local;
+  local.translation = translation_[slot];
+  local.rotation = rotation_[slot];
+  local.scale = scale_[slot];
+  return local;
+}
+
+void TransformHierarchy::MarkDirty(uint32_t slot) {
+  dirty_[slot] = 1;
+  first_dirty_level_ = std::min(first_dirty_level_, depth_[node_of_slot_[slot]]);
+}
+
+void TransformHierarchy::Rebuild() {
+  uint32_t level_count = 0;
+  for (uint32_t depth : depth_) {
+    level_count = std::max(level_count, depth + 1);
+  }
+
+  // counting sort on depth, stable so siblings stay next to each other in id order
+  level_begin_.assign(level_count + 1, 0);
+  for (uint32_t depth : depth_) {
+    level_begin_[depth + 1]++;
+  }
+  for (uint32_t ii = 0; ii < level_count; ii++) {
+    level_begin_[ii + 1] += level_begin_[ii];
+  }
+
+  std::vector<size_t> next(level_begin_.begin(), level_begin_.end() - 1);
+  std::vector<uint32_t> new_slot_of_node(parent_node_.size());
+  for (uint32_t node = 0; node < parent_node_.size(); node++) {
+    new_slot_of_node[node] = static_cast<uint32_t>(next[depth_[node]]++);
+  }
+
+  std::vector<uint32_t> node_of_slot(parent_node_.size());
+  std::vector<uint32_t> parent_slot(parent_node_.size());
+  std::vector<glm::vec3> translation(parent_node_.size());
+  std::vector<glm::quat> rotation(parent_node_.size());
+  std::vector<glm::vec3> scale(parent_node_.size());
+  std::vector<glm::mat4> world(parent_node_.size());
+  std::vector<uint8_t> dirty(parent_node_.size());
+
+  for (uint32_t node = 0; node < parent_node_.size(); node++) {
+    uint32_t old_slot = slot_of_node_[node];
+    uint32_t slot = new_slot_of_node[node];
+    uint32_t parent = parent_node_[node];
+
+    node_of_slot[slot] = node;
+    parent_slot[slot] = parent == INVALID_NODE ? INVALID_NODE : new_slot_of_node[parent];
+    translation[slot] = translation_[old_slot];
+    rotation[slot] = rotation_[old_slot];
+    scale[slot] = scale_[old_slot];
+    world[slot] = world_[old_slot];
+    dirty[slot] = dirty_[old_slot];
+  }
+
+  slot_of_node_.swap(new_slot_of_node);
+  node_of_slot_.swap(node_of_slot);
+  parent_slot_.swap(parent_slot);
+  translation_.swap(translation);
+  rotation_.swap(rotation);
+  scale_.swap(scale);
+  world_.swap(world);
+  dirty_.swap(dirty);
+
+  // dirty bits were set before the levels existed
+  first_dirty_level_ = 0;
+  needs_rebuild_ = false;
+}
+
+size_t TransformHierarchy::UpdateRange(size_t begin, size_t end) {
+  size_t written = 0;
+  for (size_t slot = begin; slot < end; slot++) {
+    uint32_t parent = parent_slot_[slot];
+    // the parent's level is finished, its bit is final
+    if (parent != INVALID_NODE && dirty_[parent]) {
+      dirty_[slot] = 1;
+    }
+    if (!dirty_[slot]) {
+      continue;
+    }
+
+    glm::mat4 local = ComposeLocal(translation_[slot], rotation_[slot], scale_[slot]);
+    if (parent == INVALID_NODE) {
+      world_[slot] = local;
+    }
+    else {
+      MultiplyAffine(world_[parent], local, world_[slot]);
+    }
+    written++;
+  }
+  return written;
+}
+
+size_t TransformHierarchy::Update(JobSystem* jobs) {
+  if (needs_rebuild_) {
+    Rebuild();
+  }
+
+  uint32_t level_count = LevelCount();
+  if (first_dirty_level_ >= level_count) {
+    return 0;
+  }
+
+  std::atomic<size_t> written{ 0 };
+  for (uint32_t level = first_dirty_level_; level < level_count; level++) {
+    size_t level_begin = level_begin_[level];
+    size_t level_end = level_begin_[level + 1];
+
+    if (!jobs) {
+      written += UpdateRange(level_begin, level_end);
+      continue;
+    }
+
+    // each level has to be complete before the next one reads it, ParallelFor blocks until it is
+    jobs->ParallelFor(level_end - level_begin, UPDATE_GRAIN, [&](size_t begin, size_t end) {
+      written.fetch_add(UpdateRange(level_begin + begin, level_begin + end), std::memory_order_relaxed);
+    });
+  }
+
+  std::fill(dirty_.begin() + level_begin_[first_dirty_level_], dirty_.end(), 0);
+  first_dirty_level_ = level_count;
+  return written.load();
+}
+
+void TransformHierarchy::ComputeWorldRecursive(std::vector<glm::mat4>& world) const {
+  std::vector<std::vector<uint32_t>> children(parent_node_.size());
+  std::vector<uint32_t> roots;
+  for (uint32_t node = 0; node < parent_node_.size(); node++) {
+    if (parent_node_[node] == INVALID_NODE) {
+      roots.push_back(node);
+    }
+    else {
+      children[parent_node_[node]].push_back(node);
+    }
+  }
+
+  world.assign(parent_node_.size(), glm::mat4(1.0f));
+
+  struct Walker {
+    const TransformHierarchy& hierarchy;
+    const std::vector<std::vector<uint32_t>>& children;
+    std::vector<glm::mat4>& world;
+
+    void Visit(uint32_t node, const glm::mat4& parent_world) {
+      LocalTransform local = hierarchy.GetLocal(node);
+      world[node] = parent_world * glm::translate(glm::mat4(1.0f), local.translation) *
+        glm::mat4_cast(local.rotation) * glm::scale(glm::mat4(1.0f), local.scale);
+      for (uint32_t child : children[node]) {
+        Visit(child, world[node]);
+      }
+    }
+  };
+
+  Walker walker{ *this, children, world };
+  for (uint32_t root : roots) {
+    walker.Visit(root, glm::mat4(1.0f));
+  }
+}
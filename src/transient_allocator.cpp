@@ -0,0 +1,64 @@
+#include "transient_allocator.h"
+#include <algorithm>
+#include <stdexcept>
+
+TransientAllocator::TransientAllocator()
+{
+}
+
+void TransientAllocator::Init(const InitData& init, uint32_t frame_count, VkDeviceSize frame_size) {
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(init.physical_device, &properties);
+
+  // the same slice may be bound as a uniform or a storage buffer
+  alignment_ = std::max(properties.limits.minUniformBufferOffsetAlignment,
+    properties.limits.minStorageBufferOffsetAlignment);
+  frame_size_ = frame_size;
+
+  frames_.resize(frame_count);
+  for (auto& frame : frames_) {
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = frame_size_;
+    buffer_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(init.device, &buffer_info, nullptr, &frame.buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create transient buffer");
+    }
+
+    frame.allocation = init.allocator->AllocateBuffer(frame.buffer, MemoryUsage::CPU_TO_GPU);
+  }
+}
+
+void TransientAllocator::Destroy(const InitData& init) {
+  for (auto& frame : frames_) {
+    vkDestroyBuffer(init.device, frame.buffer, nullptr);
+    init.allocator->Free(frame.allocation);
+  }
+  frames_.clear();
+}
+
+void TransientAllocator::BeginFrame(uint32_t frame) {
+  current_frame_ = frame;
+  head_ = 0;
+}
+
+TransientAllocation TransientAllocator::Allocate(VkDeviceSize size) {
+  VkDeviceSize offset = (head_ + alignment_ - 1) & ~(alignment_ - 1);
+  if (offset + size > frame_size_) {
+    throw std::runtime_error("transient allocator ran out of space for this frame");
+  }
+
+  head_ = offset + size;
+  high_water_mark_ = std::max(high_water_mark_, head_);
+
+  const Frame& frame = frames_[current_frame_];
+
+  TransientAllocation allocation{};
+  allocation.buffer = frame.buffer;
+  allocation.offset = static_cast<uint32_t>(offset);
+  allocation.data = static_cast<char*>(frame.allocation.mapped) + offset;
+  return allocation;
+}
@@ -0,0 +1,475 @@
+#include "upload_manager.h"
+#include "mip_generator.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+// covers optimalBufferCopyOffsetAlignment and the texel size of every format we upload
+static const VkDeviceSize STAGING_ALIGNMENT = 16;
+
+// everything the graphics queue may read an uploaded resource with
+static const VkAccessFlags UPLOAD_READ_ACCESS = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+  VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+static const VkPipelineStageFlags UPLOAD_READ_STAGES = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+  VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+static VkImageMemoryBarrier ImageLevelsBarrier(VkImage image, uint32_t level_count, VkImageLayout old_layout,
+  VkImageLayout new_layout) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = old_layout;
+  barrier.newLayout = new_layout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = level_count;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  return barrier;
+}
+
+UploadManager::UploadManager()
+{
+}
+
+void UploadManager::Init(const InitData& init, uint32_t graphics_family, std::optional<uint32_t> transfer_family,
+  VkDeviceSize ring_size) {
+  device_ = init.device;
+  allocator_ = init.allocator;
+  graphics_family_ = graphics_family;
+  transfer_family_ = transfer_family.value_or(graphics_family);
+  graphics_queue_ = init.graphics_queue;
+  vkGetDeviceQueue(device_, transfer_family_, 0, &transfer_queue_);
+
+  VkCommandPoolCreateInfo pool_info{};
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = transfer_family_;
+
+  if (vkCreateCommandPool(device_, &pool_info, nullptr, &transfer_pool_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create upload command pool!");
+  }
+
+  if (Dedicated()) {
+    pool_info.queueFamilyIndex = graphics_family_;
+    if (vkCreateCommandPool(device_, &pool_info, nullptr, &acquire_pool_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create upload command pool!");
+    }
+  }
+
+  ring_size_ = ring_size;
+
+  VkBufferCreateInfo buffer_info{};
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = ring_size_;
+  buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  if (vkCreateBuffer(device_, &buffer_info, nullptr, &ring_buffer_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create staging ring buffer");
+  }
+  ring_allocation_ = allocator_->AllocateBuffer(ring_buffer_, MemoryUsage::CPU_ONLY);
+}
+
+void UploadManager::Destroy() {
+  WaitIdle();
+
+  for (auto& batch : free_batches_) {
+    vkDestroyFence(device_, batch.fence, nullptr);
+    if (batch.transfer_done != VK_NULL_HANDLE) {
+      vkDestroySemaphore(device_, batch.transfer_done, nullptr);
+    }
+  }
+  free_batches_.clear();
+
+  vkDestroyBuffer(device_, ring_buffer_, nullptr);
+  allocator_->Free(ring_allocation_);
+
+  // destroying the pools frees the batches' command buffers
+  vkDestroyCommandPool(device_, transfer_pool_, nullptr);
+  if (acquire_pool_ != VK_NULL_HANDLE) {
+    vkDestroyCommandPool(device_, acquire_pool_, nullptr);
+  }
+}
+
+void UploadManager::UploadBuffer(VkBuffer dst_buffer, VkDeviceSize dst_offset, const void* data, VkDeviceSize size) {
+  VkBuffer src_buffer;
+  VkDeviceSize src_offset;
+  Stage(data, size, src_buffer, src_offset);
+  BeginBatch();
+
+  VkBufferCopy copy_region{};
+  copy_region.srcOffset = src_offset;
+  copy_region.dstOffset = dst_offset;
+  copy_region.size = size;
+  vkCmdCopyBuffer(current_.transfer_commands, src_buffer, dst_buffer, 1, &copy_region);
+
+  if (Dedicated()) {
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = transfer_family_;
+    barrier.dstQueueFamilyIndex = graphics_family_;
+    barrier.buffer = dst_buffer;
+    barrier.offset = dst_offset;
+    barrier.size = size;
+    buffer_barriers_.push_back(barrier);
+  }
+
+  stats_.buffer_copies++;
+  stats_.bytes += size;
+}
+
+void UploadManager::UploadImage(VkImage dst_image, uint32_t width, uint32_t height, const void* data, VkDeviceSize size,
+  uint32_t level_count) {
+  CopyToImage(dst_image, width, height, data, size, level_count, level_count);
+
+  // the transition to shader read happens once for the whole batch in Flush
+  VkImageMemoryBarrier barrier = ImageLevelsBarrier(dst_image, level_count, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  if (Dedicated()) {
+    barrier.srcQueueFamilyIndex = transfer_family_;
+    barrier.dstQueueFamilyIndex = graphics_family_;
+  }
+  image_barriers_.push_back(barrier);
+}
+
+void UploadManager::UploadImageGenerateMips(VkImage dst_image, uint32_t width, uint32_t height, const void* data,
+  VkDeviceSize size, uint32_t level_count) {
+  CopyToImage(dst_image, width, height, data, size, 1, level_count);
+  stats_.mip_blits += level_count - 1;
+
+  if (!Dedicated()) {
+    // the copies already run on the graphics queue, the blits can follow them directly
+    RecordMipBlits(current_.transfer_commands, dst_image, width, height, level_count);
+    return;
+  }
+
+  // ownership moves over in transfer dst, the blits after the acquire take the levels to shader read
+  VkImageMemoryBarrier barrier = ImageLevelsBarrier(dst_image, level_count, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  barrier.srcQueueFamilyIndex = transfer_family_;
+  barrier.dstQueueFamilyIndex = graphics_family_;
+  image_barriers_.push_back(barrier);
+  pending_mips_.push_back({ dst_image, width, height, level_count });
+}
+
+UploadTicket UploadManager::Flush() {
+  if (!recording_) {
+    return last_submitted_;
+  }
+
+  if (Dedicated()) {
+    // release on the transfer queue: only the source half of each barrier executes here
+    for (auto& barrier : buffer_barriers_) {
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = 0;
+    }
+    for (auto& barrier : image_barriers_) {
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = 0;
+    }
+    vkCmdPipelineBarrier(current_.transfer_commands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+      0, 0, nullptr,
+      static_cast<uint32_t>(buffer_barriers_.size()), buffer_barriers_.data(),
+      static_cast<uint32_t>(image_barriers_.size()), image_barriers_.data());
+
+    // acquire on the graphics queue: only the destination half executes here
+    for (auto& barrier : buffer_barriers_) {
+      barrier.srcAccessMask = 0;
+      barrier.dstAccessMask = UPLOAD_READ_ACCESS;
+    }
+    for (auto& barrier : image_barriers_) {
+      barrier.srcAccessMask = 0;
+      // images still in transfer dst get their mips blitted next
+      barrier.dstAccessMask = barrier.newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL ?
+        VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT;
+    }
+    VkPipelineStageFlags acquire_stages = UPLOAD_READ_STAGES;
+    if (!pending_mips_.empty()) {
+      acquire_stages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+    vkCmdPipelineBarrier(current_.acquire_commands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, acquire_stages,
+      0, 0, nullptr,
+      static_cast<uint32_t>(buffer_barriers_.size()), buffer_barriers_.data(),
+      static_cast<uint32_t>(image_barriers_.size()), image_barriers_.data());
+
+    for (const PendingMips& mips : pending_mips_) {
+      RecordMipBlits(current_.acquire_commands, mips.image, mips.width, mips.height, mips.level_count);
+    }
+    pending_mips_.clear();
+  }
+  else {
+    // one barrier makes every copy in the batch visible to later submissions on this queue
+    VkMemoryBarrier memory_barrier{};
+    memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memory_barrier.dstAccessMask = UPLOAD_READ_ACCESS;
+
+    for (auto& barrier : image_barriers_) {
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    }
+    vkCmdPipelineBarrier(current_.transfer_commands, VK_PIPELINE_STAGE_TRANSFER_BIT, UPLOAD_READ_STAGES,
+      0, 1, &memory_barrier, 0, nullptr,
+      static_cast<uint32_t>(image_barriers_.size()), image_barriers_.data());
+  }
+
+  buffer_barriers_.clear();
+  image_barriers_.clear();
+
+  if (vkEndCommandBuffer(current_.transfer_commands) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record upload command buffer");
+  }
+
+  vkResetFences(device_, 1, &current_.fence);
+
+  VkSubmitInfo submit_info{};
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &current_.transfer_commands;
+
+  if (Dedicated()) {
+    if (vkEndCommandBuffer(current_.acquire_commands) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record upload command buffer");
+    }
+
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &current_.transfer_done;
+    if (vkQueueSubmit(transfer_queue_, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit upload command buffer");
+    }
+
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    VkSubmitInfo acquire_info{};
+    acquire_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    acquire_info.waitSemaphoreCount = 1;
+    acquire_info.pWaitSemaphores = &current_.transfer_done;
+    acquire_info.pWaitDstStageMask = &wait_stage;
+    acquire_info.commandBufferCount = 1;
+    acquire_info.pCommandBuffers = &current_.acquire_commands;
+    if (vkQueueSubmit(graphics_queue_, 1, &acquire_info, current_.fence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit upload command buffer");
+    }
+    stats_.submits += 2;
+  }
+  else {
+    if (vkQueueSubmit(transfer_queue_, 1, &submit_info, current_.fence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to submit upload command buffer");
+    }
+    stats_.submits++;
+  }
+
+  current_.ticket = ++last_submitted_;
+  current_.ring_end = ring_head_;
+  in_flight_.push_back(std::move(current_));
+  current_ = Batch{};
+  recording_ = false;
+
+  return last_submitted_;
+}
+
+bool UploadManager::IsComplete(UploadTicket ticket) {
+  CollectCompleted();
+  return ticket <= last_completed_;
+}
+
+void UploadManager::Wait(UploadTicket ticket) {
+  if (ticket > last_submitted_) {
+    Flush();
+  }
+  CollectCompleted();
+  while (last_completed_ < ticket && !in_flight_.empty()) {
+    RetireOldest();
+  }
+}
+
+void UploadManager::WaitIdle() {
+  Wait(Flush());
+}
+
+void UploadManager::PrintStats() const {
+  std::cout << "uploads: " << stats_.buffer_copies << " buffer copies, " << stats_.image_copies
+    << " image copies, " << stats_.mip_blits << " mip blits, " << stats_.bytes / 1024 << " KiB in "
+    << stats_.submits << " submits, " << stats_.waits << " waits" << (Dedicated() ? " (dedicated transfer queue)" : "")
+    << std::endl;
+}
+
+void UploadManager::CopyToImage(VkImage dst_image, uint32_t width, uint32_t height, const void* data, VkDeviceSize size,
+  uint32_t copy_level_count, uint32_t level_count) {
+  VkBuffer src_buffer;
+  VkDeviceSize src_offset;
+  Stage(data, size, src_buffer, src_offset);
+  BeginBatch();
+
+  VkImageMemoryBarrier barrier = ImageLevelsBarrier(dst_image, level_count, VK_IMAGE_LAYOUT_UNDEFINED,
+    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+  vkCmdPipelineBarrier(current_.transfer_commands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+    0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+  // the levels are tightly packed, so the texel size falls out of the total
+  VkDeviceSize texel_count = 0;
+  for (uint32_t level = 0; level < copy_level_count; level++) {
+    texel_count += static_cast<VkDeviceSize>(std::max(1u, width >> level)) * std::max(1u, height >> level);
+  }
+  VkDeviceSize texel_size = size / texel_count;
+
+  std::vector<VkBufferImageCopy> regions(copy_level_count);
+  VkDeviceSize level_offset = src_offset;
+  for (uint32_t level = 0; level < copy_level_count; level++) {
+    uint32_t level_width = std::max(1u, width >> level);
+    uint32_t level_height = std::max(1u, height >> level);
+
+    VkBufferImageCopy& region = regions[level];
+    region.bufferOffset = level_offset;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = level;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = { level_width, level_height, 1 };
+
+    level_offset += static_cast<VkDeviceSize>(level_width) * level_height * texel_size;
+  }
+
+  vkCmdCopyBufferToImage(current_.transfer_commands, src_buffer, dst_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    copy_level_count, regions.data());
+
+  stats_.image_copies++;
+  stats_.bytes += size;
+}
+
+void UploadManager::BeginBatch() {
+  if (recording_) {
+    return;
+  }
+
+  if (!free_batches_.empty()) {
+    current_ = std::move(free_batches_.back());
+    free_batches_.pop_back();
+  }
+  else {
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandPool = transfer_pool_;
+    alloc_info.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device_, &alloc_info, &current_.transfer_commands) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate upload command buffer");
+    }
+
+    if (Dedicated()) {
+      alloc_info.commandPool = acquire_pool_;
+      if (vkAllocateCommandBuffers(device_, &alloc_info, &current_.acquire_commands) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate upload command buffer");
+      }
+
+      VkSemaphoreCreateInfo semaphore_info{};
+      semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+      if (vkCreateSemaphore(device_, &semaphore_info, nullptr, &current_.transfer_done) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upload semaphore");
+      }
+    }
+
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(device_, &fence_info, nullptr, &current_.fence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create upload fence");
+    }
+  }
+
+  VkCommandBufferBeginInfo begin_info{};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  vkBeginCommandBuffer(current_.transfer_commands, &begin_info);
+  if (Dedicated()) {
+    vkBeginCommandBuffer(current_.acquire_commands, &begin_info);
+  }
+
+  recording_ = true;
+}
+
+void UploadManager::Stage(const void* data, VkDeviceSize size, VkBuffer& src_buffer, VkDeviceSize& src_offset) {
+  if (size > ring_size_) {
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer buffer;
+    if (vkCreateBuffer(device_, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create staging buffer");
+    }
+    Allocation allocation = allocator_->AllocateBuffer(buffer, MemoryUsage::CPU_ONLY);
+    memcpy(allocation.mapped, data, (size_t)size);
+
+    BeginBatch();
+    current_.oversized.emplace_back(buffer, allocation);
+
+    src_buffer = buffer;
+    src_offset = 0;
+    return;
+  }
+
+  uint64_t start = (ring_head_ + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+  // a copy source can't wrap around the end of the ring, skip to the start instead
+  if (start % ring_size_ + size > ring_size_) {
+    start += ring_size_ - start % ring_size_;
+  }
+
+  while (start + size - ring_tail_ > ring_size_) {
+    // nothing outstanding, the whole ring is free
+    if (in_flight_.empty() && !recording_) {
+      ring_tail_ = start;
+      break;
+    }
+    // the batch being recorded holds the rest of the ring, it has to go out first
+    if (in_flight_.empty()) {
+      Flush();
+    }
+    RetireOldest();
+  }
+
+  ring_head_ = start + size;
+  memcpy(static_cast<char*>(ring_allocation_.mapped) + start % ring_size_, data, (size_t)size);
+
+  src_buffer = ring_buffer_;
+  src_offset = start % ring_size_;
+}
+
+void UploadManager::CollectCompleted() {
+  while (!in_flight_.empty() && vkGetFenceStatus(device_, in_flight_.front().fence) == VK_SUCCESS) {
+    RetireOldest();
+  }
+}
+
+void UploadManager::RetireOldest() {
+  Batch& batch = in_flight_.front();
+
+  if (vkGetFenceStatus(device_, batch.fence) != VK_SUCCESS) {
+    vkWaitForFences(device_, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+    stats_.waits++;
+  }
+
+  for (auto& staging : batch.oversized) {
+    vkDestroyBuffer(device_, staging.first, nullptr);
+    allocator_->Free(staging.second);
+  }
+  batch.oversized.clear();
+
+  ring_tail_ = batch.ring_end;
+  last_completed_ = batch.ticket;
+
+  free_batches_.push_back(std::move(batch));
+  in_flight_.pop_front();
+}
@@ -9,6 +9,11 @@ VertexBuffer::VertexBuffer(const InitData& init, const RenderData& render, const
     (void*)vertices.data()) {
 }
 
+VertexBuffer::VertexBuffer(const InitData& init, const RenderData& render, const void* data, VkDeviceSize size)
+  : Buffer(init, render, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+    const_cast<void*>(data)) {
+}
+
 void VertexBuffer::Bind() {
   return;
 }
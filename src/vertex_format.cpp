@@ -0,0 +1,451 @@
+#include "vertex_format.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+  uint32_t PositionSize(PositionFormat format) {
+    return format == PositionFormat::FLOAT32 ? 12 : 8;
+  }
+
+  uint32_t ColorSize(ColorFormat format) {
+    switch (format) {
+    case ColorFormat::FLOAT32: return 12;
+    case ColorFormat::UNORM8: return 4;
+    default: return 0;
+    }
+  }
+
+  uint32_t TexCoordSize(TexCoordFormat format) {
+    return format == TexCoordFormat::FLOAT32 ? 8 : 4;
+  }
+
+  uint32_t NormalSize(NormalFormat format) {
+    return format == NormalFormat::OCT_SNORM16 ? 4 : 0;
+  }
+
+  int16_t ToSnorm16(float value) {
+    return static_cast<int16_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+  }
+
+  float FromSnorm16(int16_t value) {
+    return std::max(value / 32767.0f, -1.0f);
+  }
+
+  uint16_t ToUnorm16(float value) {
+    return static_cast<uint16_t>(std::round(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+  }
+
+  uint8_t ToUnorm8(float value) {
+    return static_cast<uint8_t>(std::round(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+  }
+
+  // byte offsets of each attribute inside one vertex, in location order
+  struct AttributeOffsets {
+    uint32_t position;
+    uint32_t color;
+    uint32_t tex_coord;
+    uint32_t normal;
+  };
+
+  AttributeOffsets GetOffsets(const VertexLayout& layout) {
+    AttributeOffsets offsets{};
+    offsets.position = 0;
+    offsets.color = offsets.position + PositionSize(layout.position);
+    offsets.tex_coord = offsets.color + ColorSize(layout.color);
+    offsets.normal = offsets.tex_coord + TexCoordSize(layout.tex_coord);
+    return offsets;
+  }
+
+  void GetBounds(const std::vector<Vertex>& vertices, glm::vec3& bounds_min, glm::vec3& bounds_max) {
+    bounds_min = glm::vec3(0.0f);
+    bounds_max = glm::vec3(0.0f);
+    if (vertices.empty()) {
+      return;
+    }
+
+    bounds_min = bounds_max = vertices[0].pos;
+    for (const auto& vertex : vertices) {
+      bounds_min = glm::min(bounds_min, vertex.pos);
+      bounds_max = glm::max(bounds_max, vertex.pos);
+    }
+  }
+
+  // decodes one vertex the way the vertex shader would
+  Vertex DecodeVertex(const QuantizedMesh& mesh, uint32_t index, glm::vec3& normal) {
+    const VertexLayout& layout = mesh.layout;
+    AttributeOffsets offsets = GetOffsets(layout);
+    const uint8_t* data = mesh.data.data() + static_cast<size_t>(index) * layout.Stride();
+
+    Vertex vertex{};
+    glm::vec3 position;
+    if (layout.position == PositionFormat::FLOAT32) {
+      memcpy(&position, data + offsets.position, sizeof(position));
+    }
+    else {
+      uint16_t words[3];
+      memcpy(words, data + offsets.position, sizeof(words));
+      for (int ii = 0; ii < 3; ii++) {
+        position[ii] = layout.position == PositionFormat::HALF ?
+          HalfToFloat(words[ii]) : FromSnorm16(static_cast<int16_t>(words[ii]));
+      }
+    }
+    vertex.pos = position * glm::vec3(mesh.constants.position_scale) + glm::vec3(mesh.constants.position_offset);
+
+    if (layout.color == ColorFormat::NONE) {
+      vertex.color = glm::vec3(1.0f);
+    }
+    else if (layout.color == ColorFormat::FLOAT32) {
+      memcpy(&vertex.color, data + offsets.color, sizeof(vertex.color));
+    }
+    else {
+      const uint8_t* rgba = data + offsets.color;
+      vertex.color = glm::vec3(rgba[0], rgba[1], rgba[2]) / 255.0f;
+    }
+
+    if (layout.tex_coord == TexCoordFormat::FLOAT32) {
+      memcpy(&vertex.tex_coord, data + offsets.tex_coord, sizeof(vertex.tex_coord));
+    }
+    else {
+      uint16_t words[2];
+      memcpy(words, data + offsets.tex_coord, sizeof(words));
+      for (int ii = 0; ii < 2; ii++) {
+        vertex.tex_coord[ii] = layout.tex_coord == TexCoordFormat::HALF ? HalfToFloat(words[ii]) : words[ii] / 65535.0f;
+      }
+    }
+
+    normal = glm::vec3(0.0f);
+    if (layout.normal == NormalFormat::OCT_SNORM16) {
+      int16_t words[2];
+      memcpy(words, data + offsets.normal, sizeof(words));
+      normal = OctDecode(glm::vec2(FromSnorm16(words[0]), FromSnorm16(words[1])));
+    }
+
+    return vertex;
+  }
+
+}
+
+VertexLayout VertexLayout::Full() {
+  return VertexLayout();
+}
+
+uint32_t VertexLayout::Stride() const {
+  return PositionSize(position) + ColorSize(color) + TexCoordSize(tex_coord) + NormalSize(normal);
+}
+
+VkVertexInputBindingDescription VertexLayout::GetBindingDescription() const {
+  VkVertexInputBindingDescription binding_description{};
+  binding_description.binding = 0;
+  binding_description.stride = Stride();
+  binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+  return binding_description;
+}
+
+std::vector<VkVertexInputAttributeDescription> VertexLayout::GetAttributeDescriptions() const {
+  AttributeOffsets offsets = GetOffsets(*this);
+  std::vector<VkVertexInputAttributeDescription> attribute_descriptions;
+
+  VkVertexInputAttributeDescription attribute{};
+  attribute.binding = 0;
+
+  // three component 16 bit formats are barely supported for vertex input, so those take four
+  attribute.location = 0;
+  attribute.offset = offsets.position;
+  switch (position) {
+  case PositionFormat::FLOAT32: attribute.format = VK_FORMAT_R32G32B32_SFLOAT; break;
+  case PositionFormat::HALF: attribute.format = VK_FORMAT_R16G16B16A16_SFLOAT; break;
+  case PositionFormat::SNORM16: attribute.format = VK_FORMAT_R16G16B16A16_SNORM; break;
+  }
+  attribute_descriptions.push_back(attribute);
+
+  if (color != ColorFormat::NONE) {
+    attribute.location = 1;
+    attribute.offset = offsets.color;
+    attribute.format = color == ColorFormat::FLOAT32 ? VK_FORMAT_R32G32B32_SFLOAT : VK_FORMAT_R8G8B8A8_UNORM;
+    attribute_descriptions.push_back(attribute);
+  }
+
+  attribute.location = 2;
+  attribute.offset = offsets.tex_coord;
+  switch (tex_coord) {
+  case TexCoordFormat::FLOAT32: attribute.format = VK_FORMAT_R32G32_SFLOAT; break;
+  case TexCoordFormat::HALF: attribute.format = VK_FORMAT_R16G16_SFLOAT; break;
+  case TexCoordFormat::UNORM16: attribute.format = VK_FORMAT_R16G16_UNORM; break;
+  }
+  attribute_descriptions.push_back(attribute);
+
+  if (normal != NormalFormat::NONE) {
+    attribute.location = 3;
+    attribute.offset = offsets.normal;
+    attribute.format = VK_FORMAT_R16G16_SNORM;
+    attribute_descriptions.push_back(attribute);
+  }
+
+  return attribute_descriptions;
+}
+
+std::vector<std::string> VertexLayout::GetShaderDefines() const {
+  std::vector<std::string> defines;
+  if (color != ColorFormat::NONE) {
+    defines.push_back("HAS_COLOR");
+  }
+  if (normal != NormalFormat::NONE) {
+    defines.push_back("HAS_NORMAL");
+  }
+  return defines;
+}
+
+VertexLayout SelectVertexLayout(const std::vector<Vertex>& vertices, float position_tolerance,
+  const std::vector<glm::vec3>* normals) {
+  VertexLayout layout;
+
+  glm::vec3 bounds_min, bounds_max;
+  GetBounds(vertices, bounds_min, bounds_max);
+  glm::vec3 half_extent = (bounds_max - bounds_min) * 0.5f;
+  float max_half_extent = std::max(half_extent.x, std::max(half_extent.y, half_extent.z));
+
+  // rounding to the nearest snorm step is off by at most half a step
+  float snorm_error = max_half_extent / 32767.0f * 0.5f;
+  layout.position = snorm_error <= position_tolerance ? PositionFormat::SNORM16 : PositionFormat::FLOAT32;
+
+  bool all_white = true;
+  bool colors_in_range = true;
+  float max_tex_coord = 0.0f;
+  bool tex_coords_in_range = true;
+
+  for (const auto& vertex : vertices) {
+    all_white = all_white && vertex.color == glm::vec3(1.0f);
+    for (int ii = 0; ii < 3; ii++) {
+      colors_in_range = colors_in_range && vertex.color[ii] >= 0.0f && vertex.color[ii] <= 1.0f;
+    }
+    for (int ii = 0; ii < 2; ii++) {
+      tex_coords_in_range = tex_coords_in_range && vertex.tex_coord[ii] >= 0.0f && vertex.tex_coord[ii] <= 1.0f;
+      max_tex_coord = std::max(max_tex_coord, std::abs(vertex.tex_coord[ii]));
+    }
+  }
+
+  if (all_white) {
+    layout.color = ColorFormat::NONE;
+  }
+  else {
+    layout.color = colors_in_range ? ColorFormat::UNORM8 : ColorFormat::FLOAT32;
+  }
+
+  // past 2.0 a half float step is more than a texel of a 1k texture
+  if (tex_coords_in_range) {
+    layout.tex_coord = TexCoordFormat::UNORM16;
+  }
+  else {
+    layout.tex_coord = max_tex_coord <= 2.0f ? TexCoordFormat::HALF : TexCoordFormat::FLOAT32;
+  }
+
+  layout.normal = normals ? NormalFormat::OCT_SNORM16 : NormalFormat::NONE;
+  return layout;
+}
+
+QuantizedMesh QuantizeVertices(const std::vector<Vertex>& vertices, const VertexLayout& layout,
+  const std::vector<glm::vec3>* normals) {
+  QuantizedMesh mesh;
+  mesh.layout = layout;
+  mesh.vertex_count = static_cast<uint32_t>(vertices.size());
+
+  uint32_t stride = layout.Stride();
+  AttributeOffsets offsets = GetOffsets(layout);
+  mesh.data.resize(static_cast<size_t>(stride) * vertices.size());
+
+  glm::vec3 scale(1.0f);
+  glm::vec3 offset(0.0f);
+  if (layout.position != PositionFormat::FLOAT32) {
+    glm::vec3 bounds_min, bounds_max;
+    GetBounds(vertices, bounds_min, bounds_max);
+
+    offset = (bounds_min + bounds_max) * 0.5f;
+    scale = (bounds_max - bounds_min) * 0.5f;
+    // a flat axis would divide by zero, any scale works for it
+    for (int ii = 0; ii < 3; ii++) {
+      if (scale[ii] <= 0.0f) {
+        scale[ii] = 1.0f;
+      }
+    }
+  }
+  mesh.constants.position_scale = glm::vec4(scale, 1.0f);
+  mesh.constants.position_offset = glm::vec4(offset, 0.0f);
+
+  for (size_t ii = 0; ii < vertices.size(); ii++) {
+    const Vertex& vertex = vertices[ii];
+    uint8_t* data = mesh.data.data() + ii * stride;
+
+    if (layout.position == PositionFormat::FLOAT32) {
+      memcpy(data + offsets.position, &vertex.pos, sizeof(vertex.pos));
+    }
+    else {
+      glm::vec3 relative = (vertex.pos - offset) / scale;
+      uint16_t words[4] = {};
+      for (int jj = 0; jj < 3; jj++) {
+        words[jj] = layout.position == PositionFormat::HALF ?
+          FloatToHalf(relative[jj]) : static_cast<uint16_t>(ToSnorm16(relative[jj]));
+      }
+      memcpy(data + offsets.position, words, sizeof(words));
+    }
+
+    if (layout.color == ColorFormat::FLOAT32) {
+      memcpy(data + offsets.color, &vertex.color, sizeof(vertex.color));
+    }
+    else if (layout.color == ColorFormat::UNORM8) {
+      uint8_t rgba[4] = { ToUnorm8(vertex.color.r), ToUnorm8(vertex.color.g), ToUnorm8(vertex.color.b), 255 };
+      memcpy(data + offsets.color, rgba, sizeof(rgba));
+    }
+
+    if (layout.tex_coord == TexCoordFormat::FLOAT32) {
+      memcpy(data + offsets.tex_coord, &vertex.tex_coord, sizeof(vertex.tex_coord));
+    }
+    else {
+      uint16_t words[2];
+      for (int jj = 0; jj < 2; jj++) {
+        words[jj] = layout.tex_coord == TexCoordFormat::HALF ?
+          FloatToHalf(vertex.tex_coord[jj]) : ToUnorm16(vertex.tex_coord[jj]);
+      }
+      memcpy(data + offsets.tex_coord, words, sizeof(words));
+    }
+
+    if (layout.normal == NormalFormat::OCT_SNORM16) {
+      glm::vec3 normal = normals ? (*normals)[ii] : glm::vec3(0.0f, 0.0f, 1.0f);
+      glm::vec2 encoded = OctEncode(normal);
+      int16_t words[2] = { ToSnorm16(encoded.x), ToSnorm16(encoded.y) };
+      memcpy(data + offsets.normal, words, sizeof(words));
+    }
+  }
+
+  return mesh;
+}
+
+QuantizationReport AnalyzeQuantization(const std::vector<Vertex>& vertices, const QuantizedMesh& mesh,
+  const std::vector<glm::vec3>* normals) {
+  QuantizationReport report{};
+  report.stride_before = sizeof(Vertex);
+  report.stride_after = mesh.layout.Stride();
+  report.bytes_before = sizeof(Vertex) * vertices.size();
+  report.bytes_after = mesh.data.size();
+
+  for (uint32_t ii = 0; ii < mesh.vertex_count; ii++) {
+    glm::vec3 normal;
+    Vertex decoded = DecodeVertex(mesh, ii, normal);
+
+    glm::vec3 position_error = glm::abs(decoded.pos - vertices[ii].pos);
+    glm::vec2 tex_coord_error = glm::abs(decoded.tex_coord - vertices[ii].tex_coord);
+    report.max_position_error = std::max(report.max_position_error,
+      std::max(position_error.x, std::max(position_error.y, position_error.z)));
+    report.max_tex_coord_error = std::max(report.max_tex_coord_error, std::max(tex_coord_error.x, tex_coord_error.y));
+
+    if (normals && mesh.layout.normal != NormalFormat::NONE) {
+      float cosine = std::clamp(glm::dot(glm::normalize((*normals)[ii]), normal), -1.0f, 1.0f);
+      report.max_normal_error = std::max(report.max_normal_error, glm::degrees(std::acos(cosine)));
+    }
+  }
+
+  return report;
+}
+
+uint16_t FloatToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+  int32_t float_exponent = (bits >> 23) & 0xff;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (float_exponent == 0xff) {
+    // inf stays inf, nan stays a quiet nan
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  }
+
+  int32_t exponent = float_exponent - 127 + 15;
+  if (exponent >= 31) {
+    return sign | 0x7c00;
+  }
+
+  if (exponent <= 0) {
+    // subnormal half, or too small for one
+    if (exponent < -10) {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    uint32_t shift = static_cast<uint32_t>(14 - exponent);
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1))) {
+      half++;
+    }
+    return static_cast<uint16_t>(sign | half);
+  }
+
+  // round to nearest even, a carry out of the mantissa correctly bumps the exponent
+  uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+  uint32_t rest = mantissa & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+    half++;
+  }
+  return static_cast<uint16_t>(sign | half);
+}
+
+float HalfToFloat(uint16_t value) {
+  uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  uint32_t exponent = (value >> 10) & 0x1f;
+  uint32_t mantissa = value & 0x3ff;
+  uint32_t bits;
+
+  if (exponent == 0) {
+    if (mantissa == 0) {
+      bits = sign;
+    }
+    else {
+      // subnormal, renormalize for the float
+      exponent = 127 - 15 + 1;
+      while (!(mantissa & 0x400)) {
+        mantissa <<= 1;
+        exponent--;
+      }
+      bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+  }
+  else if (exponent == 31) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  }
+  else {
+    bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+  }
+
+  float result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+glm::vec2 OctEncode(const glm::vec3& normal) {
+  float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  if (length <= 0.0f) {
+    return glm::vec2(0.0f);
+  }
+
+  glm::vec3 projected = normal / length;
+  glm::vec2 encoded(projected.x, projected.y);
+
+  // fold the lower hemisphere over the diagonals
+  if (projected.z < 0.0f) {
+    encoded = glm::vec2(
+      (1.0f - std::abs(projected.y)) * (projected.x >= 0.0f ? 1.0f : -1.0f),
+      (1.0f - std::abs(projected.x)) * (projected.y >= 0.0f ? 1.0f : -1.0f));
+  }
+  return encoded;
+}
+
+glm::vec3 OctDecode(const glm::vec2& encoded) {
+  glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+  float fold = std::max(-normal.z, 0.0f);
+  normal.x += normal.x >= 0.0f ? -fold : fold;
+  normal.y += normal.y >= 0.0f ? -fold : fold;
+  return glm::normalize(normal);
+}
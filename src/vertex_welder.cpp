@@ -0,0 +1,74 @@
+#include "vertex_welder.h"
+#include <cstring>
+
+// hashing and comparing the raw bytes is only safe if there is no padding in between
+static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex has padding, welding would compare garbage");
+
+VertexWelder::VertexWelder(std::vector<Vertex>& vertices, size_t expected_vertices) :
+  vertices_(vertices), base_(vertices.size()) {
+  // keep the load factor under one half
+  size_t capacity = 16;
+  while (capacity < expected_vertices * 2) {
+    capacity *= 2;
+  }
+
+  slots_.assign(capacity, EMPTY);
+  mask_ = capacity - 1;
+  vertices_.reserve(vertices_.size() + expected_vertices);
+}
+
+uint32_t VertexWelder::Add(const Vertex& vertex) {
+  if ((vertices_.size() - base_ + 1) * 2 > slots_.size()) {
+    Grow();
+  }
+
+  // linear probing, the table is never more than half full so runs stay short
+  size_t slot = Hash(vertex) & mask_;
+  while (slots_[slot] != EMPTY) {
+    if (memcmp(&vertices_[slots_[slot]], &vertex, sizeof(Vertex)) == 0) {
+      return slots_[slot];
+    }
+    slot = (slot + 1) & mask_;
+  }
+
+  uint32_t index = static_cast<uint32_t>(vertices_.size());
+  slots_[slot] = index;
+  vertices_.push_back(vertex);
+  return index;
+}
+
+uint32_t VertexWelder::Hash(const Vertex& vertex) {
+  uint32_t words[8];
+  memcpy(words, &vertex, sizeof(words));
+
+  // murmur3 style mixing, one multiply and rotate per word
+  uint32_t hash = 0x9747b28c;
+  for (uint32_t word : words) {
+    word *= 0xcc9e2d51;
+    word = (word << 15) | (word >> 17);
+    word *= 0x1b873593;
+    hash ^= word;
+    hash = (hash << 13) | (hash >> 19);
+    hash = hash * 5 + 0xe6546b64;
+  }
+
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+void VertexWelder::Grow() {
+  slots_.assign(slots_.size() * 2, EMPTY);
+  mask_ = slots_.size() - 1;
+
+  for (uint32_t ii = static_cast<uint32_t>(base_); ii < vertices_.size(); ii++) {
+    size_t slot = Hash(vertices_[ii]) & mask_;
+    while (slots_[slot] != EMPTY) {
+      slot = (slot + 1) & mask_;
+    }
+    slots_[slot] = ii;
+  }
+}